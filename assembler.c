@@ -30,7 +30,7 @@ Instruction instructions[] = {
     {"add", 0}, {"sub", 1}, {"and", 2}, {"or", 3}, {"xor", 4},
     {"mul", 5}, {"sll", 6}, {"sra", 7}, {"srl", 8}, {"beq", 9},
     {"bne", 10}, {"blt", 11}, {"bgt", 12}, {"ble", 13}, {"bge", 14},
-    {"jal", 15}, {"lw", 16}, {"sw", 17}, {"halt", 20},
+    {"jal", 15}, {"lw", 16}, {"sw", 17}, {"fence", 18}, {"halt", 20},
     {NULL, -1}
 };
 
@@ -11,47 +11,212 @@ typedef enum {
     BUS_CMD_NO_CMD = 0, // No active command
     BUS_CMD_READ   = 1, // BusRd: Request to read a block (Shared intent)
     BUS_CMD_READX  = 2, // BusRdX: Request to read a block (Exclusive intent)
-    BUS_CMD_FLUSH  = 3  // Flush: Writing a block back to memory (or to another cache)
+    BUS_CMD_FLUSH  = 3, // Flush: Writing a block back to memory (or to another cache)
+    BUS_CMD_UPDATE = 4, // BusUpd: One written word for the other copies (write-update protocols)
+    BUS_CMD_UPGRADE = 5 // BusUpgr: Invalidate the other copies of a block the requester already holds
 } BusCmd;
 
+/*
+ * Supply Kinds
+ * A Flush of a snooped block that only feeds the requester (MOESI, MESIF):
+ * main memory neither absorbs it nor needs to. Named after what MESI would
+ * have spent instead.
+ */
+typedef enum {
+    SUPPLY_NONE             = 0, // Ordinary Flush: memory is updated
+    SUPPLY_SAVES_WRITE_BACK = 1, // A Modified block: MESI would have written it back
+    SUPPLY_SAVES_READ       = 2  // An Owned or Forward block: MESI would have read it from memory
+} SupplyKind;
+
+/*
+ * Bus Channels
+ * What a Bus instance carries. By default a single shared bus carries the
+ * requests and the data; with a separate data bus, one instance carries the
+ * requests (address and command) and another the Flush words.
+ */
+typedef enum {
+    BUS_CHANNEL_SHARED  = 0, // Requests and data on one bus
+    BUS_CHANNEL_ADDRESS = 1, // BusRd, BusRdX, BusUpgr and BusUpd only (one cycle each)
+    BUS_CHANNEL_DATA    = 2  // Flushes and memory data phases only, 'width' words per cycle
+} BusChannel;
+
+/*
+ * Arbitration Policies
+ * How the arbiter picks the next master among the requesting agents.
+ */
+typedef enum {
+    ARBITRATE_ROUND_ROBIN = 0, // Memory first, then the cores in turn after the last one served (the original arbiter)
+    ARBITRATE_FIXED       = 1, // Memory first, then the lowest core id
+    ARBITRATE_OLDEST      = 2, // The request presented first
+    ARBITRATE_WEIGHTED    = 3, // Weighted fair share: the fewest grants per unit of weight
+    ARBITRATE_TDMA        = 4  // Time slots in turn (cores, then memory); only the slot's owner is granted
+} ArbitrationPolicy;
+
+#define ARBITRATION_NUM_POLICIES 5
+
+/*
+ * ARB_WAIT_BUCKETS
+ * Grant-wait histogram buckets: bucket 0 counts the requests granted in the
+ * cycle they were presented, bucket b > 0 the waits of 2^(b-1) to 2^b - 1
+ * cycles, and the last one every longer wait.
+ */
+#define ARB_WAIT_BUCKETS 16
+
+/*
+ * ARB_MAX_WEIGHT
+ * Largest weight of an agent under weighted fair share.
+ */
+#define ARB_MAX_WEIGHT 1000
+
+/*
+ * ArbiterAgentStats
+ * Grants of one agent and the cycles each of its requests waited for them.
+ */
+typedef struct {
+    int grants;
+    long long wait_cycles;
+    int max_wait;
+    int histogram[ARB_WAIT_BUCKETS];
+} ArbiterAgentStats;
+
+/*
+ * Arbiter Structure
+ * Policy state of one bus and the grant waits of its agents (the cores,
+ * then the memory). A request waits from the first cycle it is presented
+ * (withdrawn requests start over) until its grant; the agent holding the
+ * bus is not counted as requesting. On an atomic bus the memory only
+ * requests the bus to answer the read in progress, so it is granted
+ * whatever the policy.
+ */
+typedef struct {
+    int policy;                     // ArbitrationPolicy
+    int agents;                     // num_cores + 1
+    int slot_cycles;                // TDMA slot length
+    bool atomic;                    // Memory requests continue the current read
+    int last_cycle;                 // Last cycle arbitrated (-1 = none since the last quiesce)
+    int since[MAX_CORES + 1];       // Cycle each pending request was presented (-1 = none)
+    int weight[MAX_CORES + 1];      // Weighted fair share
+    long long pass[MAX_CORES + 1];  // Weighted fair share: grants scaled by 1 / weight
+    long long virtual_time;         // Pass of the last grant (where a new request starts)
+    ArbiterAgentStats stats[MAX_CORES + 1];
+} Arbiter;
+
+/*
+ * BusStats
+ * Traffic counters of the lockstep engine, with the savings of a cache-to-
+ * cache supply over MESI.
+ */
+typedef struct {
+    int busy_cycles;           // Cycles the bus carried a command or was held
+    int reads;                 // BusRd
+    int read_exclusives;       // BusRdX
+    int upgrades;              // BusUpgr, a single cycle each
+    int updates;               // BusUpd, one word each
+    int flush_words;           // Words flushed or supplied by the caches
+    int memory_read_words;     // Words sent by main memory
+    int memory_write_words;    // Flushed words main memory absorbed
+    int write_backs_avoided;   // SUPPLY_SAVES_WRITE_BACK blocks
+    int memory_reads_avoided;  // SUPPLY_SAVES_READ blocks
+    int memory_cycles_avoided; // Read latency abandoned for them
+    int read_cycles;           // Split bus: cycles with at least one read queued at memory or sending its data
+    long long read_occupancy;  // Those reads, summed over the cycles
+    int requests_behind_data;  // Shared split bus: core-cycles a request waited behind a data transfer
+} BusStats;
+
 /*
  * Bus State Structure
  * Represents the physical wires and internal state of the system bus.
  */
 typedef struct {
     // --- Visible Signals (Wires) ---
-    int bus_origid;      // ID of the component driving the bus (0-3=Cores, 4=Mem)
+    int bus_origid;      // ID of the component driving the bus (0..num_cores-1=Cores, num_cores=Mem)
     BusCmd bus_cmd;      // Current command on the bus
     uint32_t bus_addr;   // Address being accessed
-    uint32_t bus_data;   // Data being transferred (valid during Flush)
+    uint32_t bus_data;   // Data being transferred (valid during Flush and BusUpd)
     int bus_shared;      // Shared signal (wired-OR), asserted by snoopers
+    int bus_supply;      // SupplyKind of a Flush from a cache
+    int bus_requester;   // Split transactions: core a memory data phase answers (-1 = untagged)
 
     // --- Internal Arbiter State ---
+    int num_cores;            // Number of cores; the memory is agent 'num_cores'
     bool busy;                // True if a multi-cycle transaction is in progress
     int current_grant;        // ID of the component currently granted bus access
-    int arbitration_rr_index; // Round-Robin pointer (last serviced agent)
+    int arbitration_rr_index; // Round-Robin pointer (last serviced core)
     
     int memory_countdown;     // (Legacy/Unused) Timer for memory operations
+
+    int channel;              // BusChannel carried by this instance
+    int width;                // Words per cycle (data channel)
+
+    BusStats stats;
 } Bus;
 
+/*
+ * BUS_MEMORY_ID
+ * Arbiter slot (and bus_origid) of the main memory: the one after the cores.
+ */
+#define BUS_MEMORY_ID(bus) ((bus)->num_cores)
+
 /*
  * bus_init
- * Initializes the bus structure to default values.
+ * Initializes the bus structure to default values for 'num_cores' cores:
+ * a shared bus, one word wide.
  */
-void bus_init(Bus *bus);
+void bus_init(Bus *bus, int num_cores);
 
 /*
  * bus_reset_signals
- * Clears the transient signals (cmd, addr, data, shared) at the start of a cycle.
+ * Clears the transient signals (cmd, addr, data, shared, supply, requester) at the start of a cycle.
  * Does NOT clear internal state like 'busy' or 'arbitration_rr_index'.
  */
 void bus_reset_signals(Bus *bus);
 
+/*
+ * arbiter_init
+ * Resets an arbiter for 'num_cores' cores: 'weights' holds the weighted
+ * fair share weight of every agent (cores, then memory; 0 counts as 1).
+ */
+void arbiter_init(Arbiter *arb, int num_cores, int policy, int slot_cycles, const int *weights, bool atomic);
+
+/*
+ * arbiter_quiesce
+ * Forgets the pending requests, after the bus has been drained outside of
+ * the timing model (functional fast-forward).
+ */
+void arbiter_quiesce(Arbiter *arb);
+
+/*
+ * arbiter_parse_policy / arbiter_policy_name
+ * Maps "rr", "fixed", "oldest", "weighted" or "tdma" to its
+ * ArbitrationPolicy, and back.
+ */
+bool arbiter_parse_policy(const char *name, int *policy);
+const char *arbiter_policy_name(int policy);
+
+/*
+ * arbiter_parse_weights
+ * Reads colon-separated weights ("4:1:1:1") into 'weights' (max_agents
+ * entries, the rest set to 1). Returns false for an empty or malformed
+ * list, a weight outside 1..ARB_MAX_WEIGHT or too many entries.
+ */
+bool arbiter_parse_weights(const char *text, int *weights, int max_agents);
+
+/*
+ * arbiter_wait_percentile
+ * Grant wait of an agent at the given fraction of its requests (0.99 for
+ * the 99th percentile), as the upper bound of the histogram bucket that
+ * holds it (at most the largest wait seen). 0 without grants.
+ */
+int arbiter_wait_percentile(const ArbiterAgentStats *stats, double fraction);
+
 /*
  * bus_arbitrate
- * Performs Round-Robin arbitration to select the next bus master.
- * Updates 'current_grant' based on the 'request_vector'.
+ * Selects the next bus master with the arbiter's policy. Updates
+ * 'current_grant' based on the 'request_vector' (num_cores + 1 entries: one
+ * per core, then the memory) and records the grant waits at 'cycle'. With a
+ * separate data bus, each channel runs it on its own instance (grant, busy
+ * flag and pointer) and arbiter.
  */
-void bus_arbitrate(Bus *bus, bool request_vector[5]);
+void bus_arbitrate(Bus *bus, Arbiter *arb, const bool *request_vector, int cycle);
 
 #endif
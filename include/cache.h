@@ -3,6 +3,7 @@
 
 #include "global.h"
 #include "bus.h"
+#include "coherence.h"
 
 /*
  * TSRAM Entry
@@ -10,28 +11,136 @@
  */
 typedef struct {
     uint32_t tag;    // The tag bits of the stored address
-    MesiState state; // The MESI state of the block (Modified, Exclusive, Shared, Invalid)
+    MesiState state; // The coherence state of the block (Modified, Exclusive, Shared, Invalid, ...)
 } TSRAM_Entry;
 
+/*
+ * ReplacementPolicy
+ * How a set-associative L1 chooses the line a miss replaces. An invalid way
+ * is always taken first.
+ */
+typedef enum {
+    REPLACE_LRU    = 0, // Least recently used
+    REPLACE_PLRU   = 1, // Tree pseudo-LRU
+    REPLACE_RANDOM = 2, // Per-cache xorshift generator
+    REPLACE_SRRIP  = 3  // Static re-reference interval prediction, 2-bit RRPVs
+} ReplacementPolicy;
+
+/*
+ * CacheGeometry
+ * Shape of an L1, fixed at startup. Sets, ways and block words are powers
+ * of two; an address splits into tag | set index | word offset.
+ */
+typedef struct {
+    int sets;
+    int ways;
+    int block_words;
+    ReplacementPolicy policy;
+    int offset_bits; // log2(block_words)
+    int index_bits;  // log2(sets)
+} CacheGeometry;
+
+/*
+ * MAX_MSHRS / MSHR_TARGETS
+ * Largest number of miss status holding registers of an L1, and of accesses
+ * each one can hold for its block.
+ */
+#define MAX_MSHRS 8
+#define MSHR_TARGETS 8
+
+/*
+ * MSHRTarget
+ * A load or store waiting for the block of its MSHR, in program order.
+ */
+typedef struct {
+    bool     is_write;
+    uint8_t  offset;  // Word in the block
+    uint8_t  reg;     // Load destination (0 once a younger write supersedes it)
+    uint32_t data;    // Store data
+} MSHRTarget;
+
+/*
+ * MSHR
+ * An outstanding miss of a non-blocking L1. MSHRs are kept in allocation
+ * order and issued to the bus one at a time, so the oldest is the one whose
+ * fill is awaited (pending_addr) once 'issued' is set.
+ */
+typedef struct {
+    bool     exclusive;   // A store needs the block Modified (BusRdX)
+    bool     issued;
+    uint32_t addr;        // Address of the first access
+    int      num_targets;
+    MSHRTarget target[MSHR_TARGETS];
+} MSHR;
+
+/*
+ * VICTIM_MAX_ENTRIES
+ * Largest victim cache of an L1.
+ */
+#define VICTIM_MAX_ENTRIES 16
+
+/*
+ * VictimEntry
+ * A line displaced from the L1 arrays, with its MESI state. 'stamp' orders
+ * the entries by insertion; a hit moves the block back into the L1, so the
+ * oldest entry is also the least recently used one.
+ */
+typedef struct {
+    uint32_t  addr;   // Base address of the block
+    MesiState state;
+    uint32_t  stamp;
+    uint32_t  data[MAX_BLOCK_WORDS];
+} VictimEntry;
+
+/*
+ * LoadFill
+ * A deferred load completed by a fill, for the core to write back.
+ */
+typedef struct {
+    uint8_t  reg;
+    uint32_t value;
+} LoadFill;
+
+/*
+ * AccessResult
+ * Outcome of an access to a non-blocking L1.
+ */
+typedef enum {
+    ACCESS_STALL,    // Retry next cycle
+    ACCESS_DONE,     // Hit: the load has its data, the store is written
+    ACCESS_DEFERRED  // Miss held by an MSHR: the fill completes the access
+} AccessResult;
+
 /*
  * Cache Structure
  * Represents the L1 Cache hardware for a single core.
  */
 typedef struct {
     // --- Storage ---
-    // Data SRAM: 64 sets, 8 words (32 bytes) per block
-    uint32_t dsram[NUM_CACHE_SETS][BLOCK_SIZE];
+    // Lines are numbered set * ways + way. Data SRAM: one block per line
+    uint32_t dsram[L1_MAX_WORDS];
+
+    // Tag SRAM: one entry per line
+    TSRAM_Entry tsram[L1_MAX_LINES];
 
-    // Tag SRAM: 64 entries
-    TSRAM_Entry tsram[NUM_CACHE_SETS];
+    CacheGeometry geo;
+    int core_id;  // ID of the core owning this cache
+    int protocol; // CoherenceKind of the transition tables
+    bool upgrades; // A store to a resident clean copy issues a BusUpgr instead of a BusRdX
+    bool critical_word_first; // Bursts start at the requested word; a load restarts once its word is filled
+    bool split_bus;           // Other transactions come between our request and its data phase
 
-    int core_id; // ID of the core owning this cache
+    // --- Replacement State ---
+    uint8_t  repl[L1_MAX_LINES];      // LRU: recency rank (0 = most recent); SRRIP: RRPV
+    uint16_t plru_tree[L1_MAX_LINES]; // Tree-PLRU: the ways-1 node bits of each set
+    uint32_t rng;                     // Random: generator state
 
     // --- Statistics ---
     int read_hits;
     int write_hits;
     int read_miss;
     int write_miss;
+    int restart_savings;      // Fill cycles that restarted loads did not wait for
 
     // --- Internal State Flags ---
     bool waiting_for_write;   // True if the pending operation is a Write (Store)
@@ -43,17 +152,79 @@ typedef struct {
     bool eviction_pending;
     bool is_flushing;         // True if we are currently flushing a block to the bus
     uint32_t flush_addr;      // The address of the block being flushed
-    int flush_offset;         // Current word index (0-7) being flushed
+    int flush_line;           // Its line
+    int flush_victim;         // Or its victim cache entry (-1 = the flush reads flush_line)
+    int flush_offset;         // Words already flushed
+    int flush_start;          // First word of the burst (the requested one with critical-word-first)
+    int flush_supply;         // SupplyKind: a snooped block sent to the requester only (memory and the state stay)
+    int fill_line;            // Line receiving the fill in progress (-1 before its first word)
+    uint32_t fill_words;      // Words of that fill received so far (bit per offset)
+    bool restarted;           // Its load has completed with the critical word (early restart)
+    bool update_pending;      // Write-update: a BusUpd of update_data to pending_addr awaits the bus
+    bool update_done;         // The BusUpd has been on the bus: the write completes at its retry
+    uint32_t update_data;
     
     int sram_check_countdown; // Timer to simulate SRAM access latency (1 cycle)
+
+    // --- Non-Blocking Mode (num_mshrs > 0) ---
+    int num_mshrs;            // 0 = a miss blocks the core until it is filled
+    int outstanding;          // Allocated MSHRs, oldest first
+    MSHR mshr[MAX_MSHRS];
+    int num_fills;            // Loads completed by the last fill
+    LoadFill fills[MSHR_TARGETS];
+
+    // --- Victim Cache (victim_entries > 0, blocking L1 only) ---
+    int victim_entries;       // 0 = displaced lines leave the L1 (Modified ones are written back)
+    uint32_t victim_clock;    // Stamp of the next insertion
+    int victim_hits;          // L1 misses served by the victim cache
+    VictimEntry victim[VICTIM_MAX_ENTRIES];
 } Cache;
 
 /*
  * cache_init
  * Initializes the cache structure, clearing memory and resetting stats.
+ * The geometry is the default direct-mapped one.
  */
 void cache_init(Cache *cache, int core_id);
 
+/*
+ * cache_set_geometry
+ * Reshapes an empty cache. Returns false if the sizes are not powers of two
+ * or exceed the SRAM capacities (L1_MAX_LINES, L1_MAX_WORDS, L1_MAX_WAYS,
+ * MAX_BLOCK_WORDS).
+ */
+bool cache_set_geometry(Cache *cache, int sets, int ways, int block_words, ReplacementPolicy policy);
+
+/*
+ * cache_parse_replacement
+ * Maps "lru", "plru", "random" or "srrip" to its ReplacementPolicy.
+ */
+bool cache_parse_replacement(const char *name, int *policy);
+
+/*
+ * cache_block_base / cache_set_index
+ * First address of the block holding 'addr', and the set it maps to.
+ */
+uint32_t cache_block_base(const Cache *cache, uint32_t addr);
+uint32_t cache_set_index(const Cache *cache, uint32_t addr);
+
+/*
+ * cache_fill_line
+ * Line that a fill of 'addr' writes: the one already receiving it, the
+ * Shared copy being upgraded, or the replacement victim. Has no side
+ * effects.
+ */
+int cache_fill_line(const Cache *cache, uint32_t addr);
+
+/*
+ * cache_flush_data / cache_flush_done
+ * The block the flush in progress reads (an L1 line or a victim cache
+ * entry), and the end of that flush: a Modified copy, written back to make
+ * room, becomes Invalid.
+ */
+const uint32_t *cache_flush_data(const Cache *cache);
+void cache_flush_done(Cache *cache);
+
 /*
  * cache_read
  * Attempts to read a word from the cache.
@@ -68,11 +239,164 @@ bool cache_read(Cache *cache, uint32_t addr, uint32_t *data, Bus *bus);
  */
 bool cache_write(Cache *cache, uint32_t addr, uint32_t data, Bus *bus);
 
+/*
+ * cache_read_async / cache_write_async
+ * Non-blocking counterparts of cache_read and cache_write. A miss is handed
+ * to an MSHR (a new one, or the one already fetching the block) and the
+ * access completes when the block arrives: a deferred load then appears in
+ * 'fills' for register 'reg'. Stalls only while a Modified victim is
+ * evicted, for the tag check of a new miss, or when no MSHR can take the
+ * access.
+ */
+AccessResult cache_read_async(Cache *cache, uint32_t addr, uint32_t *data, uint32_t reg);
+AccessResult cache_write_async(Cache *cache, uint32_t addr, uint32_t data);
+
+/*
+ * cache_cancel_load
+ * Drops the register write of the deferred loads of 'reg', which a younger
+ * instruction has written.
+ */
+void cache_cancel_load(Cache *cache, uint32_t reg);
+
+/*
+ * cache_would_flush
+ * True if this cache owns the block of 'addr': a snooped BusRd or BusRdX
+ * would make it flush or supply the block.
+ */
+bool cache_would_flush(const Cache *cache, uint32_t addr);
+
+/*
+ * cache_wants_bus
+ * True if a non-blocking L1 has an eviction or the oldest MSHR to put on
+ * the bus.
+ */
+bool cache_wants_bus(const Cache *cache);
+
+/*
+ * cache_issue_miss
+ * Drives the BusRd/BusRdX of the oldest MSHR, which then awaits its fill.
+ */
+void cache_issue_miss(Cache *cache, Bus *bus);
+
+/*
+ * cache_request_cmd
+ * Bus command of a registered miss of 'addr': BusRd, or BusRdX for a store
+ * ('exclusive'). With upgrades, a store whose block is still resident
+ * issues a BusUpgr instead; a snoop may have invalidated the copy since
+ * the miss was registered, so this is decided when the request goes out.
+ */
+BusCmd cache_request_cmd(const Cache *cache, uint32_t addr, bool exclusive);
+
+/*
+ * cache_issue_update
+ * Drives the BusUpd of a pending write to a shared block (write-update
+ * protocols). It takes a single bus cycle.
+ */
+void cache_issue_update(Cache *cache, Bus *bus);
+
 /*
  * cache_snoop
  * Listens to the bus for transactions from other cores.
  * Updates MESI state, asserts Shared signal, and triggers flushes if necessary.
+ * With a separate data bus it is called once for the address channel and
+ * once per data channel beat.
  */
 void cache_snoop(Cache *cache, Bus *bus);
 
+/*
+ * cache_access_blocked
+ * Returns true if repeating the access (cache_read when !is_write, cache_write
+ * otherwise, or their asynchronous versions with MSHRs) would miss again
+ * without changing any cache state, i.e. the request is already registered
+ * and only a bus event can make progress.
+ */
+bool cache_access_blocked(const Cache *cache, uint32_t addr, bool is_write);
+
+/*
+ * cache_probe
+ * Returns the MESI state of the block holding 'addr' in the L1 arrays, or
+ * MESI_INVALID if the block is not resident there. Has no side effects.
+ */
+MesiState cache_probe(const Cache *cache, uint32_t addr);
+
+/*
+ * cache_peek
+ * Returns the word of 'addr' in the L1 arrays, or 0 if its block is not
+ * resident there. Has no side effects.
+ */
+uint32_t cache_peek(const Cache *cache, uint32_t addr);
+
+/*
+ * cache_back_invalidate
+ * Drops the copy of the block of 'addr' from the arrays or the victim cache
+ * when an inclusive LLC replaces it, and returns its former state (copying
+ * the block to 'block' if it was Modified). A write-back of the copy that
+ * is still waiting for the bus is cancelled.
+ */
+MesiState cache_back_invalidate(Cache *cache, uint32_t addr, uint32_t block[MAX_BLOCK_WORDS]);
+
+/*
+ * Functional Coherence
+ * Whole-transaction counterparts of the bus-driven state machine, used by
+ * the approximate engines that resolve a miss in one step instead of cycle
+ * by cycle. They apply the same protocol transitions as cache_snoop and
+ * leave the statistics untouched.
+ */
+
+/*
+ * cache_functional_snoop
+ * Applies a remote BusRd (exclusive = false) or BusRdX for 'addr' to this
+ * cache and its victim cache. Returns true if the cache held the block. If
+ * the copy sends its data (the owner), the block is copied to 'block' and
+ * *action tells whether memory is updated too (SNOOP_FLUSH) or not
+ * (SNOOP_SUPPLY); otherwise *action is SNOOP_KEEP.
+ */
+bool cache_functional_snoop(Cache *cache, uint32_t addr, bool exclusive,
+                            uint32_t block[MAX_BLOCK_WORDS], SnoopAction *action);
+
+/*
+ * cache_functional_hit
+ * Returns the DSRAM word of 'addr' if the access hits (a write needs the
+ * line Modified or Exclusive and makes it Modified), or NULL. A block in
+ * the victim cache is swapped into the L1 first.
+ */
+uint32_t *cache_functional_hit(Cache *cache, uint32_t addr, bool is_write);
+
+/*
+ * cache_functional_write_back
+ * If the block of 'addr' is resident in a state a store must write back
+ * before its upgrade (MOESI Owned), copies it to 'block', applies the
+ * write-back and returns true. Called after a missed cache_functional_hit.
+ */
+bool cache_functional_write_back(Cache *cache, uint32_t addr, uint32_t block[MAX_BLOCK_WORDS]);
+
+/*
+ * cache_functional_snoop_update / cache_functional_update
+ * A BusUpd of 'value' to 'addr' (write-update protocols): the first writes
+ * it into another core's copy and returns true if there was one; the second
+ * completes the writer's store (its line is resident, in a state whose
+ * writes need a BusUpd), with 'shared' set if any copy remained, and
+ * returns its DSRAM word.
+ */
+bool cache_functional_snoop_update(Cache *cache, uint32_t addr, uint32_t value);
+uint32_t *cache_functional_update(Cache *cache, uint32_t addr, bool shared);
+
+/*
+ * cache_functional_fill
+ * Installs the block holding 'addr' with the given state in its fill line
+ * (which must not hold a different Modified block) and returns the DSRAM
+ * word of 'addr'.
+ */
+uint32_t *cache_functional_fill(Cache *cache, uint32_t addr, const uint32_t block[MAX_BLOCK_WORDS], MesiState state);
+
+/*
+ * cache_functional_evict
+ * If the block of 'addr' is not resident and its victim is Modified, copies
+ * the victim to 'block', stores its base address in *victim_addr,
+ * invalidates the line and returns true. With a victim cache, the victim
+ * line moves there instead, and the block written back (if any) is the
+ * Modified entry it replaces.
+ */
+bool cache_functional_evict(Cache *cache, uint32_t addr, uint32_t *victim_addr, uint32_t block[MAX_BLOCK_WORDS]);
+
 #endif
@@ -0,0 +1,38 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "global.h"
+#include "sim.h"
+
+/*
+ * CHECKPOINT_MAGIC / CHECKPOINT_VERSION
+ * File signature ("CMCK") and format revision of a checkpoint.
+ */
+#define CHECKPOINT_MAGIC 0x4B434D43
+#define CHECKPOINT_VERSION 6
+
+/*
+ * sim_checkpoint_save
+ * Writes the complete state of a lockstep simulation, as of the start of
+ * cycle sim->cycle, to 'path': every core with its L1, the bus arbiters, the
+ * memory controller and the non-zero parts of main memory. Must be called
+ * between steps (sim_step / sim_run_until). Returns false on an I/O error,
+ * in bound-weave mode or in a sampled run, whose state is not checkpointed.
+ */
+bool sim_checkpoint_save(const Sim *sim, const char *path);
+
+/*
+ * sim_checkpoint_restore
+ * Replaces the state of a freshly created and loaded instance with the one
+ * saved in 'path'; the run then continues at the checkpointed cycle. The
+ * instance must have the same core count. With the same configuration, the
+ * continuation is bit-identical to the uninterrupted run (traces are written
+ * from the checkpointed cycle on). Returns false if the file is unreadable,
+ * truncated, written by an incompatible build, for another core count or
+ * with another branch predictor, L1 or bus arbitration configuration. The
+ * file is checked before anything is replaced, so a failed restore leaves
+ * the instance unchanged.
+ */
+bool sim_checkpoint_restore(Sim *sim, const char *path);
+
+#endif
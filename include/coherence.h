@@ -0,0 +1,97 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include "global.h"
+
+/*
+ * CoherenceKind
+ * Snooping protocol of the L1s, selected at startup.
+ */
+typedef enum {
+    COHERENCE_MSI   = 0, // No Exclusive state: every read fill is Shared
+    COHERENCE_MESI  = 1, // The original protocol
+    COHERENCE_MOESI = 2, // Owned: a Modified block is shared dirty, without a write-back
+    COHERENCE_MESIF = 3, // Forward: one clean sharer supplies the block instead of memory
+    COHERENCE_DRAGON = 4 // Write-update: a store to a shared block broadcasts the word (BusUpd)
+} CoherenceKind;
+
+/*
+ * ProcessorRequest
+ * What an access needs after the tag check of a resident line (or of an
+ * Invalid one on a miss).
+ */
+typedef enum {
+    PR_HIT,        // Completes in the L1
+    PR_BUS_READ,   // BusRd, then a read fill
+    PR_BUS_READX,  // BusRdX, then a write fill (Modified)
+    PR_WRITE_BACK, // The dirty copy goes to memory first, then the BusRdX
+    PR_BUS_UPDATE  // BusUpd of the written word, then the write completes
+} ProcessorRequest;
+
+/*
+ * ProcessorTransition
+ * Entry of the processor table: the request and, for a hit, the new state.
+ */
+typedef struct {
+    uint8_t request; // ProcessorRequest
+    uint8_t next;    // MesiState after a hit
+} ProcessorTransition;
+
+/*
+ * SnoopAction
+ * What a snooping copy does with its data.
+ */
+typedef enum {
+    SNOOP_KEEP,   // Nothing: only the state changes
+    SNOOP_FLUSH,  // Flush it to the requester, with main memory updated too
+    SNOOP_SUPPLY  // Send it to the requester only: memory keeps its copy
+} SnoopAction;
+
+/*
+ * SnoopTransition
+ * Entry of the snoop table: the new state, the data action and whether the
+ * copy asserts the shared line in the request cycle.
+ */
+typedef struct {
+    uint8_t next;   // MesiState
+    uint8_t action; // SnoopAction
+    bool shared;
+} SnoopTransition;
+
+/*
+ * Event Indices
+ */
+#define PR_READ 0
+#define PR_WRITE 1
+#define SNOOP_READ 0  // BusRd from another core
+#define SNOOP_READX 1 // BusRdX from another core
+#define SNOOP_UPDATE 2 // BusUpd from another core (the word is written into the copy)
+
+/*
+ * CoherenceProtocol
+ * A protocol as state x event tables. Fills, write-backs and evictions
+ * complete the picture: a fill after a BusRdX is always Modified.
+ */
+typedef struct {
+    const char *name;
+    ProcessorTransition processor[MESI_NUM_STATES][2];
+    SnoopTransition snoop[MESI_NUM_STATES][3];
+    uint8_t read_fill[2];                  // State of a BusRd fill without / with the shared line
+    uint8_t updated[2];                    // State after the line's own BusUpd without / with the shared line
+    bool dirty[MESI_NUM_STATES];           // Written back before the line is dropped
+    uint8_t written_back[MESI_NUM_STATES]; // State after the line's own write-back
+} CoherenceProtocol;
+
+/*
+ * coherence_protocol
+ * The tables of a CoherenceKind.
+ */
+const CoherenceProtocol *coherence_protocol(int kind);
+
+/*
+ * coherence_parse
+ * Maps "msi", "mesi", "moesi", "mesif" or "dragon" to its CoherenceKind.
+ */
+bool coherence_parse(const char *name, int *kind);
+
+#endif
@@ -4,6 +4,34 @@
 #include "global.h"
 #include "cache.h"
 #include "bus.h"
+#include "predictor.h"
+#include "store_buffer.h"
+
+/*
+ * IMEM_SIZE
+ * Number of instruction words per core.
+ */
+#define IMEM_SIZE 1024
+
+/*
+ * DecodedInst
+ * An instruction with its fields extracted once, when the IMEM is loaded.
+ * 'src_mask' holds the registers Decode reads that can be busy (R2-R15): Rs,
+ * Rt except for JAL, and Rd for stores and branches. With forwarding, the
+ * sources are split by the stage that needs them: 'id_mask' for branch
+ * operands and jump targets, 'ex_mask' for ALU and address operands (with a
+ * branch predictor, Execute needs both).
+ */
+typedef struct {
+    uint8_t op;
+    uint8_t rd;
+    uint8_t rs;
+    uint8_t rt;
+    uint32_t imm;      // Sign-extended immediate (the value of R1)
+    uint16_t src_mask;
+    uint16_t id_mask;
+    uint16_t ex_mask;
+} DecodedInst;
 
 /*
  * Pipeline Latches
@@ -14,6 +42,7 @@
 typedef struct {
     uint32_t PC;          // PC of the instruction
     uint32_t Instruction; // The raw 32-bit instruction
+    Prediction Predicted; // Fetch's guess for a branch or jump
 } IF_ID_Latch;
 
 // Decode -> Execute
@@ -22,6 +51,8 @@ typedef struct {
     uint32_t A;           // Value of Rs
     uint32_t B;           // Value of Rt
     uint32_t Imm;         // Sign-extended immediate
+    uint32_t Target;      // Branch or jump target (value of Rd), with a predictor
+    Prediction Predicted;
     uint32_t Rd_Index;    // Destination register index
     uint32_t Rt_Index;    // Source/Dest register index (depending on op)
     uint32_t Rs_Index;    // Source register index
@@ -46,6 +77,7 @@ typedef struct {
     uint32_t ALUOutput;   // ALU result passed through
     uint32_t Rd_Index;    // Destination register index
     Opcode   Op;
+    bool     Deferred;    // Load missing in a non-blocking L1: the fill writes Rd
     bool     valid;
 } MEM_WB_Latch;
 
@@ -54,12 +86,13 @@ typedef struct {
  * Represents the state of a single MIPS core.
  */
 typedef struct {
-    int id; // Core ID (0-3)
+    int id; // Core ID (0..num_cores-1)
 
     // --- Architectural State ---
     uint32_t regs[REG_COUNT];          // Register File (R0-R15)
     uint32_t pc;                       // Program Counter
-    uint32_t instruction_memory[1024]; // Instruction Memory (IMEM)
+    uint32_t instruction_memory[IMEM_SIZE]; // Instruction Memory (IMEM)
+    DecodedInst decoded[IMEM_SIZE];         // IMEM pre-decoded at load time
     Cache l1_cache;                    // L1 Cache Instance
 
     // --- Pipeline Registers ---
@@ -71,6 +104,9 @@ typedef struct {
     // --- Control Flags ---
     bool halted;       // True if the core has executed a HALT instruction
     bool stall;        // True if the pipeline is stalled (e.g., waiting for memory)
+    bool forwarding;   // Bypass network (EX->EX, MEM->EX, WB->ID) enabled
+    Predictor predictor; // Branch prediction in Fetch (kind PREDICT_NONE = resolve in Decode)
+    StoreBuffer sb;      // Stores on their way to the L1 (depth 0 = none)
 
     // --- Statistics ---
     struct {
@@ -82,24 +118,51 @@ typedef struct {
         int write_misses;
         int decode_stalls;
         int mem_stalls;
+        int branches;          // Branches and jumps resolved in Execute
+        int mispredicts;
+        int mispredict_stalls; // Fetch cycles lost to a misprediction
+        int miss_cycles;       // Cycles with at least one MSHR outstanding
+        int miss_occupancy;    // Outstanding MSHRs summed over those cycles
+        int sb_forwards;       // Loads served by the store buffer
+        int sb_full_stalls;    // MEM cycles a store waited for a free entry
+        int fence_stalls;      // MEM cycles a FENCE waited for the stores and misses
     } stats;
 
     uint32_t trace_regs[16]; // Copy of regs for trace generation (snapshot)
 
     // --- Internal Logic Flags ---
-    bool branch_pending;    // True if a branch was taken in Decode
+    bool branch_pending;    // True if a branch was taken in Decode (or predicted taken in Fetch)
     uint32_t branch_target; // Target address of the branch
     bool halt_detected;     // True if HALT was seen in Decode (stops Fetch)
-    int wb_hazard_rd;       // Register being written in WB stage (for hazard detection)
+    uint16_t busy_regs;     // Scoreboard: registers written by instructions past Decode
+    uint16_t result_regs;   // Forwarding: registers written by the instructions in EX/MEM and MEM/WB
+    uint16_t load_regs;     // Forwarding: register written by a load leaving EX
+    bool squash_fetch;      // Execute found a misprediction: this cycle's fetch is lost
+    uint16_t pending_regs;  // MSHRs: registers of deferred loads still waiting for their fill
+    bool halt_pending;      // HALT has retired, the core stops once the MSHRs and the store buffer drain
+    bool cache_port_busy;   // MEM accessed the L1 this cycle (the store buffer waits)
 
 } Core;
 
 /*
  * core_init
- * Initializes the core, loads IMEM from file, and resets state.
+ * Initializes the core, loads IMEM from file (if a path is given), and resets state.
  */
 void core_init(Core *core, int id, const char *imem_path);
 
+/*
+ * core_load_imem
+ * Loads the instruction memory of the core from a hex file and pre-decodes it.
+ */
+void core_load_imem(Core *core, const char *imem_path);
+
+/*
+ * core_predecode
+ * Rebuilds the pre-decoded copy of the IMEM. Call after changing
+ * instruction_memory.
+ */
+void core_predecode(Core *core);
+
 /*
  * core_cycle
  * Advances the core by one clock cycle.
@@ -107,4 +170,27 @@ void core_init(Core *core, int id, const char *imem_path);
  */
 void core_cycle(Core *core, Bus *bus);
 
+/*
+ * core_next_event
+ * Returns the next cycle (relative to 'now') at which the core can change
+ * state. A core stalled on a miss that is already registered only wakes up
+ * through bus traffic, so it returns EVENT_NEVER. 'bus_locked' is true while
+ * the memory holds the bus and no new requests can be granted.
+ */
+int core_next_event(const Core *core, int now, bool bus_locked);
+
+/*
+ * core_skip_cycles
+ * Advances a core that core_next_event reported as passive by 'n' cycles,
+ * updating the statistics exactly as 'n' stalled calls to core_cycle would.
+ */
+void core_skip_cycles(Core *core, int n);
+
+/*
+ * core_retire_writeback
+ * Completes the WriteBack of the instruction in MEM/WB (whose memory access
+ * has already been performed) outside of a cycle, leaving the latch empty.
+ */
+void core_retire_writeback(Core *core);
+
 #endif
@@ -0,0 +1,65 @@
+#ifndef FUNCTIONAL_H
+#define FUNCTIONAL_H
+
+#include "global.h"
+#include "core.h"
+#include "bus.h"
+#include "memory.h"
+
+/*
+ * FuncCore Structure
+ * Architectural view of a core in functional mode: the program counter with
+ * its successor, which models the branch delay slot (a taken branch only
+ * redirects the instruction after the next one). Instructions come from the
+ * core's pre-decoded IMEM.
+ */
+typedef struct {
+    uint32_t pc;  // Next instruction to execute
+    uint32_t npc; // The one after it
+    long long instructions; // Executed in functional mode
+} FuncCore;
+
+/*
+ * func_quiesce
+ * Brings the memory system to a state without bus transactions: flushes in
+ * progress are completed into main memory, while misses, pending evictions
+ * and the memory controller's read are abandoned (the accesses are executed
+ * again in functional mode). Lines left half-filled are invalidated.
+ */
+void func_quiesce(Core cores[], int num_cores, MainMemory *mem, Bus *bus);
+
+/*
+ * func_enter
+ * Takes over the architectural state of a core. The
+ * instruction in MEM/WB is retired; the younger ones are squashed and will
+ * be executed again, and the program order of the latches gives the delay
+ * slot state. Call after func_quiesce.
+ */
+void func_enter(FuncCore *fc, Core *core);
+
+/*
+ * func_leave
+ * Hands a core back to the pipeline model: the latches are emptied and fetch
+ * resumes at the functional program counter (with a pending branch if the
+ * next instruction is a delay slot).
+ */
+void func_leave(const FuncCore *fc, Core *core);
+
+/*
+ * func_run
+ * Executes up to 'budget' instructions of core 'id' (fewer if it halts).
+ * Loads and stores go through the L1 caches of 'cores' with functional MESI
+ * transitions; misses are served by the other caches or main memory at no
+ * simulated time. Returns the number of instructions executed.
+ */
+long long func_run(FuncCore *fc, Core cores[], int num_cores, int id, MainMemory *mem, long long budget);
+
+/*
+ * func_back_invalidate
+ * Drops every L1 copy of the block at 'addr' after an inclusive LLC has
+ * replaced it; a Modified copy is written to main memory at once. Returns
+ * the number of copies dropped and adds the Modified ones to *writebacks.
+ */
+int func_back_invalidate(Core cores[], int num_cores, MainMemory *mem, uint32_t addr, int *writebacks);
+
+#endif
@@ -8,28 +8,47 @@
  * System Constants
  * Defines the architectural parameters of the simulation.
  */
-#define NUM_CORES 4
+#define DEFAULT_NUM_CORES 4   // Core count when none is given or discovered
+#define MAX_CORES 256         // Largest supported core count
 #define MEM_DEPTH (1 << 20)  
                              
 #define MAIN_MEMORY_SIZE (1 << 21) // 2^21 words (20-bit address space + extra bit?)
+#define ADDRESS_BITS 21            // log2(MAIN_MEMORY_SIZE)
 
-#define CACHE_SIZE 512       // Total words in cache (64 sets * 8 words)
-#define BLOCK_SIZE 8         // Words per cache block
-#define NUM_CACHE_SETS 64    // Number of sets in the direct-mapped cache
+#define L1_DEFAULT_SETS 64    // Default L1 geometry: direct-mapped, 64 sets of 8-word blocks
+#define L1_DEFAULT_WAYS 1
+#define DEFAULT_BLOCK_WORDS 8
+#define MAX_BLOCK_WORDS 32    // Largest cache block (words)
+#define L1_MAX_WAYS 16        // Largest L1 associativity
+#define L1_MAX_LINES 1024     // L1 TSRAM capacity (sets * ways)
+#define L1_MAX_WORDS 4096     // L1 DSRAM capacity (sets * ways * block words)
 #define REG_COUNT 16         // Number of registers (R0-R15)
+#define MEM_READ_LATENCY 16  // Default cycles from a read request to the first data word
+
+/*
+ * EVENT_NEVER
+ * Wake-up time used by agents that are passive (they only change state when
+ * another agent acts on them, e.g. a core stalled on an outstanding miss).
+ */
+#define EVENT_NEVER 0x7FFFFFFF
 
 
 /*
  * MESI States
- * Enumeration for the cache coherence protocol states.
+ * Enumeration for the cache coherence protocol states. Owned and Forward
+ * only occur under MOESI and MESIF (see coherence.h).
  */
 typedef enum {
     MESI_INVALID   = 0, // Block is invalid
     MESI_SHARED    = 1, // Block is valid, clean, and may exist in other caches
     MESI_EXCLUSIVE = 2, // Block is valid, clean, and exists ONLY in this cache
-    MESI_MODIFIED  = 3  // Block is valid, dirty, and exists ONLY in this cache
+    MESI_MODIFIED  = 3, // Block is valid, dirty, and exists ONLY in this cache
+    MESI_OWNED     = 4, // Block is valid, dirty, and may exist Shared in other caches
+    MESI_FORWARD   = 5  // Block is valid, clean, shared, and this copy answers BusRd
 } MesiState;
 
+#define MESI_NUM_STATES 6
+
 /*
  * Opcodes
  * Enumeration of supported MIPS-like instructions.
@@ -53,6 +72,7 @@ typedef enum {
     OP_JAL = 15,
     OP_LW  = 16,
     OP_SW  = 17,
+    OP_FENCE = 18, // Waits in MEM until the store buffer and the MSHRs are empty
     OP_HALT = 20
 } Opcode;
 
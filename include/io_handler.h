@@ -6,28 +6,80 @@
 #include "memory.h"
 #include "bus.h"
 
+/*
+ * CORE_TRACE_MAX
+ * Buffer size for the part of a core trace line after the cycle number.
+ */
+#define CORE_TRACE_MAX 160
+
+/*
+ * StatEntry
+ * One named counter of a core's statistics file.
+ */
+#define MAX_CORE_STATS 16
+
+typedef struct {
+    const char *name;
+    int value;
+} StatEntry;
+
 /*
  * SimFiles Structure
  * Holds the file paths for all input and output files used in the simulation.
+ * The per-core lists have 'num_cores' entries; a NULL list or path disables
+ * the corresponding file. All strings are owned by the structure.
  */
 typedef struct {
-    char *imem_paths[NUM_CORES];      // Paths to Instruction Memory files (imem0..3.txt)
-    char *memin_path;                 // Path to Main Memory initialization file
-    char *memout_path;                // Path to Main Memory dump file
-    char *regout_paths[NUM_CORES];    // Paths to Register dump files
-    char *coretrace_paths[NUM_CORES]; // Paths to Core Trace files
-    char *bustrace_path;              // Path to Bus Trace file
-    char *dsram_paths[NUM_CORES];     // Paths to DSRAM dump files
-    char *tsram_paths[NUM_CORES];     // Paths to TSRAM dump files
-    char *stats_paths[NUM_CORES];     // Paths to Statistics files
+    int num_cores;                // Number of cores the per-core lists describe
+    char **imem_paths;            // Paths to Instruction Memory files (imem0.txt, ...)
+    char *memin_path;             // Path to Main Memory initialization file
+    char *memout_path;            // Path to Main Memory dump file
+    char **regout_paths;          // Paths to Register dump files
+    char **coretrace_paths;       // Paths to Core Trace files
+    char *bustrace_path;          // Path to Bus Trace file
+    char **dsram_paths;           // Paths to DSRAM dump files
+    char **tsram_paths;           // Paths to TSRAM dump files
+    char **stats_paths;           // Paths to Statistics files
+    char *l2stats_path;           // Path to the LLC statistics file (written only with an LLC)
+    char *busstats_path;          // Path to the bus statistics file (written only with a non-MESI protocol, BusUpgr, a split bus, a non-rr arbiter or bus_stats)
 } SimFiles;
 
+/*
+ * sim_files_alloc
+ * Allocates empty (all NULL) per-core path lists for 'num_cores' cores.
+ */
+bool sim_files_alloc(SimFiles *files, int num_cores);
+
+/*
+ * sim_files_free
+ * Releases every path and list of the structure.
+ */
+void sim_files_free(SimFiles *files);
+
+/*
+ * sim_files_default
+ * Fills in the standard file names (imem0.txt, memin.txt, regout0.txt, ...)
+ * inside 'dir' (the working directory if NULL). Without 'with_outputs' only
+ * the inputs are set.
+ */
+bool sim_files_default(SimFiles *files, const char *dir, int num_cores, bool with_outputs);
+
+/*
+ * discover_num_cores
+ * Counts the consecutive imem0.txt, imem1.txt, ... files present in 'dir'
+ * (the working directory if NULL).
+ */
+int discover_num_cores(const char *dir);
+
 /*
  * parse_arguments
- * Parses command-line arguments and populates the SimFiles structure.
+ * Parses command-line arguments and populates the SimFiles structure. The
+ * LLC statistics, which have no positional argument, go next to memout.
+ * 'num_cores' is the requested core count, or 0 to derive it from the
+ * arguments (or from the imem files present when there are none).
  * Returns true if successful, false if arguments are invalid.
  */
-bool parse_arguments(int argc, char *argv[], SimFiles *files);
+bool parse_arguments(int argc, char *argv[], SimFiles *files, int num_cores);
 
 /*
  * load_imem_files
@@ -41,18 +93,49 @@ void load_imem_files(Core cores[], SimFiles *files);
  */
 void load_memin_file(MainMemory *mem, SimFiles *files);
 
+/*
+ * format_core_trace
+ * Renders the part of a core trace line after the cycle number (stage PCs
+ * and R2-R15, newline included) into 'buf'. Returns the length.
+ */
+int format_core_trace(char *buf, Core *core);
+
+/*
+ * write_trace_line
+ * Appends a trace line made of the cycle number and a pre-rendered state.
+ */
+void write_trace_line(FILE *fp, int cycle, const char *state, int len);
+
 /*
  * write_core_trace
  * Appends a single line to the core trace file representing the current state.
  */
 void write_core_trace(FILE *fp, Core *core, int cycle);
 
+/*
+ * write_core_trace_repeat
+ * Appends 'count' trace lines for cycles first_cycle.. of a core whose
+ * pipeline state does not change over that range (used when the kernel
+ * skips quiet cycles).
+ */
+void write_core_trace_repeat(FILE *fp, Core *core, int first_cycle, int count);
+
 /*
  * write_bus_trace
  * Appends a single line to the bus trace file if a transaction occurred.
  */
 void write_bus_trace(FILE *fp, Bus *bus, int cycle);
 
+/*
+ * collect_core_stats
+ * Fills 'out' with the statistics of a core, in the order they appear in
+ * the stats file. The branch prediction counters follow the default ones
+ * when the core has a predictor, then the outstanding-miss counters when its
+ * L1 has MSHRs and the store buffer counters when it has one. Returns the number of entries (at most
+ * MAX_CORE_STATS).
+ */
+int collect_core_stats(Core *core, StatEntry out[]);
+
 /*
  * Final Output Functions
  * These functions dump the final state of the system to files after simulation ends.
@@ -62,5 +145,16 @@ void write_dsram_files(Core cores[], SimFiles *files);
 void write_tsram_files(Core cores[], SimFiles *files);
 void write_stats_files(Core cores[], SimFiles *files);
 void write_memout_file(MainMemory *mem, SimFiles *files);
+void write_l2stats_file(const Llc *llc, SimFiles *files);
+
+/*
+ * write_busstats_file
+ * Bus counters of the run ('cycles' long) and the grant waits of the bus
+ * arbiters. 'data' and 'data_arb' are the data channel of a separate data
+ * bus (NULL for a shared bus); its utilization and waits are reported next
+ * to the address channel's.
+ */
+void write_busstats_file(const Bus *bus, const Bus *data, const Arbiter *arb, const Arbiter *data_arb,
+                         const char *protocol, int cycles, SimFiles *files);
 
 #endif
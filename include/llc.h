@@ -0,0 +1,72 @@
+#ifndef LLC_H
+#define LLC_H
+
+#include "global.h"
+
+/*
+ * LLC_MAX_LINES / LLC_MAX_WAYS
+ * Largest shared last-level cache (lines in all sets) and associativity.
+ */
+#define LLC_MAX_LINES 16384
+#define LLC_MAX_WAYS 16
+
+/*
+ * LLC_NO_VICTIM
+ * Returned as the replaced block when a miss takes an invalid way.
+ */
+#define LLC_NO_VICTIM 0xFFFFFFFF
+
+/*
+ * LlcLine
+ * Tag entry of the LLC. The data is not kept: the LLC is write-through, so
+ * a resident block always equals main memory.
+ */
+typedef struct {
+    bool     valid;
+    uint32_t block;   // Block number (address / block_words)
+    uint32_t stamp;   // Last access, for LRU
+} LlcLine;
+
+/*
+ * Llc Structure
+ * Shared last-level cache between the bus and main memory. Every BusRd and
+ * BusRdX looks its block up; a miss allocates it, replacing the least
+ * recently used way of the set. When 'inclusive' is set, the L1s may only
+ * hold blocks present in the LLC, so a replaced block must be dropped from
+ * them (back-invalidation).
+ */
+typedef struct {
+    int sets;           // 0 = no LLC
+    int ways;
+    int block_words;    // Same blocks as the L1s
+    int hit_latency;    // Cycles from a bus read to the first data word on a hit
+    bool inclusive;
+    uint32_t clock;     // Next LRU stamp
+
+    // --- Statistics ---
+    int hits;
+    int misses;
+    int evictions;                     // Valid blocks replaced
+    int back_invalidations;            // L1 copies dropped for an inclusive eviction
+    int back_invalidation_writebacks;  // Of which were Modified
+    LlcLine line[LLC_MAX_LINES];       // Set s holds lines s*ways .. s*ways+ways-1
+} Llc;
+
+/*
+ * llc_configure
+ * Empties the LLC and sets its geometry (powers of two, at most
+ * LLC_MAX_LINES lines; 0 sets disables it). Returns false for an
+ * unsupported geometry.
+ */
+bool llc_configure(Llc *llc, int sets, int ways, int block_words, int hit_latency, bool inclusive);
+
+/*
+ * llc_lookup
+ * Looks up the block holding 'addr'. A hit makes it the most recently used
+ * way and returns true. A miss allocates it and returns false, with the
+ * base address of the block it replaced in 'victim' (LLC_NO_VICTIM if the
+ * way was free). The statistics are left to the caller.
+ */
+bool llc_lookup(Llc *llc, uint32_t addr, uint32_t *victim);
+
+#endif
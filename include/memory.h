@@ -3,6 +3,26 @@
 
 #include "global.h"
 #include "bus.h"
+#include "llc.h"
+
+/*
+ * MEM_MAX_REQUESTS
+ * Largest read queue of the memory on a split-transaction bus.
+ */
+#define MEM_MAX_REQUESTS 16
+
+/*
+ * MemRequest
+ * A read queued at the memory on a split-transaction bus. Its latency runs
+ * while the bus carries other transactions; then its data phase goes out,
+ * tagged with the requester.
+ */
+typedef struct {
+    uint32_t addr;     // Requested word
+    int requester;     // Core the data phase answers
+    bool shared;       // Shared line of the request
+    int latency_timer; // Cycles left before the data phase can start (-1 = ready)
+} MemRequest;
 
 /*
  * MainMemory Structure
@@ -12,6 +32,24 @@ typedef struct {
     uint32_t data[MAIN_MEMORY_SIZE]; // The actual memory storage array
     bool processing_read;            // True if memory is currently handling a read request (latency)
     bool serving_shared_request;     // True if the current read request was flagged as Shared
+    int read_latency;                // Cycles from a read request to the first data word
+    int block_words;                 // Words per block (the geometry of the L1s)
+    bool critical_word_first;        // A burst starts at the requested word and wraps around the block
+
+    // --- Read Request State ---
+    int latency_timer;               // Cycles left before the data burst can start (-1 = ready)
+    uint32_t target_addr;            // Address of the read being served (or the last one queued)
+    int word_offset;                 // Words of the block already sent
+
+    // --- Split-Transaction Bus (max_requests > 0) ---
+    int max_requests;                // 0 = a read holds the bus from its request to its last word
+    int num_requests;                // Queued reads, oldest first
+    MemRequest request[MEM_MAX_REQUESTS];
+    int requester;                   // Core the data phase in progress answers
+
+    // --- Shared Last-Level Cache (llc.sets = 0: none) ---
+    Llc llc;
+    uint32_t back_invalidate_addr;   // Block an inclusive LLC has replaced this cycle (LLC_NO_VICTIM = none)
 } MainMemory;
 
 /*
@@ -20,14 +58,69 @@ typedef struct {
  */
 void memory_init(MainMemory *mem);
 
+/*
+ * memory_create
+ * Allocates an initialized main memory. The data array comes zeroed from the
+ * allocator, so no explicit clear of the 8 MB image is needed.
+ */
+MainMemory *memory_create(void);
+
+/*
+ * memory_destroy
+ * Releases a main memory allocated with memory_create.
+ */
+void memory_destroy(MainMemory *mem);
+
 /*
  * memory_listen
  * The main logic function for memory.
  * - Listens to the bus for Read/Write commands.
  * - Handles write-backs (Flush) immediately.
- * - Simulates latency for Read requests.
+ * - Simulates latency for Read requests (through the LLC, if any).
  * - Drives the bus to return data after latency expires.
+ * A block replaced by an inclusive LLC is left in back_invalidate_addr for
+ * the caller, which owns the L1s. With a separate data bus it is called once
+ * for the address channel and once per data channel beat.
  */
 void memory_listen(MainMemory *mem, Bus *bus);
 
+/*
+ * memory_wants_bus
+ * True if the memory needs the bus: for the read it is serving, or on a
+ * split-transaction bus for the data phase of a queued read whose latency
+ * has elapsed.
+ */
+bool memory_wants_bus(const MainMemory *mem);
+
+/*
+ * memory_accepts_request
+ * False while a core's request for 'addr' must wait on a split-transaction
+ * bus: the read queue is full, or it holds a read of the same block (which
+ * must get its data before any other access to the block is ordered).
+ * Always true on an atomic bus.
+ */
+bool memory_accepts_request(const MainMemory *mem, uint32_t addr);
+
+/*
+ * memory_next_event
+ * Returns the first cycle (relative to 'now') at which memory_listen can do
+ * anything other than count down its latency timer, or EVENT_NEVER if the
+ * memory is idle and only reacts to bus traffic.
+ */
+int memory_next_event(const MainMemory *mem, const Bus *bus, int now);
+
+/*
+ * memory_skip_cycles
+ * Advances the latency countdowns by 'n' quiet cycles in one step.
+ */
+void memory_skip_cycles(MainMemory *mem, int n);
+
+/*
+ * memory_read_block / memory_write_block
+ * Functional access to the block of block_words words starting at 'base'
+ * (words beyond the memory read as 0 and are not written).
+ */
+void memory_read_block(const MainMemory *mem, uint32_t base, uint32_t block[MAX_BLOCK_WORDS]);
+void memory_write_block(MainMemory *mem, uint32_t base, const uint32_t block[MAX_BLOCK_WORDS]);
+
 #endif
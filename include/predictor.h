@@ -0,0 +1,95 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include "global.h"
+
+/*
+ * BTB_MAX_ENTRIES / PHT_MAX_ENTRIES
+ * Largest branch target buffer and pattern history table of a core.
+ */
+#define BTB_MAX_ENTRIES 256
+#define PHT_MAX_ENTRIES 4096
+
+/*
+ * PredictorKind
+ * Direction predictor of the fetch stage. PREDICT_NONE keeps the original
+ * pipeline, which resolves branches in Decode without prediction.
+ */
+typedef enum {
+    PREDICT_NONE,
+    PREDICT_BTFN,    // Static: backward taken, forward not taken
+    PREDICT_BIMODAL, // 2-bit counters indexed by the PC
+    PREDICT_GSHARE   // 2-bit counters indexed by the PC xor the global history
+} PredictorKind;
+
+/*
+ * Prediction
+ * What Fetch assumed about an instruction, carried down the pipeline to the
+ * stage that resolves it.
+ */
+typedef struct {
+    bool     taken;
+    uint16_t target;
+    uint16_t index;  // Counter that made the prediction
+} Prediction;
+
+/*
+ * BTBEntry
+ * A taken branch or jump seen before, with its last target.
+ */
+typedef struct {
+    bool     valid;
+    bool     conditional; // False for JAL, which is always taken
+    uint16_t pc;
+    uint16_t target;
+} BTBEntry;
+
+/*
+ * Predictor Structure
+ * Per-core branch prediction state: a direct-mapped BTB, which supplies the
+ * targets (a branch missing from it is predicted not taken), and the 2-bit
+ * counters of the dynamic predictors.
+ */
+typedef struct {
+    PredictorKind kind;
+    int btb_entries;          // Powers of two
+    int pht_entries;
+    uint32_t history;         // gshare: outcomes of the last log2(pht_entries) branches
+    uint32_t changes;         // Incremented whenever the tables or the history change
+    BTBEntry btb[BTB_MAX_ENTRIES];
+    uint8_t pht[PHT_MAX_ENTRIES];
+} Predictor;
+
+/*
+ * predictor_parse_kind
+ * Converts "none", "btfn", "bimodal" or "gshare". Returns false otherwise.
+ */
+bool predictor_parse_kind(const char *name, int *kind);
+
+/*
+ * predictor_init
+ * Empties the BTB and sets every counter to weakly not taken.
+ */
+void predictor_init(Predictor *bp, PredictorKind kind, int btb_entries, int pht_entries);
+
+/*
+ * predictor_predict
+ * Prediction for the instruction fetched at 'pc'.
+ */
+Prediction predictor_predict(const Predictor *bp, uint32_t pc);
+
+/*
+ * predictor_update
+ * Trains the predictor with the outcome of the branch or jump at 'pc'.
+ * 'index' is the counter of its prediction.
+ */
+void predictor_update(Predictor *bp, uint32_t pc, uint16_t index, bool conditional, bool taken, uint32_t target);
+
+/*
+ * predictor_train
+ * predictor_update for a branch executed without a prediction (functional
+ * mode), so the tables stay warm across fast-forwarded stretches.
+ */
+void predictor_train(Predictor *bp, uint32_t pc, bool conditional, bool taken, uint32_t target);
+
+#endif
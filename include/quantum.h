@@ -0,0 +1,92 @@
+#ifndef QUANTUM_H
+#define QUANTUM_H
+
+#include <stdio.h>
+#include "global.h"
+#include "core.h"
+#include "memory.h"
+
+/*
+ * BusRequest
+ * A bus transaction a core needs, logged during the bound phase.
+ */
+typedef struct {
+    bool valid;
+    int time;       // Core cycle in which the request was registered
+    bool evict;     // Write-back of a Modified victim (otherwise a miss)
+    bool exclusive; // BusRdX (store miss) rather than BusRd
+    uint32_t addr;  // Missing address, or the victim block for an eviction
+} BusRequest;
+
+/*
+ * QuantumState Structure
+ * State of the approximate bound-weave engine. In the bound phase every core
+ * runs ahead on its own, up to the end of the quantum, as long as it hits in
+ * its L1; a core that needs the bus logs the request and stops. The weave
+ * phase then resolves the logged requests in time order against a single
+ * shared bus and applies their coherence effects functionally.
+ */
+typedef struct {
+    int quantum;          // Bound phase length in cycles
+    int num_cores;
+    int *core_time;       // Next cycle each core will execute
+    int *resume_at;       // Cycle at which a core's transaction completes
+    BusRequest *request;  // At most one outstanding request per core
+    bool *fill_pending;   // Block filled, the core has not retried yet
+    uint32_t *fill_block;
+    int bus_free;         // First cycle at which the bus is idle
+
+    // --- Statistics ---
+    int transactions;
+    int bus_wait_cycles;  // Cycles requests waited for the bus
+} QuantumState;
+
+/*
+ * quantum_init
+ * Allocates the per-core state of 'num_cores' cores, every one starting at
+ * cycle 'start'. Returns false if the allocation fails.
+ */
+bool quantum_init(QuantumState *q, int quantum, int start, int num_cores);
+
+/*
+ * quantum_free
+ * Releases the per-core state.
+ */
+void quantum_free(QuantumState *q);
+
+/*
+ * quantum_bound
+ * Bound phase of one core: runs it up to (excluding) cycle 'end' or until it
+ * halts or logs a bus request. Touches only the core, its L1 and its trace
+ * file, so all cores can run concurrently.
+ */
+void quantum_bound(QuantumState *q, Core *core, FILE *trace, int end);
+
+/*
+ * quantum_weave
+ * Weave phase: resolves the logged requests in (time, core) order. Each one
+ * occupies the bus for the duration of the real transaction, snoops the
+ * other caches, moves the data and schedules the requesting core's resume
+ * cycle. The transactions are appended to 'bus_trace' (may be NULL).
+ *
+ * A request for a block that was just filled for another core is held back
+ * until that core has retried its access, as the real fill and retry happen
+ * in the same cycle; otherwise two cores could steal a line from each other
+ * forever.
+ */
+void quantum_weave(QuantumState *q, Core cores[], MainMemory *mem, FILE *bus_trace);
+
+/*
+ * quantum_reached
+ * True once every core has halted, executed all cycles before 'end', or is
+ * waiting on a held-back request.
+ */
+bool quantum_reached(const QuantumState *q, const Core cores[], int end);
+
+/*
+ * quantum_last_cycle
+ * Cycle count of the run so far: the furthest point any core has reached.
+ */
+int quantum_last_cycle(const QuantumState *q);
+
+#endif
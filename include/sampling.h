@@ -0,0 +1,121 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include "global.h"
+#include "core.h"
+#include "io_handler.h"
+#include "functional.h"
+
+/*
+ * SAMPLE_Z
+ * Standard normal quantile of the reported confidence intervals (95%).
+ */
+#define SAMPLE_Z 1.96
+
+/*
+ * SamplePhase
+ * What a sampled run is doing: fast-forwarding functionally, warming up the
+ * pipelines and the bus in detail, or measuring a window in detail.
+ */
+typedef enum {
+    SAMPLE_FUNCTIONAL,
+    SAMPLE_WARMUP,
+    SAMPLE_MEASURE
+} SamplePhase;
+
+/*
+ * SampleStat
+ * Running sums of one per-window metric (mean and variance estimator).
+ */
+typedef struct {
+    int n;
+    double sum;
+    double sum_sq;
+} SampleStat;
+
+/*
+ * SampleCore Structure
+ * Per-core results of a sampled run, and the counters of the core at the
+ * start of the window being measured.
+ */
+typedef struct {
+    SampleStat ipc;
+    SampleStat read_miss_rate;
+    SampleStat write_miss_rate;
+    long long functional; // Instructions executed in functional mode
+
+    bool measuring; // Not halted at the start of the window
+    int cycles;
+    int instructions;
+    int read_hits;
+    int write_hits;
+    int read_miss;
+    int write_miss;
+} SampleCore;
+
+/*
+ * SampleState Structure
+ * Systematic sampling driver state: functional stretches alternate with a
+ * detailed warm-up and a detailed measurement window.
+ */
+typedef struct {
+    int num_cores;
+    SamplePhase phase;
+    int phase_end;  // Cycle at which the detailed phase ends
+    int windows;    // Measurement windows completed
+    SampleCore *core;
+    FuncCore *fc;   // Functional state, allocated once for every stretch
+} SampleState;
+
+/*
+ * sample_init
+ * Allocates the per-core state of 'num_cores' cores; the run starts with a
+ * functional stretch. Returns false if the allocation fails.
+ */
+bool sample_init(SampleState *s, int num_cores);
+
+/*
+ * sample_free
+ * Releases the per-core state.
+ */
+void sample_free(SampleState *s);
+
+/*
+ * sample_begin
+ * Records the counters of every core at the start of a measurement window.
+ */
+void sample_begin(SampleState *s, const Core cores[]);
+
+/*
+ * sample_end
+ * Adds the IPC and miss rates of the window that ends now to the estimates.
+ * A core contributes if it was running at the start of the window and has
+ * simulated at least one cycle in it.
+ */
+void sample_end(SampleState *s, const Core cores[]);
+
+/*
+ * sample_mean / sample_half_width
+ * Estimate of a metric and the half width of its confidence interval, or -1
+ * when there are too few windows (none, or one for the interval).
+ */
+double sample_mean(const SampleStat *stat);
+double sample_half_width(const SampleStat *stat);
+
+/*
+ * sample_estimate_cycles
+ * Extrapolated cycle count of a core: the cycles simulated in detail plus
+ * the functional instructions at the estimated IPC. Stores the half width
+ * of its confidence interval in 'half_width' (-1 if unknown). Returns -1 if
+ * no window measured the core.
+ */
+long long sample_estimate_cycles(const SampleState *s, const Core *core, long long *half_width);
+
+/*
+ * sample_write_report
+ * Appends the estimates of every core to its Stats file (written first by
+ * write_stats_files).
+ */
+void sample_write_report(const SampleState *s, const Core cores[], SimFiles *files);
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdio.h>
+#include "global.h"
+#include "core.h"
+#include "bus.h"
+#include "memory.h"
+#include "io_handler.h"
+#include "spin_detect.h"
+#include "worker_pool.h"
+#include "quantum.h"
+#include "functional.h"
+#include "sampling.h"
+
+/*
+ * SimConfig Structure
+ * Run-time parameters of a simulation instance.
+ */
+typedef struct {
+    int cores;       // Number of cores, 1..MAX_CORES (0 = DEFAULT_NUM_CORES)
+    int max_cycles;  // The run stops once this cycle has been simulated
+    int mem_latency; // Cycles from a bus read to the first data word from memory
+    int threads;     // Host threads for the per-core phases (1 = serial)
+    int quantum;     // > 0: approximate bound-weave engine with this quantum
+    int quantum_check; // Also run the exact engine and report the timing error
+    int fast_forward;  // Instructions per core to execute functionally first (0 = none)
+    int forwarding;    // Operand forwarding in the pipelines (0 = stall until writeback)
+    int branch_predictor;  // PredictorKind (PREDICT_NONE = branches resolved in Decode)
+    int btb_entries;       // Branch target buffer entries per core (power of two)
+    int predictor_entries; // 2-bit counters per core for bimodal/gshare (power of two)
+    int mshrs;             // > 0: non-blocking L1s with this many MSHRs (lockstep engine only)
+    int store_buffer;      // > 0: store buffer entries per core (lockstep engine, blocking L1 only)
+    int l1_sets;           // L1 geometry (powers of two): sets, ways and words per block
+    int l1_ways;
+    int l1_block;
+    int l1_replacement;    // ReplacementPolicy of the L1s
+    int victim_entries;    // > 0: victim cache entries per L1 (lockstep engine, blocking L1 only)
+    int l2_sets;           // > 0: shared last-level cache with this many sets (lockstep engine only)
+    int l2_ways;
+    int l2_latency;        // Cycles from a bus read to the first data word on an LLC hit
+    int l2_inclusive;      // The LLC back-invalidates the L1 copies of the blocks it replaces
+    int coherence;         // CoherenceKind of the L1s (non-MESI: lockstep engine only)
+    int bus_upgrade;       // Stores to clean shared copies issue a BusUpgr (lockstep engine only)
+    int critical_word_first; // Bursts start at the requested word, loads restart early (lockstep engine only)
+    int split_bus;         // > 0: split-transaction bus, reads queued at memory (lockstep engine only)
+    int data_bus;          // > 0: separate data bus this many words wide (split-transaction bus only)
+    int arbitration;       // ArbitrationPolicy of the bus arbiters (non-rr: lockstep engine only)
+    int tdma_slot;         // Cycles per TDMA slot
+    int arbitration_weights[MAX_CORES + 1]; // Weighted fair share, cores then memory (0 = 1)
+    int bus_stats;         // Write busstats.txt with the default bus too
+    int sample_interval; // > 0: sampled run, functional instructions per core between windows
+    int sample_warmup;   // Detailed cycles before each measurement window
+    int sample_window;   // Detailed cycles measured per window
+} SimConfig;
+
+/*
+ * Sim Structure
+ * A complete, self-contained simulated system. Every piece of state lives in
+ * this handle, so any number of instances can coexist in one process.
+ */
+typedef struct {
+    SimConfig config;
+    int num_cores;
+
+    // --- System Components ---
+    Bus bus;             // The shared bus, or the address channel
+    Bus data_bus;        // Data channel (config.data_bus > 0)
+    Arbiter arbiter;     // Policy and grant waits of 'bus'
+    Arbiter data_arbiter; // Of 'data_bus'
+    MainMemory *memory;
+    Core *cores;         // num_cores entries
+    SpinDetector *spin;  // Per-core steady-loop fast-forward
+    bool *requests;      // Arbitration request vector (cores, then memory)
+    bool *data_requests; // Data channel request vector
+
+    // --- Kernel State ---
+    int cycle; // Next cycle to simulate
+    bool done; // All cores halted or the cycle cap was reached
+
+    // --- Parallel Execution (NULL pool = serial) ---
+    WorkerPool *pool;
+    bool *snoop_shared; // Bus signals asserted by each snooper
+    bool *snoop_busy;
+
+    // --- Functional Fast-Forward ---
+    bool fast_forward_done;      // config.fast_forward has been applied
+    long long fast_forwarded;    // Instructions executed functionally (all cores)
+
+    // --- Sampled Simulation (config.sample_interval > 0) ---
+    SampleState sampling;
+
+    // --- Bound-Weave Engine (config.quantum > 0) ---
+    QuantumState quantum;
+    int bound_end; // End of the quantum being bound
+
+    // --- Trace Outputs (NULL = disabled) ---
+    FILE **core_trace;
+    FILE *bus_trace;
+} Sim;
+
+/*
+ * sim_config_default
+ * Fills a configuration with the project defaults.
+ */
+void sim_config_default(SimConfig *config);
+
+/*
+ * sim_config_set
+ * Overrides one parameter by name (e.g. "mem_latency", "16"), as given on
+ * the command line or in a batch manifest. Returns false if the key is
+ * unknown or the value is out of range.
+ */
+bool sim_config_set(SimConfig *config, const char *key, const char *value);
+
+/*
+ * sim_config_apply
+ * Same as sim_config_set for a single "key=value" string.
+ */
+bool sim_config_apply(SimConfig *config, const char *assignment);
+
+/*
+ * sim_create
+ * Allocates and resets a new simulator instance. Returns NULL on failure or
+ * for an unsupported configuration (MSHRs or a store buffer with the
+ * bound-weave engine, both together, or an L1 larger than its SRAMs).
+ */
+Sim *sim_create(const SimConfig *config);
+
+/*
+ * sim_load
+ * Loads IMEM and MemIn from the given files and opens the trace outputs.
+ * Trace paths that are NULL disable the corresponding trace. Returns false
+ * if the files describe a different number of cores than the instance.
+ */
+bool sim_load(Sim *sim, SimFiles *files);
+
+/*
+ * sim_step
+ * Advances the simulation by up to 'n' cycles (fewer if it finishes).
+ * Returns the number of cycles actually simulated.
+ */
+int sim_step(Sim *sim, int n);
+
+/*
+ * sim_run_until
+ * Advances the simulation until cycle 'target' is reached or the run finishes.
+ */
+void sim_run_until(Sim *sim, int target);
+
+/*
+ * sim_run
+ * Runs the simulation to completion.
+ */
+void sim_run(Sim *sim);
+
+/*
+ * sim_fast_forward
+ * Executes up to 'instructions' instructions per core in functional mode
+ * (no timing: the cycle count and the statistics do not advance), then
+ * resumes the detailed model at the reached point. Bus transactions in
+ * progress are completed or replayed. Returns the number of instructions
+ * executed by all cores, or -1 on an allocation failure.
+ */
+long long sim_fast_forward(Sim *sim, long long instructions);
+
+/*
+ * sim_write_outputs
+ * Writes the final RegOut/DSRAM/TSRAM/Stats/MemOut files. After a sampled
+ * run, the Stats files also hold the extrapolated estimates.
+ */
+void sim_write_outputs(Sim *sim, SimFiles *files);
+
+/*
+ * sim_destroy
+ * Closes the traces and releases the instance.
+ */
+void sim_destroy(Sim *sim);
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef SPIN_DETECT_H
+#define SPIN_DETECT_H
+
+#include <stdio.h>
+#include "global.h"
+#include "core.h"
+#include "io_handler.h"
+
+/*
+ * SPIN_MAX_PERIOD
+ * Longest loop (in cycles) the detector looks for.
+ */
+#define SPIN_MAX_PERIOD 32
+
+/*
+ * SpinSnapshot
+ * The part of a core's state that fully determines its next cycle, given
+ * that every access hits in an unchanged L1. Two equal snapshots mean the
+ * core will repeat exactly the same cycles from there on.
+ */
+typedef struct {
+    uint32_t regs[REG_COUNT];
+    uint32_t pc;
+    IF_ID_Latch  if_id;
+    ID_EX_Latch  id_ex;
+    EX_MEM_Latch ex_mem;
+    MEM_WB_Latch mem_wb;
+    bool stall;
+    bool halt_detected;
+    bool branch_pending;
+    uint32_t branch_target;
+    uint16_t busy_regs;
+    uint32_t predictor_changes; // Equal only if the predictor tables did not change
+} SpinSnapshot;
+
+/*
+ * SpinEntry
+ * One observed cycle: the state at the start of the cycle, the counters at
+ * that point and the rendered trace line.
+ */
+typedef struct {
+    SpinSnapshot snap;
+    uint32_t hash;
+    bool cache_idle;        // No miss, eviction, flush or buffered store in progress
+    int instructions;
+    int decode_stalls;
+    int mem_stalls;
+    int read_hits;
+    int write_hits;
+    int read_miss;
+    int write_miss;
+    int branches;
+    int mispredicts;
+    int mispredict_stalls;
+    char trace[CORE_TRACE_MAX];
+    int trace_len;
+} SpinEntry;
+
+/*
+ * SpinDetector Structure
+ * Per-core loop detector. While 'active', the core is not simulated: each
+ * cycle replays one step of the recorded loop (trace line + counter deltas)
+ * until one of the watched L1 lines changes.
+ */
+typedef struct {
+    // --- Detection History (ring buffer of the last cycles) ---
+    SpinEntry history[SPIN_MAX_PERIOD + 1];
+    int head;   // Slot of the next observation
+    int count;  // Number of valid entries
+
+    // --- Active Loop ---
+    bool active;
+    int period;                           // Loop length in cycles
+    int phase;                            // Step of the loop to replay next
+    SpinEntry loop[SPIN_MAX_PERIOD];      // Loop steps in execution order
+    int d_instructions[SPIN_MAX_PERIOD];  // Counter deltas of each step
+    int d_decode_stalls[SPIN_MAX_PERIOD];
+    int d_read_hits[SPIN_MAX_PERIOD];
+    int d_branches[SPIN_MAX_PERIOD];
+    int d_mispredicts[SPIN_MAX_PERIOD];
+    int d_mispredict_stalls[SPIN_MAX_PERIOD];
+
+    // --- Watched Lines (every block the loop loads from) ---
+    uint32_t watch_addr[SPIN_MAX_PERIOD];
+    MesiState watch_state[SPIN_MAX_PERIOD];
+    uint32_t watch_data[SPIN_MAX_PERIOD]; // The loaded word: a write-update protocol changes it in place
+    int num_watch;
+} SpinDetector;
+
+/*
+ * spin_init
+ * Clears the detector history.
+ */
+void spin_init(SpinDetector *spin);
+
+/*
+ * spin_observe
+ * Records the state of the core at the start of a cycle ('trace' is the
+ * rendered trace line for it). Returns true if the core has just entered a
+ * steady loop: the detector is then active and the current cycle must be
+ * replayed with spin_replay instead of calling core_cycle.
+ */
+bool spin_observe(SpinDetector *spin, Core *core, const char *trace, int trace_len);
+
+/*
+ * spin_is_active
+ * True while the core is being fast-forwarded.
+ */
+bool spin_is_active(const SpinDetector *spin);
+
+/*
+ * spin_still_valid
+ * Returns false once a watched line has been invalidated or changed state,
+ * a watched word has been updated, or the cache has started a bus
+ * transaction.
+ */
+bool spin_still_valid(const SpinDetector *spin, const Core *core);
+
+/*
+ * spin_next_event
+ * Event-kernel hook for an active detector: the loop only ends through bus
+ * traffic, so the core is passive unless its cache must act this cycle.
+ */
+int spin_next_event(const SpinDetector *spin, const Core *core, int now);
+
+/*
+ * spin_replay
+ * Fast-forwards the core by 'n' cycles starting at 'cycle': appends the loop's
+ * trace lines to 'fp' and advances the statistics analytically.
+ */
+void spin_replay(SpinDetector *spin, Core *core, FILE *fp, int cycle, int n);
+
+/*
+ * spin_sync
+ * Writes the pipeline state of the current loop step into the core without
+ * leaving fast-forward, so the core can be inspected between steps.
+ */
+void spin_sync(const SpinDetector *spin, Core *core);
+
+/*
+ * spin_exit
+ * Leaves fast-forward: restores the pipeline state of the current loop step
+ * into the core so normal simulation resumes exactly where the loop was.
+ */
+void spin_exit(SpinDetector *spin, Core *core);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef STORE_BUFFER_H
+#define STORE_BUFFER_H
+
+#include "global.h"
+#include "cache.h"
+#include "bus.h"
+
+/*
+ * SB_MAX_ENTRIES
+ * Deepest store buffer of a core.
+ */
+#define SB_MAX_ENTRIES 32
+
+/*
+ * StoreBufferEntry
+ * A retired store that has not reached the L1 yet.
+ */
+typedef struct {
+    uint32_t addr;
+    uint32_t data;
+} StoreBufferEntry;
+
+/*
+ * StoreBuffer Structure
+ * Per-core FIFO between MEM and the L1. Stores are written to the L1 one at
+ * a time, oldest first, so the other cores see them in program order (TSO).
+ * 'owns_miss' is set while the oldest store holds the L1's single miss
+ * (or the eviction before it).
+ */
+typedef struct {
+    int depth;          // 0 = stores write the L1 from MEM
+    int head;           // Oldest entry
+    int count;
+    bool owns_miss;
+    StoreBufferEntry entry[SB_MAX_ENTRIES];
+} StoreBuffer;
+
+/*
+ * sb_init
+ * Empties the buffer and sets its depth (0 disables it).
+ */
+void sb_init(StoreBuffer *sb, int depth);
+
+/*
+ * sb_push
+ * Appends a store. Returns false if the buffer is full.
+ */
+bool sb_push(StoreBuffer *sb, uint32_t addr, uint32_t data);
+
+/*
+ * sb_forward
+ * Looks for the youngest buffered store to 'addr'. Returns true and its
+ * data if there is one.
+ */
+bool sb_forward(const StoreBuffer *sb, uint32_t addr, uint32_t *data);
+
+/*
+ * sb_blocks_load
+ * True if a load of 'addr' that is not forwarded must wait for the oldest
+ * store's miss: the L1 handles one miss at a time, the set being filled
+ * cannot be read, and a registered miss that is not on the bus must be
+ * retried by the store (it is either waiting for the bus or already filled).
+ */
+bool sb_blocks_load(const StoreBuffer *sb, const Cache *cache, uint32_t addr);
+
+/*
+ * sb_drain
+ * Writes the oldest store to the L1 (cache_write), removing it on a hit.
+ * Called in the cycles where MEM leaves the L1 port free.
+ */
+void sb_drain(StoreBuffer *sb, Cache *cache, Bus *bus);
+
+#endif
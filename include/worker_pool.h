@@ -0,0 +1,70 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+#include "global.h"
+
+/*
+ * SpinBarrier
+ * Sense-reversing barrier for a fixed number of threads. Waiters spin on a
+ * shared flag (yielding the CPU after a while), which keeps the hand-off
+ * between two short simulation phases far cheaper than a mutex/condvar pair.
+ */
+typedef struct {
+    int parties;   // Number of threads that must arrive
+    int remaining; // Threads still expected in the current round
+    int sense;     // Flipped by the last thread to arrive
+} SpinBarrier;
+
+/*
+ * WorkerFn
+ * Work callback: runs the slice 'worker' (0..num_workers-1) of job 'job'.
+ */
+typedef void (*WorkerFn)(void *ctx, int job, int worker, int num_workers);
+
+/*
+ * WorkerPool Structure
+ * A fixed set of threads that execute one job at a time, in lockstep with the
+ * calling thread. The caller acts as worker 0, so a pool of N workers starts
+ * N - 1 threads.
+ */
+typedef struct {
+    int num_workers;
+    pthread_t *threads;
+    int *local_sense; // Per-worker barrier sense
+    SpinBarrier barrier;
+    int ready;        // Set once the worker count is final
+
+    WorkerFn fn;
+    void *ctx;
+    int job; // Current job, or POOL_EXIT
+} WorkerPool;
+
+/*
+ * POOL_EXIT
+ * Job number reserved for shutting the workers down.
+ */
+#define POOL_EXIT (-1)
+
+/*
+ * pool_create
+ * Starts a pool of 'num_workers' workers (caller included) that run 'fn'
+ * with 'ctx'. Returns NULL on failure.
+ */
+WorkerPool *pool_create(int num_workers, WorkerFn fn, void *ctx);
+
+/*
+ * pool_run
+ * Runs 'job' on every worker and returns once all slices have completed.
+ * Everything written before the call is visible to the workers, and
+ * everything they write is visible to the caller afterwards.
+ */
+void pool_run(WorkerPool *pool, int job);
+
+/*
+ * pool_destroy
+ * Stops and joins the workers and releases the pool.
+ */
+void pool_destroy(WorkerPool *pool);
+
+#endif
@@ -6,16 +6,28 @@
  * Date:    11/11/2024
  *
  * Description:
- * Implements the shared system bus with Round-Robin arbitration. Handles
- * command broadcasting and data flushing between Cores and Main Memory.
+ * Implements the shared system bus and its arbiter (round-robin by
+ * default, or one of the other ArbitrationPolicy values). Handles command
+ * broadcasting and data flushing between Cores and Main Memory.
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include "bus.h"
 
-void bus_init(Bus *bus) {
+// Weighted fair share: pass added by a grant at weight 1 (divisible by 1..16)
+#define ARB_STRIDE 720720LL
+
+static const char *const policy_names[ARBITRATION_NUM_POLICIES] = {
+    "rr", "fixed", "oldest", "weighted", "tdma"
+};
+
+void bus_init(Bus *bus, int num_cores) {
     memset(bus, 0, sizeof(Bus));
-    bus->arbitration_rr_index = 4;
+    bus->num_cores = num_cores;
+    bus->arbitration_rr_index = BUS_MEMORY_ID(bus);
+    bus->channel = BUS_CHANNEL_SHARED;
+    bus->width = 1;
 }
 
 void bus_reset_signals(Bus *bus) {
@@ -24,11 +36,163 @@ void bus_reset_signals(Bus *bus) {
     bus->bus_addr = 0;
     bus->bus_data = 0;
     bus->bus_shared = 0;
+    bus->bus_supply = SUPPLY_NONE;
+    bus->bus_requester = -1;
+}
+
+void arbiter_init(Arbiter *arb, int num_cores, int policy, int slot_cycles, const int *weights, bool atomic) {
+    memset(arb, 0, sizeof(Arbiter));
+    arb->policy = policy;
+    arb->agents = num_cores + 1;
+    arb->slot_cycles = slot_cycles > 0 ? slot_cycles : 1;
+    arb->atomic = atomic;
+    for (int a = 0; a < arb->agents; a++) {
+        arb->weight[a] = weights && weights[a] > 0 ? weights[a] : 1;
+    }
+    arbiter_quiesce(arb);
+}
+
+void arbiter_quiesce(Arbiter *arb) {
+    arb->last_cycle = -1;
+    for (int a = 0; a < arb->agents; a++) arb->since[a] = -1;
+}
+
+bool arbiter_parse_policy(const char *name, int *policy) {
+    for (int i = 0; i < ARBITRATION_NUM_POLICIES; i++) {
+        if (strcmp(name, policy_names[i]) == 0) {
+            *policy = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *arbiter_policy_name(int policy) {
+    return policy >= 0 && policy < ARBITRATION_NUM_POLICIES ? policy_names[policy] : "?";
+}
+
+bool arbiter_parse_weights(const char *text, int *weights, int max_agents) {
+    for (int a = 0; a < max_agents; a++) weights[a] = 1;
+
+    const char *p = text;
+    for (int a = 0; ; a++) {
+        char *end;
+        long value = strtol(p, &end, 10);
+        if (end == p || a >= max_agents || value < 1 || value > ARB_MAX_WEIGHT) return false;
+        weights[a] = (int)value;
+        if (*end == '\0') return true;
+        if (*end != ':') return false;
+        p = end + 1;
+    }
+}
+
+int arbiter_wait_percentile(const ArbiterAgentStats *stats, double fraction) {
+    if (stats->grants == 0) return 0;
+    long long target = (long long)(fraction * stats->grants + 0.999999);
+    long long seen = 0;
+    for (int b = 0; b < ARB_WAIT_BUCKETS - 1; b++) {
+        seen += stats->histogram[b];
+        if (seen >= target) {
+            int upper = b == 0 ? 0 : (1 << b) - 1;
+            return upper < stats->max_wait ? upper : stats->max_wait;
+        }
+    }
+    return stats->max_wait;
+}
+
+/*
+ * record_grant
+ * Adds the wait of the request granted to 'agent' at 'cycle' to its
+ * statistics and charges the grant to its fair share.
+ */
+static void record_grant(Arbiter *arb, int agent, int cycle) {
+    ArbiterAgentStats *stats = &arb->stats[agent];
+    int wait = cycle - arb->since[agent];
+    int bucket = 0;
+    while (bucket < ARB_WAIT_BUCKETS - 1 && (1 << bucket) <= wait) bucket++;
+
+    stats->grants++;
+    stats->wait_cycles += wait;
+    if (wait > stats->max_wait) stats->max_wait = wait;
+    stats->histogram[bucket]++;
+    arb->since[agent] = -1;
+
+    arb->virtual_time = arb->pass[agent];
+    arb->pass[agent] += ARB_STRIDE / arb->weight[agent];
+}
+
+/*
+ * choose_master
+ * The requesting agent the policy grants the bus to (-1 = none). Ties go
+ * to the first agent in round-robin order after the last core served.
+ */
+static int choose_master(const Bus *bus, const Arbiter *arb, const bool *request_vector, int cycle) {
+    int agents = arb->agents;
+    int memory = BUS_MEMORY_ID(bus);
+    int best = -1;
+
+    switch (arb->policy) {
+    case ARBITRATE_TDMA: {
+        int owner = (cycle / arb->slot_cycles) % agents;
+        return request_vector[owner] ? owner : -1;
+    }
+    case ARBITRATE_FIXED:
+        if (request_vector[memory]) return memory;
+        for (int a = 0; a < bus->num_cores; a++) {
+            if (request_vector[a]) return a;
+        }
+        return -1;
+    case ARBITRATE_OLDEST:
+    case ARBITRATE_WEIGHTED:
+        for (int k = 1; k <= agents; k++) {
+            int a = (bus->arbitration_rr_index + k) % agents;
+            if (!request_vector[a]) continue;
+            if (best < 0 ||
+                (arb->policy == ARBITRATE_OLDEST ? arb->since[a] < arb->since[best] : arb->pass[a] < arb->pass[best])) {
+                best = a;
+            }
+        }
+        return best;
+    default:
+        break;
+    }
+
+    /*
+     * ROUND-ROBIN
+     * The memory goes first. We check the cores starting from the one AFTER
+     * the last one served. Order: Core 0 -> 1 -> ... -> N-1 -> Core 0...
+     */
+    if (request_vector[memory]) return memory;
+    for (int k = 1; k <= agents; k++) {
+        int candidate = (bus->arbitration_rr_index + k) % agents;
+        if (request_vector[candidate]) return candidate;
+    }
+    return -1;
 }
 
-void bus_arbitrate(Bus *bus, bool request_vector[5]) {
+void bus_arbitrate(Bus *bus, Arbiter *arb, const bool *request_vector, int cycle) {
     /*
-     * 1. BUSY CHECK
+     * 1. PENDING REQUESTS
+     * A request seen for the first time was raised after the last cycle
+     * arbitrated: the cycles in between, if any, were skipped as quiet.
+     * The agent holding the bus is not waiting for it.
+     */
+    int start = arb->last_cycle >= 0 ? arb->last_cycle + 1 : cycle;
+    for (int a = 0; a < arb->agents; a++) {
+        if (!request_vector[a] || (bus->busy && bus->current_grant == a)) {
+            arb->since[a] = -1;
+            continue;
+        }
+        if (arb->since[a] < 0) {
+            arb->since[a] = start;
+            // Weighted fair share: an idle agent does not bank credit
+            if (arb->pass[a] < arb->virtual_time) arb->pass[a] = arb->virtual_time;
+        }
+    }
+    arb->last_cycle = cycle;
+
+    /*
+     * 2. BUSY CHECK
      * If the bus is currently executing a transaction (e.g., a multi-cycle flush),
      * we do not change the grant.
      */
@@ -37,27 +201,20 @@ void bus_arbitrate(Bus *bus, bool request_vector[5]) {
     }
 
     /*
-     * 2. ROUND-ROBIN ARBITRATION
-     * We check requests starting from the agent AFTER the last one served.
-     * Order: Core 0 -> 1 -> 2 -> 3 -> Memory (4) -> Core 0...
+     * 3. POLICY
+     * On an atomic bus, a memory request finishes the read in progress.
+     * Memory wins don't move the round-robin pointer.
      */
-    int count = 0;
-    int candidate = (bus->arbitration_rr_index + 1) % 5;
-
-    while (count < 5) {
-        if (request_vector[candidate]) {
-            bus->current_grant = candidate;
-            bus->busy = true;
-            // Only update RR index if a Core won. Memory requests don't shift priority?
-            // (Actually, standard RR updates for everyone, but let's keep existing logic if intended)
-            if (candidate < 4) {
-                bus->arbitration_rr_index = candidate;
-            }
-            return;
-        }
-        candidate = (candidate + 1) % 5;
-        count++;
+    int memory = BUS_MEMORY_ID(bus);
+    int winner = arb->atomic && request_vector[memory] ? memory : choose_master(bus, arb, request_vector, cycle);
+    if (winner < 0) {
+        bus->current_grant = -1;
+        return;
     }
-
-    bus->current_grant = -1;
+    bus->current_grant = winner;
+    bus->busy = true;
+    if (winner < bus->num_cores) {
+        bus->arbitration_rr_index = winner;
+    }
+    record_grant(arb, winner, cycle);
 }
@@ -15,59 +15,500 @@
 #include <stdio.h>
 #include "cache.h"
 
+#define RRPV_MAX 3 // SRRIP: distant re-reference
+
+/*
+ * protocol_of
+ * Transition tables of the cache's protocol (coherence.c), which make every
+ * coherence decision: which accesses hit, which states are dirty, and how a
+ * snooped request changes a copy and whether it flushes or supplies it.
+ */
+static const CoherenceProtocol *protocol_of(const Cache *cache) {
+    return coherence_protocol(cache->protocol);
+}
+
 void cache_init(Cache *cache, int core_id) {
-    memset(cache->dsram, 0, sizeof(cache->dsram));
-    memset(cache->tsram, 0, sizeof(cache->tsram));
     cache->core_id = core_id;
+    cache->protocol = COHERENCE_MESI;
+    cache->upgrades = false;
+    cache->critical_word_first = false;
+    cache->split_bus = false;
+    cache_set_geometry(cache, L1_DEFAULT_SETS, L1_DEFAULT_WAYS, DEFAULT_BLOCK_WORDS, REPLACE_LRU);
     cache->read_hits = 0;
     cache->write_hits = 0;
     cache->read_miss = 0;
     cache->write_miss = 0;
+    cache->restart_savings = 0;
     cache->waiting_for_write = false;
     cache->snoop_result_shared = false;
     cache->is_waiting_for_fill = false;
     cache->pending_addr = 0xFFFFFFFF;
     cache->is_flushing = false;
     cache->flush_addr = 0;
+    cache->flush_line = 0;
+    cache->flush_victim = -1;
     cache->flush_offset = 0;
+    cache->flush_start = 0;
+    cache->flush_supply = SUPPLY_NONE;
+    cache->fill_line = -1;
+    cache->fill_words = 0;
+    cache->restarted = false;
+    cache->update_pending = false;
+    cache->update_done = false;
+    cache->update_data = 0;
     cache->sram_check_countdown = 0;
     cache->eviction_pending = false;
+    cache->num_mshrs = 0;
+    cache->outstanding = 0;
+    cache->num_fills = 0;
+    cache->victim_entries = 0;
+    cache->victim_clock = 0;
+    cache->victim_hits = 0;
+    memset(cache->victim, 0, sizeof(cache->victim));
+}
+
+static int log2_of(int value) {
+    int bits = 0;
+    while ((1 << bits) < value) bits++;
+    return bits;
+}
+
+static bool is_pow2(int value) {
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+bool cache_set_geometry(Cache *cache, int sets, int ways, int block_words, ReplacementPolicy policy) {
+    if (!is_pow2(sets) || !is_pow2(ways) || !is_pow2(block_words) ||
+        ways > L1_MAX_WAYS || block_words > MAX_BLOCK_WORDS ||
+        sets * ways > L1_MAX_LINES || sets * ways * block_words > L1_MAX_WORDS) {
+        return false;
+    }
+    CacheGeometry *geo = &cache->geo;
+    geo->sets = sets;
+    geo->ways = ways;
+    geo->block_words = block_words;
+    geo->policy = policy;
+    geo->offset_bits = log2_of(block_words);
+    geo->index_bits = log2_of(sets);
+
+    /*
+     * The LRU ranks of a set start as a permutation (way w is the w-th most
+     * recent), and SRRIP starts every line at the distant re-reference value.
+     */
+    memset(cache->dsram, 0, sizeof(cache->dsram));
+    memset(cache->tsram, 0, sizeof(cache->tsram));
+    memset(cache->plru_tree, 0, sizeof(cache->plru_tree));
+    for (int line = 0; line < sets * ways; line++) {
+        if (policy == REPLACE_LRU) cache->repl[line] = (uint8_t)(line % ways);
+        else if (policy == REPLACE_SRRIP) cache->repl[line] = RRPV_MAX;
+        else cache->repl[line] = 0;
+    }
+    cache->rng = 0x9E3779B9u ^ (uint32_t)cache->core_id;
+    return true;
+}
+
+bool cache_parse_replacement(const char *name, int *policy) {
+    static const char *names[] = {"lru", "plru", "random", "srrip"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *policy = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Address Decomposition
+ * tag | set index | word offset, by the geometry of the cache.
+ */
+static uint32_t set_of(const Cache *cache, uint32_t addr) {
+    return (addr >> cache->geo.offset_bits) & (uint32_t)(cache->geo.sets - 1);
+}
+
+static uint32_t tag_of(const Cache *cache, uint32_t addr) {
+    return addr >> (cache->geo.offset_bits + cache->geo.index_bits);
+}
+
+static uint32_t offset_of(const Cache *cache, uint32_t addr) {
+    return addr & (uint32_t)(cache->geo.block_words - 1);
+}
+
+/*
+ * all_words
+ * fill_words once every word of a block has arrived.
+ */
+static uint32_t all_words(const Cache *cache) {
+    return (uint32_t)(((uint64_t)1 << cache->geo.block_words) - 1);
+}
+
+static uint32_t *line_data(Cache *cache, int line) {
+    return &cache->dsram[line * cache->geo.block_words];
+}
+
+static uint32_t line_addr(const Cache *cache, int line) {
+    uint32_t set = (uint32_t)(line / cache->geo.ways);
+    return (cache->tsram[line].tag << (cache->geo.offset_bits + cache->geo.index_bits)) |
+           (set << cache->geo.offset_bits);
+}
+
+uint32_t cache_block_base(const Cache *cache, uint32_t addr) {
+    return addr & ~(uint32_t)(cache->geo.block_words - 1);
+}
+
+uint32_t cache_set_index(const Cache *cache, uint32_t addr) {
+    return set_of(cache, addr);
+}
+
+/*
+ * find_line
+ * Returns the valid line of 'set' holding 'tag', or -1.
+ */
+static int find_line(const Cache *cache, uint32_t set, uint32_t tag) {
+    int first = (int)set * cache->geo.ways;
+    for (int line = first; line < first + cache->geo.ways; line++) {
+        const TSRAM_Entry *entry = &cache->tsram[line];
+        if (entry->state != MESI_INVALID && entry->tag == tag) return line;
+    }
+    return -1;
+}
+
+/*
+ * victim_line
+ * The line of 'set' a miss would replace: the first invalid way, otherwise
+ * the choice of the policy. Has no side effects, so the line evicted or
+ * tested for a stall is the one the fill later claims. Direct-mapped, it is
+ * the line of the set.
+ */
+static int victim_line(const Cache *cache, uint32_t set) {
+    int ways = cache->geo.ways;
+    int first = (int)set * ways;
+    if (ways == 1) return first;
+    for (int line = first; line < first + ways; line++) {
+        if (cache->tsram[line].state == MESI_INVALID) return line;
+    }
+
+    switch (cache->geo.policy) {
+        case REPLACE_PLRU: {
+            // Follow the node bits from the root (0 = left subtree is older)
+            int node = 0;
+            while (node < ways - 1) node = 2 * node + 1 + ((cache->plru_tree[set] >> node) & 1);
+            return first + node - (ways - 1);
+        }
+        case REPLACE_RANDOM:
+            return first + (int)(cache->rng & (uint32_t)(ways - 1));
+        case REPLACE_SRRIP: {
+            int victim = first;
+            for (int line = first + 1; line < first + ways; line++) {
+                if (cache->repl[line] > cache->repl[victim]) victim = line;
+            }
+            return victim;
+        }
+        default: {
+            for (int line = first; line < first + ways; line++) {
+                if (cache->repl[line] == ways - 1) return line;
+            }
+            return first;
+        }
+    }
+}
+
+/*
+ * touch
+ * Records a hit on 'line' (or a fill, for the recency-based policies).
+ */
+static void touch(Cache *cache, int line) {
+    int ways = cache->geo.ways;
+    if (ways == 1) return;
+    int first = line - line % ways;
+
+    switch (cache->geo.policy) {
+        case REPLACE_LRU: {
+            uint8_t rank = cache->repl[line];
+            for (int l = first; l < first + ways; l++) {
+                if (cache->repl[l] < rank) cache->repl[l]++;
+            }
+            cache->repl[line] = 0;
+            break;
+        }
+        case REPLACE_PLRU: {
+            // Point every node on the path away from the line
+            uint16_t *tree = &cache->plru_tree[first / ways];
+            int node = line - first + ways - 1;
+            while (node > 0) {
+                int parent = (node - 1) / 2;
+                if (node == 2 * parent + 1) *tree |= (uint16_t)(1 << parent);
+                else *tree &= (uint16_t)~(1 << parent);
+                node = parent;
+            }
+            break;
+        }
+        case REPLACE_SRRIP:
+            cache->repl[line] = 0; // Near-immediate re-reference
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * retire_line
+ * Commits the choice of the policy when the valid 'line' is replaced:
+ * SRRIP ages the set until the victim is distant, the random generator
+ * moves on.
+ */
+static void retire_line(Cache *cache, int line) {
+    if (cache->geo.ways == 1) return;
+    if (cache->geo.policy == REPLACE_SRRIP) {
+        int first = line - line % cache->geo.ways;
+        uint8_t age = (uint8_t)(RRPV_MAX - cache->repl[line]);
+        for (int l = first; l < first + cache->geo.ways; l++) cache->repl[l] += age;
+    } else if (cache->geo.policy == REPLACE_RANDOM) {
+        cache->rng ^= cache->rng << 13;
+        cache->rng ^= cache->rng >> 17;
+        cache->rng ^= cache->rng << 5;
+    }
+}
+
+/*
+ * claim_line
+ * cache_fill_line, committing the choice of the policy when a valid line
+ * is replaced. Called for the first word of the fill.
+ */
+static int claim_line(Cache *cache, uint32_t set, uint32_t tag) {
+    int line = find_line(cache, set, tag);
+    if (line >= 0) return line;
+
+    line = victim_line(cache, set);
+    if (cache->tsram[line].state != MESI_INVALID) retire_line(cache, line);
+    return line;
+}
+
+/*
+ * install
+ * The fill of 'line' is complete: it enters the replacement order.
+ */
+static void install(Cache *cache, int line) {
+    if (cache->geo.policy == REPLACE_SRRIP) {
+        cache->repl[line] = RRPV_MAX - 1; // Long re-reference interval
+    } else {
+        touch(cache, line);
+    }
+}
+
+int cache_fill_line(const Cache *cache, uint32_t addr) {
+    if (cache->fill_line >= 0) return cache->fill_line;
+    uint32_t set = set_of(cache, addr);
+    int line = find_line(cache, set, tag_of(cache, addr));
+    return line >= 0 ? line : victim_line(cache, set);
+}
+
+/*
+ * request_eviction
+ * Starts the write-back of the dirty 'line', unless a write-back is already
+ * under way.
+ */
+static void request_eviction(Cache *cache, int line) {
+    if (!cache->eviction_pending && !cache->is_flushing) {
+        cache->eviction_pending = true; // Request arbitration
+        cache->flush_addr = line_addr(cache, line);
+        cache->flush_line = line;
+        cache->flush_victim = -1;
+        cache->flush_offset = 0;
+        cache->flush_start = 0;
+        cache->flush_supply = SUPPLY_NONE;
+    }
+}
+
+const uint32_t *cache_flush_data(const Cache *cache) {
+    if (cache->flush_victim >= 0) return cache->victim[cache->flush_victim].data;
+    return &cache->dsram[cache->flush_line * cache->geo.block_words];
+}
+
+void cache_flush_done(Cache *cache) {
+    MesiState *state = cache->flush_victim >= 0 ? &cache->victim[cache->flush_victim].state
+                                                : &cache->tsram[cache->flush_line].state;
+    cache->is_flushing = false;
+    if (cache->flush_supply == SUPPLY_NONE) *state = protocol_of(cache)->written_back[*state];
+}
+
+/*
+ * Victim Cache
+ * Fully associative, searched by block address. The entries keep the MESI
+ * state of the lines the arrays gave up and are snooped like them.
+ */
+static int find_victim(const Cache *cache, uint32_t addr) {
+    uint32_t base = cache_block_base(cache, addr);
+    for (int i = 0; i < cache->victim_entries; i++) {
+        if (cache->victim[i].state != MESI_INVALID && cache->victim[i].addr == base) return i;
+    }
+    return -1;
+}
+
+/*
+ * victim_slot
+ * The entry a new victim takes: a free one, otherwise the oldest.
+ */
+static int victim_slot(const Cache *cache) {
+    int slot = 0;
+    for (int i = 0; i < cache->victim_entries; i++) {
+        if (cache->victim[i].state == MESI_INVALID) return i;
+        if ((int32_t)(cache->victim[i].stamp - cache->victim[slot].stamp) < 0) slot = i;
+    }
+    return slot;
+}
+
+/*
+ * flush_busy
+ * True while a flush is requested or in progress: it reads a line or an
+ * entry, so nothing moves between the arrays and the victim cache.
+ */
+static bool flush_busy(const Cache *cache) {
+    return cache->eviction_pending || cache->is_flushing;
+}
+
+/*
+ * stash_line
+ * Moves the valid 'line' into victim cache entry 'slot' (which holds
+ * nothing that must be written back) and frees the line.
+ */
+static void stash_line(Cache *cache, int line, int slot) {
+    VictimEntry *e = &cache->victim[slot];
+    retire_line(cache, line);
+    e->addr = line_addr(cache, line);
+    e->state = cache->tsram[line].state;
+    e->stamp = cache->victim_clock++;
+    memcpy(e->data, line_data(cache, line), cache->geo.block_words * sizeof(uint32_t));
+    cache->tsram[line].state = MESI_INVALID;
+}
+
+/*
+ * swap_in
+ * Moves the block of victim cache entry 'slot' into the line of its set
+ * that a miss would replace; that line, if valid, takes the entry's place.
+ * Returns the line.
+ */
+static int swap_in(Cache *cache, int slot) {
+    VictimEntry e = cache->victim[slot];
+    uint32_t set = set_of(cache, e.addr);
+    int line = victim_line(cache, set);
+    if (cache->tsram[line].state != MESI_INVALID) {
+        stash_line(cache, line, slot);
+    } else {
+        cache->victim[slot].state = MESI_INVALID;
+    }
+    memcpy(line_data(cache, line), e.data, cache->geo.block_words * sizeof(uint32_t));
+    cache->tsram[line].tag = tag_of(cache, e.addr);
+    cache->tsram[line].state = e.state;
+    install(cache, line);
+    return line;
+}
+
+/*
+ * victim_hit
+ * An L1 miss on a block of the victim cache: swaps it in after the tag
+ * check. Returns its line, or -1 while the access must stall.
+ */
+static int victim_hit(Cache *cache, int slot) {
+    if (cache->sram_check_countdown == 0 || flush_busy(cache)) {
+        cache->sram_check_countdown = 1;
+        return -1;
+    }
+    cache->sram_check_countdown = 0;
+    cache->victim_hits++;
+    return swap_in(cache, slot);
+}
+
+/*
+ * make_room
+ * Frees the line a miss in 'set' will fill. Without a victim cache, only a
+ * dirty victim needs its eviction; with one, the victim line moves there
+ * once the entry it replaces has been written back. Returns false while the
+ * access must stall.
+ */
+static bool make_room(Cache *cache, uint32_t set) {
+    const CoherenceProtocol *protocol = protocol_of(cache);
+    int victim = victim_line(cache, set);
+    MesiState state = cache->tsram[victim].state;
+    if (cache->victim_entries == 0) {
+        if (!protocol->dirty[state]) return true;
+        request_eviction(cache, victim);
+        return false;
+    }
+
+    if (state == MESI_INVALID) return true;
+    if (flush_busy(cache)) return false;
+    int slot = victim_slot(cache);
+    const VictimEntry *e = &cache->victim[slot];
+    if (protocol->dirty[e->state]) {
+        cache->eviction_pending = true; // Request arbitration
+        cache->flush_addr = e->addr;
+        cache->flush_victim = slot;
+        cache->flush_offset = 0;
+        cache->flush_start = 0;
+        cache->flush_supply = SUPPLY_NONE;
+        return false;
+    }
+    stash_line(cache, victim, slot);
+    return true;
 }
 
 bool cache_read(Cache *cache, uint32_t addr, uint32_t *data, Bus *bus) {
-    uint32_t set = (addr >> 3) & 0x3F;
-    uint32_t tag = addr >> 9;
-    uint32_t offset = addr & 0x7;
+    uint32_t set = set_of(cache, addr);
+    int line = find_line(cache, set, tag_of(cache, addr));
 
-    TSRAM_Entry *entry = &cache->tsram[set];
+    /*
+     * EARLY RESTART
+     * With critical-word-first, our load miss completes as soon as its word
+     * is in the line being filled. After that, only the other lines can be
+     * read until the fill ends.
+     */
+    if (cache->critical_word_first && addr == cache->pending_addr && cache->fill_line >= 0 &&
+        !cache->waiting_for_write && !cache->restarted && (cache->fill_words & (1u << offset_of(cache, addr)))) {
+        cache->restarted = true;
+        *data = line_data(cache, cache->fill_line)[offset_of(cache, addr)];
+        return true;
+    }
+    if (cache->restarted && (line < 0 || line == cache->fill_line)) return false;
+
+    /*
+     * 0. VICTIM CACHE
+     * A block found there returns to the arrays and is read like a hit,
+     * but counted as a victim hit.
+     */
+    int slot = line < 0 ? find_victim(cache, addr) : -1;
+    if (slot >= 0) {
+        line = victim_hit(cache, slot);
+        if (line < 0) return false;
+        *data = line_data(cache, line)[offset_of(cache, addr)];
+        return true;
+    }
 
     /*
      * 1. HIT DETECTION
-     * If the tag matches and the line is valid, we have a hit.
-     * We return the data immediately.
+     * If a valid line of the set holds the tag, we have a hit.
+     * We return the data immediately. The retry after our own fill is not
+     * a new reference, so it counts neither as a hit nor for replacement.
      */
-    if (entry->state != MESI_INVALID && entry->tag == tag) {
+    if (line >= 0) {
         if (cache->pending_addr == addr) {
             cache->pending_addr = 0xFFFFFFFF;
         } else {
             cache->read_hits++;
+            touch(cache, line);
         }
-        *data = cache->dsram[set][offset];
+        *data = line_data(cache, line)[offset_of(cache, addr)];
         cache->sram_check_countdown = 0;
         return true;
     }
 
     /*
  * 2. CONFLICT EVICTION LOGIC
- * If we missed, and the CURRENT line is Modified, we must flush it first.
+ * If we missed, and the victim line is Modified, we must flush it first.
  * We request the bus for this eviction (eviction_pending) and stall.
+ * With a victim cache, the victim line moves there instead.
  */
-    if (entry->state == MESI_MODIFIED && entry->tag != tag) {
-        if (!cache->eviction_pending && !cache->is_flushing) {
-            cache->eviction_pending = true; // Request arbitration
-            cache->flush_addr = (entry->tag << 9) | (set << 3);
-            cache->flush_offset = 0;
-        }
+    if (!make_room(cache, set)) {
         return false; // Stall core until eviction is done
     }
 
@@ -96,47 +537,118 @@ bool cache_read(Cache *cache, uint32_t addr, uint32_t *data, Bus *bus) {
 }
 
 bool cache_write(Cache *cache, uint32_t addr, uint32_t data, Bus *bus) {
-    uint32_t set = (addr >> 3) & 0x3F;
-    uint32_t tag = addr >> 9;
-    uint32_t offset = addr & 0x7;
+    uint32_t set = set_of(cache, addr);
+    int line = find_line(cache, set, tag_of(cache, addr));
 
-    TSRAM_Entry *entry = &cache->tsram[set];
+    // While a restarted load's fill is arriving, only write hits to the other lines go on
+    if (cache->restarted && (line < 0 || line == cache->fill_line ||
+                             protocol_of(cache)->processor[cache->tsram[line].state][PR_WRITE].request != PR_HIT)) {
+        return false;
+    }
 
-    bool write_hit = (entry->state == MESI_MODIFIED || entry->state == MESI_EXCLUSIVE) && (entry->tag == tag);
+    /*
+     * 0. VICTIM CACHE
+     * A block found there returns to the arrays; a Shared one is then
+     * upgraded like any Shared line.
+     */
+    int slot = line < 0 ? find_victim(cache, addr) : -1;
+    bool victim_hit_done = false;
+    if (slot >= 0) {
+        line = victim_hit(cache, slot);
+        if (line < 0) return false;
+        victim_hit_done = true;
+    }
+    TSRAM_Entry *entry = line >= 0 ? &cache->tsram[line] : NULL;
+    const CoherenceProtocol *protocol = protocol_of(cache);
+    const ProcessorTransition *pr = entry ? &protocol->processor[entry->state][PR_WRITE] : NULL;
+
+    bool write_hit = pr && pr->request == PR_HIT;
 
     /*
      * 1. WRITE HIT
-     * If we have the block in Modified or Exclusive state, we can write directly.
+     * If the protocol lets us write the block (Modified or Exclusive), we write directly.
      * The state becomes Modified.
      */
     if (write_hit) {
         if (cache->pending_addr == addr) {
             cache->pending_addr = 0xFFFFFFFF;
-        } else {
+        } else if (!victim_hit_done) {
             cache->write_hits++;
+            touch(cache, line);
         }
-        cache->dsram[set][offset] = data;
-        entry->state = MESI_MODIFIED;
+        line_data(cache, line)[offset_of(cache, addr)] = data;
+        entry->state = pr->next;
         cache->sram_check_countdown = 0;
         return true;
     }
 
     /*
-  * 2. CONFLICT EVICTION LOGIC
-  * If we missed, and the CURRENT line is Modified, we must flush it first.
+     * 2. WRITE UPDATE
+     * A shared copy under a write-update protocol: the word goes to the
+     * other copies first (BusUpd). The store completes at the retry after
+     * that bus cycle; the block stays shared if another copy asserted the
+     * Shared line.
+     */
+    if (pr && pr->request == PR_BUS_UPDATE) {
+        if (cache->update_done) {
+            line_data(cache, line)[offset_of(cache, addr)] = data;
+            entry->state = protocol->updated[cache->snoop_result_shared];
+            cache->update_done = false;
+            cache->pending_addr = 0xFFFFFFFF;
+            return true;
+        }
+        if (!cache->update_pending) {
+            if (cache->pending_addr != addr && !victim_hit_done) {
+                cache->write_hits++;
+                touch(cache, line);
+            }
+            cache->update_pending = true;
+            cache->update_data = data;
+            cache->pending_addr = addr;
+            cache->snoop_result_shared = false;
+        }
+        return false;
+    }
+
+    /*
+  * 3. CONFLICT EVICTION LOGIC
+  * If we missed, and the victim line is Modified, we must flush it first.
   * We request the bus for this eviction (eviction_pending) and stall.
+  * A Shared copy of the block is upgraded in place and has no victim; an
+  * Owned one is written back first, since memory serves the upgrade.
   */
-    if (entry->state == MESI_MODIFIED && entry->tag != tag) {
-        if (!cache->eviction_pending && !cache->is_flushing) {
-            cache->eviction_pending = true; // Request arbitration
-            cache->flush_addr = (entry->tag << 9) | (set << 3);
-            cache->flush_offset = 0;
-        }
+    if (entry && pr->request == PR_WRITE_BACK) {
+        request_eviction(cache, line);
+        return false;
+    }
+    if (!entry && !make_room(cache, set)) {
         return false; // Stall core until eviction is done
     }
 
     /*
-     * 3. WRITE MISS / UPGRADE
+     * 4. WRITE MISS (READ FIRST)
+     * Under a write-update protocol a store miss reads the block like a
+     * load; the retry after the fill writes or updates it. A BusUpd still
+     * waiting for the bus is dropped with its block (back-invalidation).
+     */
+    if (!entry && protocol->processor[MESI_INVALID][PR_WRITE].request == PR_BUS_READ) {
+        cache->update_pending = false;
+        if (cache->pending_addr != addr) {
+            if (cache->sram_check_countdown == 0) {
+                cache->sram_check_countdown = 1;
+                return false; // Stall core, verify tag
+            }
+            cache->write_miss++;
+            cache->waiting_for_write = false;
+            cache->pending_addr = addr;
+            cache->snoop_result_shared = false;
+            cache->sram_check_countdown = 0;
+        }
+        return false;
+    }
+
+    /*
+     * 5. WRITE MISS / UPGRADE
      * If we don't have the block (or it's Shared), we need to request it (ReadX).
      */
     if (!cache->waiting_for_write) {
@@ -160,37 +672,299 @@ bool cache_write(Cache *cache, uint32_t addr, uint32_t data, Bus *bus) {
     return false;
 }
 
+/*
+ * find_mshr
+ * Returns the index of the MSHR of the block holding 'addr', or -1.
+ */
+static int find_mshr(const Cache *cache, uint32_t addr) {
+    for (int i = 0; i < cache->outstanding; i++) {
+        if (cache_block_base(cache, cache->mshr[i].addr) == cache_block_base(cache, addr)) return i;
+    }
+    return -1;
+}
+
+/*
+ * set_has_mshr
+ * True if a miss is outstanding in the set of 'addr'.
+ */
+static bool set_has_mshr(const Cache *cache, uint32_t addr) {
+    for (int i = 0; i < cache->outstanding; i++) {
+        if (set_of(cache, cache->mshr[i].addr) == set_of(cache, addr)) return true;
+    }
+    return false;
+}
+
+/*
+ * add_target
+ * Appends an access to an MSHR. Returns false if it is full.
+ */
+static bool add_target(const Cache *cache, MSHR *m, bool is_write, uint32_t addr, uint32_t reg, uint32_t data) {
+    if (m->num_targets == MSHR_TARGETS) return false;
+    MSHRTarget *t = &m->target[m->num_targets++];
+    t->is_write = is_write;
+    t->offset = (uint8_t)offset_of(cache, addr);
+    t->reg = (uint8_t)reg;
+    t->data = data;
+    return true;
+}
+
+/*
+ * allocate_mshr
+ * Second half of a primary miss, after the hit check and the eviction of a
+ * Modified victim: waits for the tag check, then claims an MSHR and drops
+ * the victim line (a Shared copy of the block itself is kept for an
+ * upgrade), so a hit never reads a half-filled line. A set has at most one
+ * MSHR. Returns NULL while the access must stall.
+ */
+static MSHR *allocate_mshr(Cache *cache, uint32_t addr, bool exclusive) {
+    if (cache->sram_check_countdown == 0) {
+        cache->sram_check_countdown = 1;
+        return NULL;
+    }
+    if (cache->outstanding == cache->num_mshrs || set_has_mshr(cache, addr)) return NULL;
+    cache->sram_check_countdown = 0;
+
+    uint32_t set = set_of(cache, addr);
+    if (find_line(cache, set, tag_of(cache, addr)) < 0) cache->tsram[victim_line(cache, set)].state = MESI_INVALID;
+
+    MSHR *m = &cache->mshr[cache->outstanding++];
+    m->exclusive = exclusive;
+    m->issued = false;
+    m->addr = addr;
+    m->num_targets = 0;
+    return m;
+}
+
+AccessResult cache_read_async(Cache *cache, uint32_t addr, uint32_t *data, uint32_t reg) {
+    uint32_t set = set_of(cache, addr);
+
+    /*
+     * 1. SECONDARY MISS
+     * The block is already on its way: the load joins its MSHR, behind the
+     * stores to it. It replaces older loads of the same register.
+     */
+    int i = find_mshr(cache, addr);
+    if (i >= 0) {
+        MSHR *m = &cache->mshr[i];
+        if (m->num_targets == MSHR_TARGETS) return ACCESS_STALL;
+        cache_cancel_load(cache, reg);
+        add_target(cache, m, false, addr, reg, 0);
+        cache->read_miss++;
+        return ACCESS_DEFERRED;
+    }
+
+    /*
+     * 2. HIT
+     */
+    int line = find_line(cache, set, tag_of(cache, addr));
+    if (line >= 0) {
+        cache->read_hits++;
+        touch(cache, line);
+        *data = line_data(cache, line)[offset_of(cache, addr)];
+        cache->sram_check_countdown = 0;
+        return ACCESS_DONE;
+    }
+
+    /*
+     * 3. PRIMARY MISS
+     */
+    int victim = victim_line(cache, set);
+    if (protocol_of(cache)->dirty[cache->tsram[victim].state]) {
+        request_eviction(cache, victim);
+        return ACCESS_STALL;
+    }
+    MSHR *m = allocate_mshr(cache, addr, false);
+    if (!m) return ACCESS_STALL;
+    cache_cancel_load(cache, reg);
+    add_target(cache, m, false, addr, reg, 0);
+    cache->read_miss++;
+    return ACCESS_DEFERRED;
+}
+
+AccessResult cache_write_async(Cache *cache, uint32_t addr, uint32_t data) {
+    uint32_t set = set_of(cache, addr);
+
+    /*
+     * 1. SECONDARY MISS
+     * A store can join an MSHR that will bring the block Modified, or one
+     * whose BusRd has not gone out yet (it becomes a BusRdX). A read already
+     * on the bus has to complete first.
+     */
+    int i = find_mshr(cache, addr);
+    if (i >= 0) {
+        MSHR *m = &cache->mshr[i];
+        if ((m->issued && !m->exclusive) || m->num_targets == MSHR_TARGETS) return ACCESS_STALL;
+        m->exclusive = true;
+        add_target(cache, m, true, addr, 0, data);
+        cache->write_miss++;
+        return ACCESS_DEFERRED;
+    }
+
+    /*
+     * 2. WRITE HIT
+     */
+    int line = find_line(cache, set, tag_of(cache, addr));
+    TSRAM_Entry *entry = line >= 0 ? &cache->tsram[line] : NULL;
+    const CoherenceProtocol *protocol = protocol_of(cache);
+    const ProcessorTransition *pr = entry ? &protocol->processor[entry->state][PR_WRITE] : NULL;
+    if (pr && pr->request == PR_HIT) {
+        cache->write_hits++;
+        touch(cache, line);
+        line_data(cache, line)[offset_of(cache, addr)] = data;
+        entry->state = pr->next;
+        cache->sram_check_countdown = 0;
+        return ACCESS_DONE;
+    }
+
+    /*
+     * 3. PRIMARY MISS / UPGRADE
+     * An Owned copy is written back before its upgrade.
+     */
+    if (!entry) {
+        int victim = victim_line(cache, set);
+        if (protocol->dirty[cache->tsram[victim].state]) {
+            request_eviction(cache, victim);
+            return ACCESS_STALL;
+        }
+    } else if (pr->request == PR_WRITE_BACK) {
+        request_eviction(cache, line);
+        return ACCESS_STALL;
+    }
+    MSHR *m = allocate_mshr(cache, addr, true);
+    if (!m) return ACCESS_STALL;
+    add_target(cache, m, true, addr, 0, data);
+    cache->write_miss++;
+    return ACCESS_DEFERRED;
+}
+
+void cache_cancel_load(Cache *cache, uint32_t reg) {
+    for (int i = 0; i < cache->outstanding; i++) {
+        MSHR *m = &cache->mshr[i];
+        for (int t = 0; t < m->num_targets; t++) {
+            if (!m->target[t].is_write && m->target[t].reg == reg) m->target[t].reg = 0;
+        }
+    }
+}
+
+bool cache_would_flush(const Cache *cache, uint32_t addr) {
+    int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+    int slot = line < 0 ? find_victim(cache, addr) : -1;
+    if (line < 0 && slot < 0) return false;
+
+    MesiState state = line >= 0 ? cache->tsram[line].state : cache->victim[slot].state;
+    const CoherenceProtocol *protocol = protocol_of(cache);
+    return protocol->snoop[state][SNOOP_READ].action != SNOOP_KEEP ||
+           protocol->snoop[state][SNOOP_READX].action != SNOOP_KEEP;
+}
+
+bool cache_wants_bus(const Cache *cache) {
+    return cache->eviction_pending || (cache->outstanding > 0 && !cache->mshr[0].issued);
+}
+
+void cache_issue_miss(Cache *cache, Bus *bus) {
+    MSHR *m = &cache->mshr[0];
+    bus->bus_origid = cache->core_id;
+    bus->bus_addr = m->addr;
+    bus->bus_cmd = cache_request_cmd(cache, m->addr, m->exclusive);
+
+    m->issued = true;
+    cache->pending_addr = m->addr;
+    cache->is_waiting_for_fill = true;
+    cache->waiting_for_write = m->exclusive;
+    cache->snoop_result_shared = false;
+}
+
+BusCmd cache_request_cmd(const Cache *cache, uint32_t addr, bool exclusive) {
+    if (!exclusive) return BUS_CMD_READ;
+    if (cache->upgrades && find_line(cache, set_of(cache, addr), tag_of(cache, addr)) >= 0) return BUS_CMD_UPGRADE;
+    return BUS_CMD_READX;
+}
+
+void cache_issue_update(Cache *cache, Bus *bus) {
+    bus->bus_origid = cache->core_id;
+    bus->bus_cmd = BUS_CMD_UPDATE;
+    bus->bus_addr = cache->pending_addr;
+    bus->bus_data = cache->update_data;
+
+    cache->update_pending = false;
+    cache->is_waiting_for_fill = true;
+}
+
+/*
+ * complete_mshr
+ * The block of the oldest MSHR has arrived in 'line': performs its accesses
+ * in order and frees it.
+ */
+static void complete_mshr(Cache *cache, int line) {
+    MSHR *m = &cache->mshr[0];
+    uint32_t *block = line_data(cache, line);
+    cache->num_fills = 0;
+    for (int t = 0; t < m->num_targets; t++) {
+        const MSHRTarget *target = &m->target[t];
+        if (target->is_write) {
+            block[target->offset] = target->data;
+        } else if (target->reg >= 2) {
+            cache->fills[cache->num_fills].reg = target->reg;
+            cache->fills[cache->num_fills].value = block[target->offset];
+            cache->num_fills++;
+        }
+    }
+    cache->outstanding--;
+    memmove(&cache->mshr[0], &cache->mshr[1], cache->outstanding * sizeof(MSHR));
+    cache->pending_addr = 0xFFFFFFFF;
+}
+
+/*
+ * invalidate_copy
+ * Drops the copy in 'line' or victim cache entry 'slot' (either may be -1)
+ * and returns its former state. A write-back of the copy that is still
+ * waiting for the bus is cancelled: the freed line or entry may be refilled
+ * before it would be granted.
+ */
+static MesiState invalidate_copy(Cache *cache, int line, int slot) {
+    if (line < 0 && slot < 0) return MESI_INVALID;
+
+    MesiState *state = line >= 0 ? &cache->tsram[line].state : &cache->victim[slot].state;
+    MesiState old = *state;
+    *state = MESI_INVALID;
+    if (cache->eviction_pending && (line >= 0 ? cache->flush_victim < 0 && cache->flush_line == line
+                                              : cache->flush_victim == slot)) {
+        cache->eviction_pending = false;
+    }
+    return old;
+}
+
 void cache_snoop(Cache *cache, Bus *bus) {
     /*
      * 1. FLUSH STATE MACHINE
      * If this cache is flushing data (due to eviction or snoop),
-     * it drives the bus with the data words one by one.
+     * it drives the bus with the data words one by one, from flush_start.
+     * With a separate data bus, it only drives the data channel once granted;
+     * until then it snoops both channels like the other caches.
      */
-    if (cache->is_flushing) {
+    if (cache->is_flushing && (bus->channel == BUS_CHANNEL_SHARED ||
+                               (bus->channel == BUS_CHANNEL_DATA && bus->current_grant == cache->core_id))) {
         bus->busy = true;
         if (cache->flush_offset < 0) {
             cache->flush_offset++;
             return;
         }
+        int word = (cache->flush_start + cache->flush_offset) & (cache->geo.block_words - 1);
         bus->bus_cmd = BUS_CMD_FLUSH;
-        bus->bus_addr = cache->flush_addr + cache->flush_offset;
-
-        uint32_t set = (cache->flush_addr >> 3) & 0x3F;
-        bus->bus_data = cache->dsram[set][cache->flush_offset];
+        bus->bus_addr = cache->flush_addr + word;
+        bus->bus_data = cache_flush_data(cache)[word];
 
         bus->bus_shared = true;
+        bus->bus_supply = cache->flush_supply;
         bus->bus_origid = cache->core_id;
 
         cache->flush_offset++;
-        if (cache->flush_offset >= 8) {
-            cache->is_flushing = false;
+        if (cache->flush_offset >= cache->geo.block_words) {
             bus->busy = false;
 
             // If we were flushing due to eviction, invalidate the line.
             // If flushing due to Snoop (Modified -> Shared/Invalid), state is handled below.
-            if (cache->tsram[set].state == MESI_MODIFIED) {
-                cache->tsram[set].state = MESI_INVALID;
-            }
+            cache_flush_done(cache);
         }
         return;
     }
@@ -203,66 +977,117 @@ void cache_snoop(Cache *cache, Bus *bus) {
     if (bus->bus_cmd == BUS_CMD_READ || bus->bus_cmd == BUS_CMD_READX) {
         if (bus->bus_origid == cache->core_id) return;
         uint32_t addr = bus->bus_addr;
-        uint32_t set = (addr >> 3) & 0x3F;
-        uint32_t tag = addr >> 9;
+        int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+
+        // A block outside the arrays may sit in the victim cache
+        int slot = line < 0 ? find_victim(cache, addr) : -1;
+        MesiState *state = line >= 0 ? &cache->tsram[line].state :
+                           slot >= 0 ? &cache->victim[slot].state : NULL;
 
-        TSRAM_Entry *entry = &cache->tsram[set];
+        if (state) {
+            const SnoopTransition *t =
+                &protocol_of(cache)->snoop[*state][bus->bus_cmd == BUS_CMD_READ ? SNOOP_READ : SNOOP_READX];
 
-        if (entry->tag == tag && entry->state != MESI_INVALID) {
-            // Assert Shared signal if we have the copy
-            if (bus->bus_cmd == BUS_CMD_READ && entry->state != MESI_MODIFIED) {
+            // Assert Shared signal if we keep a clean copy (a dirty one asserts it while flushing)
+            if (t->shared) {
                 bus->bus_shared = true;
             }
-            // If Modified, we must flush to memory/requester
-            if (entry->state == MESI_MODIFIED) {
+            // The owner (Modified, Owned or Forward) sends the block to memory/requester
+            if (t->action != SNOOP_KEEP) {
                 cache->is_flushing = true;
-                bus->busy = true;
-                cache->flush_addr = addr & ~0x7;
+                if (bus->channel == BUS_CHANNEL_SHARED) bus->busy = true; // Else it requests the data channel
+
+                cache->flush_addr = cache_block_base(cache, addr);
+                cache->flush_line = line;
+                cache->flush_victim = slot;
                 cache->flush_offset = 0;
-                if (bus->bus_cmd == BUS_CMD_READ) {
-                    entry->state = MESI_SHARED;
-                } else {
-                    entry->state = MESI_INVALID;
-                }
-            }
-            else if (entry->state == MESI_EXCLUSIVE) {
-                if (bus->bus_cmd == BUS_CMD_READ) {
-                    entry->state = MESI_SHARED;
-                } else {
-                    entry->state = MESI_INVALID;
-                }
-            }
-            else if (entry->state == MESI_SHARED) {
-                if (bus->bus_cmd == BUS_CMD_READX) {
-                    entry->state = MESI_INVALID;
-                }
+                cache->flush_start = cache->critical_word_first ? (int)offset_of(cache, addr) : 0;
+                cache->flush_supply = t->action != SNOOP_SUPPLY ? SUPPLY_NONE :
+                                      *state == MESI_MODIFIED ? SUPPLY_SAVES_WRITE_BACK : SUPPLY_SAVES_READ;
             }
+            *state = t->next;
+        }
+    }
+
+    /*
+     * 3. UPGRADES
+     * A BusUpgr moves no data: every other copy is dropped, and our own
+     * clean copy becomes Modified in this cycle, which completes the store
+     * (and the targets of its MSHR).
+     */
+    if (bus->bus_cmd == BUS_CMD_UPGRADE) {
+        uint32_t addr = bus->bus_addr;
+        int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+        if (bus->bus_origid == cache->core_id) {
+            cache->tsram[line].state = MESI_MODIFIED;
+            cache->is_waiting_for_fill = false;
+            cache->waiting_for_write = false;
+            touch(cache, line);
+            if (cache->num_mshrs > 0) complete_mshr(cache, line);
+            return;
+        }
+        invalidate_copy(cache, line, line < 0 ? find_victim(cache, addr) : -1);
+        return;
+    }
+
+    /*
+     * 4. WORD UPDATES
+     * A BusUpd writes its word into every other copy of the block. Our own
+     * BusUpd has reached the other caches: the store can complete.
+     */
+    if (bus->bus_cmd == BUS_CMD_UPDATE) {
+        if (bus->bus_origid == cache->core_id) {
+            cache->is_waiting_for_fill = false;
+            cache->update_done = true;
+            return;
         }
+        uint32_t addr = bus->bus_addr;
+        int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+        int slot = line < 0 ? find_victim(cache, addr) : -1;
+        if (line < 0 && slot < 0) return;
+
+        MesiState *state = line >= 0 ? &cache->tsram[line].state : &cache->victim[slot].state;
+        uint32_t *data = line >= 0 ? line_data(cache, line) : cache->victim[slot].data;
+        const SnoopTransition *t = &protocol_of(cache)->snoop[*state][SNOOP_UPDATE];
+        data[offset_of(cache, addr)] = bus->bus_data;
+        if (t->shared) bus->bus_shared = true;
+        *state = t->next;
+        return;
     }
 
     /*
-     * 3. DATA FILL
+     * 5. DATA FILL
      * Accept data from the bus (Flush command) if we are waiting for it.
+     * With critical-word-first the burst starts at the requested word and
+     * wraps around the block, so the fill counts the words it has received.
      */
     if (bus->bus_cmd == BUS_CMD_FLUSH) {
-        if (bus->bus_shared) {
+        // On a split bus, memory tags its data phases and only a supply replaces one
+        bool is_my_data = cache->is_waiting_for_fill &&
+                          cache_block_base(cache, bus->bus_addr) == cache_block_base(cache, cache->pending_addr) &&
+                          (!cache->split_bus || bus->bus_requester == cache->core_id ||
+                           (bus->bus_requester < 0 && bus->bus_supply != SUPPLY_NONE));
+
+        // On a split bus, other flushes go by while our read waits at memory
+        if (bus->bus_shared && (is_my_data || !cache->split_bus)) {
             cache->snoop_result_shared = true;
         }
 
-        bool is_my_data = cache->is_waiting_for_fill &&
-                          ((bus->bus_addr & ~0x7) == (cache->pending_addr & ~0x7));
-
         if (!is_my_data) return;
 
-        uint32_t set = (bus->bus_addr >> 3) & 0x3F;
-        uint32_t tag = bus->bus_addr >> 9;
-        int offset = bus->bus_addr & 0x7;
+        uint32_t tag = tag_of(cache, bus->bus_addr);
+        int offset = (int)offset_of(cache, bus->bus_addr);
 
-        cache->dsram[set][offset] = bus->bus_data;
+        // The first word claims the line (the victim's data is overwritten from here on)
+        if (cache->fill_line < 0) cache->fill_line = claim_line(cache, set_of(cache, bus->bus_addr), tag);
+        int line = cache->fill_line;
+        line_data(cache, line)[offset] = bus->bus_data;
+        cache->fill_words |= 1u << offset;
+        if (cache->restarted) cache->restart_savings++;
 
         // When the last word arrives, update state
-        if (offset == 7) {
-            TSRAM_Entry *entry = &cache->tsram[set];
+        if (cache->fill_words == all_words(cache)) {
+            TSRAM_Entry *entry = &cache->tsram[line];
             entry->tag = tag;
             cache->is_waiting_for_fill = false; // Transaction done
 
@@ -270,12 +1095,219 @@ void cache_snoop(Cache *cache, Bus *bus) {
                 entry->state = MESI_MODIFIED;
                 cache->waiting_for_write = false;
             } else {
-                if (cache->snoop_result_shared) {
-                    entry->state = MESI_SHARED;
-                } else {
-                    entry->state = MESI_EXCLUSIVE;
-                }
+                entry->state = protocol_of(cache)->read_fill[cache->snoop_result_shared];
+            }
+            install(cache, line);
+            cache->fill_line = -1;
+            cache->fill_words = 0;
+            if (cache->restarted) {
+                cache->restarted = false;
+                cache->pending_addr = 0xFFFFFFFF; // The load is done: there is no retry
             }
+            if (cache->num_mshrs > 0) complete_mshr(cache, line);
+        }
+    }
+}
+
+/*
+ * async_access_blocked
+ * cache_access_blocked for a non-blocking cache: only a fill frees a full
+ * MSHR, or the MSHRs and the set.
+ */
+static bool async_access_blocked(const Cache *cache, uint32_t addr, bool is_write) {
+    uint32_t set = set_of(cache, addr);
+    int line = find_line(cache, set, tag_of(cache, addr));
+
+    int i = find_mshr(cache, addr);
+    if (i >= 0) {
+        const MSHR *m = &cache->mshr[i];
+        return m->num_targets == MSHR_TARGETS || (is_write && m->issued && !m->exclusive);
+    }
+
+    const CoherenceProtocol *protocol = protocol_of(cache);
+    if (line >= 0) {
+        uint8_t request = protocol->processor[cache->tsram[line].state][PR_WRITE].request;
+        if (!is_write || request == PR_HIT) return false;
+        if (request == PR_WRITE_BACK) return cache->eviction_pending || cache->is_flushing;
+    } else if (protocol->dirty[cache->tsram[victim_line(cache, set)].state]) {
+        return cache->eviction_pending || cache->is_flushing;
+    }
+    if (cache->sram_check_countdown == 0) return false;
+    return cache->outstanding == cache->num_mshrs || set_has_mshr(cache, addr);
+}
+
+bool cache_access_blocked(const Cache *cache, uint32_t addr, bool is_write) {
+    if (cache->num_mshrs > 0) return async_access_blocked(cache, addr, is_write);
+
+    uint32_t set = set_of(cache, addr);
+    int line = find_line(cache, set, tag_of(cache, addr));
+
+    /*
+     * 1. HIT
+     * A hit always completes, so the access is never blocked. An Owned
+     * copy waits for its write-back before the upgrade, and a write-update
+     * store for the bus.
+     */
+    const CoherenceProtocol *protocol = protocol_of(cache);
+    if (line >= 0) {
+        uint8_t request = protocol->processor[cache->tsram[line].state][PR_WRITE].request;
+        if (!is_write || request == PR_HIT) return false;
+        if (request == PR_WRITE_BACK) return cache->eviction_pending || cache->is_flushing;
+        if (request == PR_BUS_UPDATE) return cache->update_pending;
+    }
+
+    /*
+     * 2. VICTIM CACHE
+     * A victim hit only waits for a flush, after its tag check.
+     */
+    if (line < 0 && find_victim(cache, addr) >= 0) {
+        return cache->sram_check_countdown != 0 && flush_busy(cache);
+    }
+
+    /*
+     * 3. CONFLICT EVICTION
+     * Blocked once the eviction has been requested (or is already flushing).
+     * A line moving to the victim cache waits for any flush.
+     */
+    if (line < 0) {
+        MesiState victim = cache->tsram[victim_line(cache, set)].state;
+        if (cache->victim_entries == 0 && protocol->dirty[victim]) {
+            return cache->eviction_pending || cache->is_flushing;
         }
+        if (cache->victim_entries > 0 && victim != MESI_INVALID) return flush_busy(cache);
+    }
+
+    /*
+     * 4. MISS
+     * Blocked once the miss has been registered for this address (a store
+     * that reads first registers it like a load).
+     */
+    bool read_first = protocol->processor[MESI_INVALID][PR_WRITE].request == PR_BUS_READ;
+    if (is_write && !read_first && !cache->waiting_for_write) return false;
+    return cache->pending_addr == addr;
+}
+
+MesiState cache_probe(const Cache *cache, uint32_t addr) {
+    int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+    return line >= 0 ? cache->tsram[line].state : MESI_INVALID;
+}
+
+uint32_t cache_peek(const Cache *cache, uint32_t addr) {
+    int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+    return line >= 0 ? cache->dsram[line * cache->geo.block_words + offset_of(cache, addr)] : 0;
+}
+
+MesiState cache_back_invalidate(Cache *cache, uint32_t addr, uint32_t block[MAX_BLOCK_WORDS]) {
+    int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+    int slot = line < 0 ? find_victim(cache, addr) : -1;
+    if (line < 0 && slot < 0) return MESI_INVALID;
+
+    MesiState state = line >= 0 ? cache->tsram[line].state : cache->victim[slot].state;
+    if (protocol_of(cache)->dirty[state]) {
+        const uint32_t *data = line >= 0 ? line_data(cache, line) : cache->victim[slot].data;
+        memcpy(block, data, cache->geo.block_words * sizeof(uint32_t));
+    }
+    return invalidate_copy(cache, line, slot);
+}
+
+bool cache_functional_snoop(Cache *cache, uint32_t addr, bool exclusive,
+                            uint32_t block[MAX_BLOCK_WORDS], SnoopAction *action) {
+    int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+    int slot = line < 0 ? find_victim(cache, addr) : -1;
+
+    *action = SNOOP_KEEP;
+    if (line < 0 && slot < 0) return false;
+
+    MesiState *state = line >= 0 ? &cache->tsram[line].state : &cache->victim[slot].state;
+    const SnoopTransition *t = &protocol_of(cache)->snoop[*state][exclusive ? SNOOP_READX : SNOOP_READ];
+    if (t->action != SNOOP_KEEP) {
+        const uint32_t *data = line >= 0 ? line_data(cache, line) : cache->victim[slot].data;
+        memcpy(block, data, cache->geo.block_words * sizeof(uint32_t));
+        *action = (SnoopAction)t->action;
     }
+    *state = t->next;
+    return true;
+}
+
+uint32_t *cache_functional_hit(Cache *cache, uint32_t addr, bool is_write) {
+    int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+    if (line < 0) {
+        int slot = find_victim(cache, addr);
+        if (slot < 0) return NULL;
+        line = swap_in(cache, slot);
+    }
+
+    TSRAM_Entry *entry = &cache->tsram[line];
+    if (is_write) {
+        const ProcessorTransition *pr = &protocol_of(cache)->processor[entry->state][PR_WRITE];
+        if (pr->request != PR_HIT) return NULL;
+        entry->state = pr->next;
+    }
+    touch(cache, line);
+    return &line_data(cache, line)[offset_of(cache, addr)];
+}
+
+bool cache_functional_write_back(Cache *cache, uint32_t addr, uint32_t block[MAX_BLOCK_WORDS]) {
+    const CoherenceProtocol *protocol = protocol_of(cache);
+    int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+    if (line < 0 || protocol->processor[cache->tsram[line].state][PR_WRITE].request != PR_WRITE_BACK) return false;
+
+    MesiState *state = &cache->tsram[line].state;
+    memcpy(block, line_data(cache, line), cache->geo.block_words * sizeof(uint32_t));
+    *state = protocol->written_back[*state];
+    return true;
+}
+
+bool cache_functional_snoop_update(Cache *cache, uint32_t addr, uint32_t value) {
+    int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+    int slot = line < 0 ? find_victim(cache, addr) : -1;
+    if (line < 0 && slot < 0) return false;
+
+    MesiState *state = line >= 0 ? &cache->tsram[line].state : &cache->victim[slot].state;
+    uint32_t *data = line >= 0 ? line_data(cache, line) : cache->victim[slot].data;
+    data[offset_of(cache, addr)] = value;
+    *state = protocol_of(cache)->snoop[*state][SNOOP_UPDATE].next;
+    return true;
+}
+
+uint32_t *cache_functional_update(Cache *cache, uint32_t addr, bool shared) {
+    int line = find_line(cache, set_of(cache, addr), tag_of(cache, addr));
+    cache->tsram[line].state = protocol_of(cache)->updated[shared];
+    return &line_data(cache, line)[offset_of(cache, addr)];
+}
+
+uint32_t *cache_functional_fill(Cache *cache, uint32_t addr, const uint32_t block[MAX_BLOCK_WORDS], MesiState state) {
+    uint32_t tag = tag_of(cache, addr);
+    int line = claim_line(cache, set_of(cache, addr), tag);
+    memcpy(line_data(cache, line), block, cache->geo.block_words * sizeof(uint32_t));
+    cache->tsram[line].tag = tag;
+    cache->tsram[line].state = state;
+    install(cache, line);
+    return &line_data(cache, line)[offset_of(cache, addr)];
+}
+
+bool cache_functional_evict(Cache *cache, uint32_t addr, uint32_t *victim_addr, uint32_t block[MAX_BLOCK_WORDS]) {
+    uint32_t set = set_of(cache, addr);
+    if (find_line(cache, set, tag_of(cache, addr)) >= 0) return false;
+
+    int line = victim_line(cache, set);
+    TSRAM_Entry *entry = &cache->tsram[line];
+    if (cache->victim_entries > 0) {
+        if (entry->state == MESI_INVALID) return false;
+        int slot = victim_slot(cache);
+        VictimEntry *e = &cache->victim[slot];
+        bool write_back = protocol_of(cache)->dirty[e->state];
+        if (write_back) {
+            *victim_addr = e->addr;
+            memcpy(block, e->data, cache->geo.block_words * sizeof(uint32_t));
+        }
+        stash_line(cache, line, slot);
+        return write_back;
+    }
+    if (!protocol_of(cache)->dirty[entry->state]) return false;
+
+    *victim_addr = line_addr(cache, line);
+    memcpy(block, line_data(cache, line), cache->geo.block_words * sizeof(uint32_t));
+    entry->state = MESI_INVALID;
+    return true;
 }
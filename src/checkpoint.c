@@ -0,0 +1,262 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    checkpoint.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * Binary checkpoints of a simulation instance. A checkpoint holds, in order:
+ *
+ *   header   magic, version, sizeof(Core), sizeof(Bus), core count, cycle
+ *   cores    every Core (registers, IMEM, pipeline latches, flags, stats
+ *            and its L1 cache: DSRAM, TSRAM, victim cache, miss, MSHR and
+ *            flush state)
+ *   bus      the Bus wires, arbiter state and traffic counters, then the
+ *            data channel's (idle without a separate data bus), then the
+ *            two Arbiters (policy state and grant waits)
+ *   memory   the memory controller's in-flight read, the LLC (its header
+ *            and statistics, then the tags of its sets * ways lines), then
+ *            the non-zero runs of main memory as (start, length, words...),
+ *            ended by length 0
+ *
+ * The structures are stored as raw images, so a checkpoint can only be
+ * restored by a build with the same layout; the header sizes catch a
+ * mismatch. The next events are recomputed from the agents before every
+ * cycle and the spin detectors only speed up the run, so neither is saved:
+ * a core inside a fast-forwarded loop is checkpointed in its synchronized
+ * state and simply resumes normal simulation after a restore.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checkpoint.h"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t core_size;
+    uint32_t bus_size;
+    int32_t num_cores;
+    int32_t cycle;
+} CheckpointHeader;
+
+typedef struct {
+    int32_t processing_read;
+    int32_t serving_shared_request;
+    int32_t latency_timer;
+    uint32_t target_addr;
+    int32_t word_offset;
+    int32_t requester;
+    int32_t num_requests;
+} MemoryControllerState;
+
+static void write_memory(FILE *fp, const MainMemory *mem) {
+    MemoryControllerState ctl = {
+        mem->processing_read, mem->serving_shared_request,
+        mem->latency_timer, mem->target_addr, mem->word_offset,
+        mem->requester, mem->num_requests
+    };
+    fwrite(&ctl, sizeof(ctl), 1, fp);
+    fwrite(mem->request, sizeof(MemRequest), (size_t)mem->num_requests, fp);
+    fwrite(&mem->llc, offsetof(Llc, line), 1, fp);
+    fwrite(mem->llc.line, sizeof(LlcLine), (size_t)(mem->llc.sets * mem->llc.ways), fp);
+
+    uint32_t addr = 0;
+    while (addr < MAIN_MEMORY_SIZE) {
+        if (mem->data[addr] == 0) {
+            addr++;
+            continue;
+        }
+        uint32_t start = addr;
+        while (addr < MAIN_MEMORY_SIZE && mem->data[addr] != 0) addr++;
+        uint32_t run[2] = {start, addr - start};
+        fwrite(run, sizeof(run), 1, fp);
+        fwrite(&mem->data[start], sizeof(uint32_t), addr - start, fp);
+    }
+    uint32_t end[2] = {0, 0};
+    fwrite(end, sizeof(end), 1, fp);
+}
+
+/*
+ * read_memory
+ * Reads the memory section into 'mem', a freshly created memory that takes
+ * the configuration of 'live', the instance's. Fails on a truncated file or
+ * an LLC of another geometry; 'live' is never written.
+ */
+static bool read_memory(FILE *fp, const MainMemory *live, MainMemory *mem) {
+    mem->read_latency = live->read_latency;
+    mem->block_words = live->block_words;
+    mem->back_invalidate_addr = live->back_invalidate_addr;
+
+    MemoryControllerState ctl;
+    if (fread(&ctl, sizeof(ctl), 1, fp) != 1) return false;
+    mem->processing_read = ctl.processing_read;
+    mem->serving_shared_request = ctl.serving_shared_request;
+    mem->latency_timer = ctl.latency_timer;
+    mem->target_addr = ctl.target_addr;
+    mem->word_offset = ctl.word_offset;
+    mem->requester = ctl.requester;
+
+    // Reads queued on a split bus
+    if (ctl.num_requests < 0 || ctl.num_requests > MEM_MAX_REQUESTS) return false;
+    mem->num_requests = ctl.num_requests;
+    if (fread(mem->request, sizeof(MemRequest), (size_t)mem->num_requests, fp) != (size_t)mem->num_requests) {
+        return false;
+    }
+
+    // The lines only fit the same LLC; the hit latency is this instance's
+    Llc *llc = &mem->llc;
+    if (fread(llc, offsetof(Llc, line), 1, fp) != 1 || llc->sets != live->llc.sets ||
+        llc->ways != live->llc.ways || llc->block_words != live->llc.block_words ||
+        llc->inclusive != live->llc.inclusive) {
+        return false;
+    }
+    llc->hit_latency = live->llc.hit_latency;
+    size_t lines = (size_t)(llc->sets * llc->ways);
+    if (fread(llc->line, sizeof(LlcLine), lines, fp) != lines) return false;
+
+    // The data comes zeroed from memory_create
+    while (true) {
+        uint32_t run[2];
+        if (fread(run, sizeof(run), 1, fp) != 1) return false;
+        if (run[1] == 0) return true;
+        if (run[0] >= MAIN_MEMORY_SIZE || run[1] > MAIN_MEMORY_SIZE - run[0]) return false;
+        if (fread(&mem->data[run[0]], sizeof(uint32_t), run[1], fp) != run[1]) return false;
+    }
+}
+
+/*
+ * state_matches
+ * True if the restored cores and arbiter were saved with this instance's
+ * pipeline, L1 and arbitration configuration.
+ */
+static bool state_matches(const Sim *sim, const Core *cores, const Arbiter *arbiter) {
+    for (int i = 0; i < sim->num_cores; i++) {
+        // Predictions in flight and the tables only make sense to the same predictor
+        const Predictor *bp = &cores[i].predictor;
+        if ((int)bp->kind != sim->config.branch_predictor ||
+            (bp->kind != PREDICT_NONE && (bp->btb_entries != sim->config.btb_entries ||
+                                         bp->pht_entries != sim->config.predictor_entries))) {
+            return false;
+        }
+        // Outstanding misses and buffered stores need the same kind of L1, and its lines the same geometry and protocol
+        const CacheGeometry *geo = &cores[i].l1_cache.geo;
+        if (cores[i].l1_cache.num_mshrs != sim->config.mshrs ||
+            cores[i].sb.depth != sim->config.store_buffer ||
+            cores[i].l1_cache.victim_entries != sim->config.victim_entries ||
+            cores[i].l1_cache.protocol != sim->config.coherence ||
+            geo->sets != sim->config.l1_sets || geo->ways != sim->config.l1_ways ||
+            geo->block_words != sim->config.l1_block || (int)geo->policy != sim->config.l1_replacement) {
+            return false;
+        }
+    }
+
+    // The fair-share passes and the TDMA slots only make sense to the same arbiters
+    return arbiter->policy == sim->config.arbitration && arbiter->slot_cycles == sim->config.tdma_slot &&
+           arbiter->atomic == (sim->config.split_bus == 0);
+}
+
+bool sim_checkpoint_save(const Sim *sim, const char *path) {
+    if (sim->config.quantum > 0 || sim->config.sample_interval > 0) return false;
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) return false;
+
+    CheckpointHeader header = {
+        CHECKPOINT_MAGIC, CHECKPOINT_VERSION, sizeof(Core), sizeof(Bus),
+        sim->num_cores, sim->cycle
+    };
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(sim->cores, sizeof(Core), sim->num_cores, fp);
+    fwrite(&sim->bus, sizeof(Bus), 1, fp);
+    fwrite(&sim->data_bus, sizeof(Bus), 1, fp);
+    fwrite(&sim->arbiter, sizeof(Arbiter), 1, fp);
+    fwrite(&sim->data_arbiter, sizeof(Arbiter), 1, fp);
+    write_memory(fp, sim->memory);
+
+    bool ok = !ferror(fp);
+    if (fclose(fp) != 0) ok = false;
+    return ok;
+}
+
+bool sim_checkpoint_restore(Sim *sim, const char *path) {
+    if (sim->config.quantum > 0 || sim->config.sample_interval > 0) return false;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return false;
+
+    /*
+     * 1. HEADER
+     * Reject foreign files, other builds and other core counts.
+     */
+    CheckpointHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION ||
+        header.core_size != sizeof(Core) || header.bus_size != sizeof(Bus) ||
+        header.num_cores != sim->num_cores || header.cycle < 0) {
+        fclose(fp);
+        return false;
+    }
+
+    /*
+     * 2. STATE
+     * Read into copies and checked against this instance's configuration
+     * before any of its state is touched, so a rejected file leaves it as
+     * it was. The bus keeps the instance's core count, which the header has
+     * already matched.
+     */
+    Core *cores = malloc((size_t)sim->num_cores * sizeof(Core));
+    MainMemory *mem = memory_create();
+    Bus bus, data_bus;
+    Arbiter arbiter, data_arbiter;
+    bool ok = cores && mem &&
+              fread(cores, sizeof(Core), sim->num_cores, fp) == (size_t)sim->num_cores &&
+              fread(&bus, sizeof(Bus), 1, fp) == 1 &&
+              fread(&data_bus, sizeof(Bus), 1, fp) == 1 &&
+              fread(&arbiter, sizeof(Arbiter), 1, fp) == 1 &&
+              fread(&data_arbiter, sizeof(Arbiter), 1, fp) == 1 &&
+              read_memory(fp, sim->memory, mem) &&
+              state_matches(sim, cores, &arbiter);
+    fclose(fp);
+    if (!ok) {
+        free(cores);
+        memory_destroy(mem);
+        return false;
+    }
+
+    memcpy(sim->cores, cores, (size_t)sim->num_cores * sizeof(Core));
+    free(cores);
+    sim->bus = bus;
+    sim->data_bus = data_bus;
+    sim->arbiter = arbiter;
+    sim->data_arbiter = data_arbiter;
+    memory_destroy(sim->memory);
+    sim->memory = mem;
+
+    /*
+     * 3. KERNEL
+     * Resume at the checkpointed cycle with fresh spin detectors and the
+     * pipeline and bus options of this instance.
+     */
+    sim->cycle = header.cycle;
+    sim->memory->critical_word_first = sim->config.critical_word_first;
+    sim->memory->max_requests = sim->config.split_bus;
+    sim->bus.channel = sim->config.data_bus > 0 ? BUS_CHANNEL_ADDRESS : BUS_CHANNEL_SHARED;
+    sim->data_bus.channel = sim->config.data_bus > 0 ? BUS_CHANNEL_DATA : BUS_CHANNEL_SHARED;
+    sim->data_bus.width = sim->config.data_bus > 0 ? sim->config.data_bus : 1;
+    sim->fast_forward_done = true; // The saved run has already started
+    bool all_halted = true;
+    for (int i = 0; i < sim->num_cores; i++) {
+        sim->cores[i].forwarding = sim->config.forwarding;
+        sim->cores[i].l1_cache.upgrades = sim->config.bus_upgrade;
+        sim->cores[i].l1_cache.critical_word_first = sim->config.critical_word_first;
+        sim->cores[i].l1_cache.split_bus = sim->config.split_bus > 0;
+        spin_init(&sim->spin[i]);
+        if (!sim->cores[i].halted) all_halted = false;
+    }
+    sim->done = all_halted || sim->cycle > sim->config.max_cycles;
+    return true;
+}
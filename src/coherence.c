@@ -0,0 +1,143 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    coherence.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * Transition tables of the snooping protocols. The L1 state machine
+ * (cache.c) and the functional model look every decision up here: whether
+ * an access hits, which bus request a miss or an upgrade issues, how a
+ * snooped BusRd/BusRdX changes a copy and who supplies the data, the state
+ * of a fill, and which states must be written back.
+ *
+ * MESI is the original protocol. MSI drops the Exclusive state, so every
+ * store to a block read first needs a BusRdX. MOESI lets a Modified owner
+ * answer a BusRd without the write-back: it keeps the dirty block as Owned
+ * and supplies it to every later reader, and writes it back only when the
+ * line is dropped (or before its own upgrade, since memory is stale).
+ * MESIF marks the newest sharer Forward; that clean copy answers BusRd and
+ * BusRdX cache-to-cache, so the memory read is abandoned.
+ *
+ * Dragon is a write-update protocol: copies are never invalidated. A store
+ * to a shared block broadcasts the word (BusUpd) and every other copy
+ * writes it; the writer becomes the owner, Shared-Modified (kept in the
+ * Owned state) while other copies remain, Modified otherwise. A store miss
+ * reads the block first (BusRd) and then updates it like any other store.
+ * The owner supplies the block to readers and writes it back when it is
+ * dropped, so memory never sees the updated words until then. The Shared
+ * state stands for Dragon's Shared-Clean.
+ */
+
+#include <string.h>
+#include "coherence.h"
+
+#define I MESI_INVALID
+#define S MESI_SHARED
+#define E MESI_EXCLUSIVE
+#define M MESI_MODIFIED
+#define O MESI_OWNED
+#define F MESI_FORWARD
+
+// Processor table entries
+#define HIT(state) {PR_HIT, state}
+#define BUS_RD     {PR_BUS_READ, I}
+#define BUS_RDX    {PR_BUS_READX, I}
+#define BUS_UPD    {PR_BUS_UPDATE, I}
+#define WRITE_BACK {PR_WRITE_BACK, I}
+
+// Snoop table entries
+#define KEEP(state, shared) {state, SNOOP_KEEP, shared}
+#define FLUSH(state)        {state, SNOOP_FLUSH, false}
+#define SUPPLY(state, shared) {state, SNOOP_SUPPLY, shared}
+
+static const CoherenceProtocol PROTOCOLS[] = {
+    [COHERENCE_MSI] = {
+        "msi",
+        //               PrRd          PrWr
+        .processor = {[I] = {BUS_RD,  BUS_RDX},
+                      [S] = {HIT(S),  BUS_RDX},
+                      [M] = {HIT(M),  HIT(M)}},
+        //               BusRd            BusRdX
+        .snoop =     {[S] = {KEEP(S, true), KEEP(I, false)},
+                      [M] = {FLUSH(S),      FLUSH(I)}},
+        .read_fill = {S, S},
+        .dirty = {[M] = true},
+        .written_back = {I, S, E, I, O, F}
+    },
+    [COHERENCE_MESI] = {
+        "mesi",
+        .processor = {[I] = {BUS_RD,  BUS_RDX},
+                      [S] = {HIT(S),  BUS_RDX},
+                      [E] = {HIT(E),  HIT(M)},
+                      [M] = {HIT(M),  HIT(M)}},
+        .snoop =     {[S] = {KEEP(S, true), KEEP(I, false)},
+                      [E] = {KEEP(S, true), KEEP(I, false)},
+                      [M] = {FLUSH(S),      FLUSH(I)}},
+        .read_fill = {E, S},
+        .dirty = {[M] = true},
+        .written_back = {I, S, E, I, O, F}
+    },
+    [COHERENCE_MOESI] = {
+        "moesi",
+        .processor = {[I] = {BUS_RD,  BUS_RDX},
+                      [S] = {HIT(S),  BUS_RDX},
+                      [E] = {HIT(E),  HIT(M)},
+                      [M] = {HIT(M),  HIT(M)},
+                      [O] = {HIT(O),  WRITE_BACK}},
+        .snoop =     {[S] = {KEEP(S, true),   KEEP(I, false)},
+                      [E] = {KEEP(S, true),   KEEP(I, false)},
+                      [M] = {SUPPLY(O, false), SUPPLY(I, false)},
+                      [O] = {SUPPLY(O, true),  SUPPLY(I, false)}},
+        .read_fill = {E, S},
+        .dirty = {[M] = true, [O] = true},
+        .written_back = {I, S, E, I, S, F}
+    },
+    [COHERENCE_MESIF] = {
+        "mesif",
+        .processor = {[I] = {BUS_RD,  BUS_RDX},
+                      [S] = {HIT(S),  BUS_RDX},
+                      [E] = {HIT(E),  HIT(M)},
+                      [M] = {HIT(M),  HIT(M)},
+                      [F] = {HIT(F),  BUS_RDX}},
+        .snoop =     {[S] = {KEEP(S, true),   KEEP(I, false)},
+                      [E] = {KEEP(S, true),   KEEP(I, false)},
+                      [M] = {FLUSH(S),         FLUSH(I)},
+                      [F] = {SUPPLY(S, true),  SUPPLY(I, false)}},
+        .read_fill = {E, F},
+        .dirty = {[M] = true},
+        .written_back = {I, S, E, I, O, F}
+    },
+    [COHERENCE_DRAGON] = {
+        "dragon",
+        .processor = {[I] = {BUS_RD,  BUS_RD},
+                      [S] = {HIT(S),  BUS_UPD},
+                      [E] = {HIT(E),  HIT(M)},
+                      [M] = {HIT(M),  HIT(M)},
+                      [O] = {HIT(O),  BUS_UPD}},
+        //               BusRd             BusRdX            BusUpd
+        .snoop =     {[S] = {KEEP(S, true),   KEEP(I, false),   KEEP(S, true)},
+                      [E] = {KEEP(S, true),   KEEP(I, false),   KEEP(S, true)},
+                      [M] = {SUPPLY(O, false), SUPPLY(I, false), KEEP(S, true)},
+                      [O] = {SUPPLY(O, true),  SUPPLY(I, false), KEEP(S, true)}},
+        .read_fill = {E, S},
+        .updated = {M, O},
+        .dirty = {[M] = true, [O] = true},
+        .written_back = {I, S, E, I, S, F}
+    }
+};
+
+const CoherenceProtocol *coherence_protocol(int kind) {
+    return &PROTOCOLS[kind];
+}
+
+bool coherence_parse(const char *name, int *kind) {
+    for (int k = 0; k < (int)(sizeof(PROTOCOLS) / sizeof(PROTOCOLS[0])); k++) {
+        if (strcmp(name, PROTOCOLS[k].name) == 0) {
+            *kind = k;
+            return true;
+        }
+    }
+    return false;
+}
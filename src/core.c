@@ -29,12 +29,109 @@ uint32_t sign_extend(uint32_t imm) {
 #define GET_RT(inst)     ((inst >> 12) & 0xF)
 #define GET_IMM(inst)    (inst & 0xFFF)
 
+// Decode reads IF/ID without an instruction (fetch past the IMEM) as word 0
+static const DecodedInst no_instruction;
+
+/*
+ * reg_bit
+ * Scoreboard bit of a register; R0 and R1 can never be busy.
+ */
+static uint16_t reg_bit(uint32_t reg) {
+    return reg >= 2 ? (uint16_t)(1u << reg) : 0;
+}
+
+/*
+ * dest_bit
+ * Scoreboard bit of the register an instruction writes in WriteBack (JAL
+ * writes R15), or 0.
+ */
+static uint16_t dest_bit(Opcode op, uint32_t rd) {
+    switch (op) {
+        case OP_SW:
+        case OP_BEQ: case OP_BNE:
+        case OP_BLT: case OP_BGT:
+        case OP_BLE: case OP_BGE:
+        case OP_HALT: case OP_FENCE:
+            return 0;
+        case OP_JAL:
+            return reg_bit(15);
+        default:
+            return reg_bit(rd);
+    }
+}
+
+void core_predecode(Core *core) {
+    for (int i = 0; i < IMEM_SIZE; i++) {
+        uint32_t inst = core->instruction_memory[i];
+        DecodedInst *d = &core->decoded[i];
+        d->op = GET_OPCODE(inst);
+        d->rd = GET_RD(inst);
+        d->rs = GET_RS(inst);
+        d->rt = GET_RT(inst);
+        d->imm = sign_extend(GET_IMM(inst));
+
+        d->src_mask = reg_bit(d->rs);
+        if (d->op != OP_JAL) d->src_mask |= reg_bit(d->rt);
+        if (d->op == OP_SW ||
+            d->op == OP_BEQ || d->op == OP_BNE ||
+            d->op == OP_BLT || d->op == OP_BGT ||
+            d->op == OP_BLE || d->op == OP_BGE) {
+            d->src_mask |= reg_bit(d->rd);
+        }
+
+        d->id_mask = 0;
+        d->ex_mask = 0;
+        if (d->op <= OP_SRL || d->op == OP_LW || d->op == OP_SW) {
+            d->ex_mask = reg_bit(d->rs) | reg_bit(d->rt);
+        } else if (d->op == OP_JAL) {
+            d->id_mask = reg_bit(d->rd);
+        } else if (d->op >= OP_BEQ && d->op <= OP_BGE) {
+            d->id_mask = reg_bit(d->rs) | reg_bit(d->rt) | reg_bit(d->rd);
+        }
+    }
+}
+
+/*
+ * branch_condition
+ * Outcome of a conditional branch on operands 'a' and 'b' (JAL is always
+ * taken, other opcodes never).
+ */
+static bool branch_condition(Opcode op, uint32_t a, uint32_t b) {
+    switch (op) {
+        case OP_BEQ: return a == b;
+        case OP_BNE: return a != b;
+        case OP_BLT: return (int32_t)a < (int32_t)b;
+        case OP_BGT: return (int32_t)a > (int32_t)b;
+        case OP_BLE: return (int32_t)a <= (int32_t)b;
+        case OP_BGE: return (int32_t)a >= (int32_t)b;
+        case OP_JAL: return true;
+        default: return false;
+    }
+}
+
+/*
+ * forward_operand
+ * Value of source register 'reg' in Execute with forwarding: the ALU result
+ * of the previous instruction, which has just left MEM, or the register
+ * file. R1 reads as the immediate.
+ */
+static uint32_t forward_operand(const Core *core, uint32_t reg, uint32_t imm) {
+    if (reg == 1) return imm;
+    const MEM_WB_Latch *prev = &core->mem_wb;
+    if (prev->valid && (dest_bit(prev->Op, prev->Rd_Index) & reg_bit(reg))) return prev->ALUOutput;
+    return core->regs[reg];
+}
+
 void core_init(Core *core, int id, const char *imem_path) {
     memset(core, 0, sizeof(Core));
     core->id = id;
 
     cache_init(&core->l1_cache, id);
 
+    if (imem_path) core_load_imem(core, imem_path);
+}
+
+void core_load_imem(Core *core, const char *imem_path) {
     FILE *fp = fopen(imem_path, "r");
     if (fp) {
         int i = 0;
@@ -47,15 +144,25 @@ void core_init(Core *core, int id, const char *imem_path) {
     } else {
         printf("Error: Could not open IMEM file %s\n", imem_path);
     }
+    core_predecode(core);
 }
 
+/*
+ * stage_wb
+ * Also starts the scoreboard of the cycle: the mask of registers written by
+ * the instructions past Decode is rebuilt as they advance (WB, then MEM/WB,
+ * then EX/MEM), and Decode stalls if it shares a register with the source
+ * mask of its instruction.
+ */
 void stage_wb(Core *core) {
     /*
-     * 1. HAZARD CLEARING
-     * Reset the hazard tracker at the start of the cycle.
-     * This clears the flag from the previous cycle so we don't stall unnecessarily.
+     * 1. SCOREBOARD RESET
+     * Rebuilt every cycle, starting with the register written here; MEM and
+     * EX then add the instructions they pass on.
      */
-    core->wb_hazard_rd = 0;
+    core->busy_regs = 0;
+    core->result_regs = 0;
+    core->load_regs = 0;
 
     if (core->stall) return;
     if (!core->mem_wb.valid) return;
@@ -68,7 +175,11 @@ void stage_wb(Core *core) {
      * If we reach WriteBack with a HALT instruction, the core stops.
      */
     if (op == OP_HALT) {
-        core->halted = true;
+        if (core->l1_cache.outstanding > 0 || core->sb.count > 0 || core->l1_cache.restarted) {
+            core->halt_pending = true;
+        } else {
+            core->halted = true;
+        }
         return;
     }
 
@@ -82,7 +193,7 @@ void stage_wb(Core *core) {
     if (op == OP_SW ||
         op == OP_BEQ || op == OP_BNE ||
         op == OP_BLT || op == OP_BGT ||
-        op == OP_BLE || op == OP_BGE ) {
+        op == OP_BLE || op == OP_BGE || op == OP_FENCE || in->Deferred) {
         write_enable = false;
         }
 
@@ -113,11 +224,64 @@ void stage_wb(Core *core) {
             // C. Publish the Hazard
             // We tell the Decode stage: "I am writing to this register NOW."
             // This allows the Decode stage to stall if it tries to read this specific reg.
-            core->wb_hazard_rd = dest_reg;
+            core->busy_regs = reg_bit(dest_reg);
+
+            // D. Supersede a Deferred Load
+            // An older load of this register still waiting for its fill must not overwrite it.
+            if (core->pending_regs & reg_bit(dest_reg)) {
+                cache_cancel_load(&core->l1_cache, dest_reg);
+                core->pending_regs &= ~reg_bit(dest_reg);
+            }
         }
     }
 }
 
+/*
+ * mem_access_async
+ * Load or store through a non-blocking L1 (MSHRs): one that misses leaves
+ * MEM once the cache has taken it. A deferred load marks its register
+ * pending and skips WriteBack; the fill writes it at the start of a later
+ * cycle (complete_deferred_loads). Decode holds back any instruction that
+ * reads a pending register, a younger write to it cancels the load's write,
+ * and HALT waits in WriteBack until every outstanding miss has completed.
+ * A store whose data register is still pending waits for the fill, since it
+ * reads the register here.
+ */
+static AccessResult mem_access_async(Core *core, const EX_MEM_Latch *in, uint32_t store_data, uint32_t *load_data) {
+    if (in->Op == OP_SW) {
+        if (core->pending_regs & reg_bit(in->Rd_Index)) return ACCESS_STALL;
+        return cache_write_async(&core->l1_cache, in->ALUOutput, store_data);
+    }
+    AccessResult result = cache_read_async(&core->l1_cache, in->ALUOutput, load_data, in->Rd_Index);
+    if (result == ACCESS_DEFERRED) core->pending_regs |= reg_bit(in->Rd_Index);
+    return result;
+}
+
+/*
+ * mem_access_buffered
+ * Load or store with a store buffer. A store leaves MEM as soon as it has an
+ * entry, and the buffer writes it to the L1 in the cycles where MEM does not
+ * use the cache. A load takes its data from the youngest buffered store to
+ * the same address. FENCE waits in MEM until the buffer (and the MSHRs) are
+ * empty, and HALT until the buffer has drained. Returns false if the access
+ * must stall: the buffer is full, or a load that it cannot serve waits for
+ * the oldest store's miss or misses itself.
+ */
+static bool mem_access_buffered(Core *core, const EX_MEM_Latch *in, uint32_t store_data, uint32_t *load_data, Bus *bus) {
+    if (in->Op == OP_SW) {
+        if (sb_push(&core->sb, in->ALUOutput, store_data)) return true;
+        core->stats.sb_full_stalls++;
+        return false;
+    }
+    if (sb_forward(&core->sb, in->ALUOutput, load_data)) {
+        core->stats.sb_forwards++;
+        return true;
+    }
+    if (sb_blocks_load(&core->sb, &core->l1_cache, in->ALUOutput)) return false;
+    core->cache_port_busy = true;
+    return cache_read(&core->l1_cache, in->ALUOutput, load_data, bus);
+}
+
 void stage_mem(Core *core, Bus *bus) {
     EX_MEM_Latch *in = &core->ex_mem;
     MEM_WB_Latch *out = &core->mem_wb;
@@ -127,13 +291,33 @@ void stage_mem(Core *core, Bus *bus) {
         return;
     }
     bool mem_busy = false;
+    bool deferred = false;
 
     /*
      * 1. CACHE ACCESS
      * Attempt to read or write to the L1 Cache.
      * If the cache returns false (miss/busy), we stall the pipeline.
+     * With MSHRs, only an access the cache cannot take yet stalls.
      */
-    if (in->Op == OP_LW) {
+    if (core->l1_cache.num_mshrs > 0 && (in->Op == OP_LW || in->Op == OP_SW)) {
+        AccessResult result = mem_access_async(core, in, rd_data, &out->MemData);
+        if (result == ACCESS_STALL) {
+            mem_busy = true;
+            core->stats.mem_stalls++;
+        }
+        deferred = result == ACCESS_DEFERRED;
+    } else if (core->sb.depth > 0 && (in->Op == OP_LW || in->Op == OP_SW)) {
+        if (!mem_access_buffered(core, in, rd_data, &out->MemData, bus)) {
+            mem_busy = true;
+            core->stats.mem_stalls++;
+        }
+    } else if (in->Op == OP_FENCE) {
+        if (core->sb.count > 0 || core->l1_cache.outstanding > 0) {
+            mem_busy = true;
+            core->stats.mem_stalls++;
+            core->stats.fence_stalls++;
+        }
+    } else if (in->Op == OP_LW) {
         if (cache_read(&core->l1_cache, in->ALUOutput, &out->MemData, bus)) {
             mem_busy = false;
         } else {
@@ -156,18 +340,68 @@ void stage_mem(Core *core, Bus *bus) {
     out->ALUOutput = in->ALUOutput;
     out->Rd_Index = in->Rd_Index;
     out->Op = in->Op;
+    out->Deferred = deferred;
     out->valid = true;
+    core->busy_regs |= reg_bit(out->Rd_Index);
+    core->result_regs |= dest_bit(out->Op, out->Rd_Index);
 }
 
+/*
+ * resolve_branch
+ * With a branch predictor, Fetch consults the BTB and the direction
+ * predictor for every instruction and follows a predicted-taken branch after
+ * its delay slot, exactly as a branch taken in Decode would. Branches and
+ * jumps then read their operands like the ALU and are resolved here, in
+ * Execute, which also trains the predictor. On a misprediction, the delay
+ * slot (in IF/ID) is on the right path either way: the PC is set to the
+ * instruction after it and only this cycle's fetch is squashed. A predicted
+ * branch in the delay slot keeps its own pending redirection. A branch that
+ * was itself the delay slot of a mispredicted one finds IF/ID empty
+ * (squashed): its delay slot is the next fetch, so only the redirection
+ * after it is corrected.
+ */
+static void resolve_branch(Core *core, const ID_EX_Latch *in, bool taken, uint32_t target) {
+    const Prediction *p = &in->Predicted;
+    core->stats.branches++;
+    predictor_update(&core->predictor, in->PC, p->index, in->Op != OP_JAL, taken, target);
+    if (taken == p->taken && (!taken || target == p->target)) return;
+
+    core->stats.mispredicts++;
+    if (core->if_id.Instruction == 0 && core->if_id.PC == 0) {
+        core->branch_pending = taken;
+        core->branch_target = target;
+        return;
+    }
+    core->pc = taken ? target : core->if_id.PC + 1;
+    core->squash_fetch = true;
+}
+
+/*
+ * stage_ex
+ * With forwarding, the operands come from the instruction that has just
+ * left MEM (EX->EX) or from the register file, which WriteBack has already
+ * updated in the same cycle (MEM->EX and WB->ID). Decode then only stalls a
+ * branch or jump on a result still in flight, and an instruction right
+ * behind a load that writes one of its operands (load-use). Store data is
+ * read in MEM and never stalls.
+ */
 void stage_ex(Core *core) {
     ID_EX_Latch *in = &core->id_ex;
     EX_MEM_Latch *out = &core->ex_mem;
     if (core->stall) return;
     out->valid = false;
     if (!in->valid) return;
+
+    // Operands read in Decode, or the forwarded ones
+    uint32_t a = in->A;
+    uint32_t b = in->B;
+    if (core->forwarding) {
+        a = forward_operand(core, in->Rs_Index, in->Imm);
+        b = forward_operand(core, in->Rt_Index, in->Imm);
+    }
     out->PC = in->PC;
     out->Rd_Index = in->Rd_Index;
-    out->B = in->B; // Pass Rt for Store
+    out->B = b; // Pass Rt for Store
     out->Op = in->Op;
 
     /*
@@ -175,187 +409,272 @@ void stage_ex(Core *core) {
      * Perform the arithmetic or logic operation based on the opcode.
      */
     switch (in->Op) {
-        case OP_ADD: out->ALUOutput = in->A + in->B; break;
-        case OP_SUB: out->ALUOutput = in->A - in->B; break;
-        case OP_AND: out->ALUOutput = in->A & in->B; break;
-        case OP_OR:  out->ALUOutput = in->A | in->B; break;
-        case OP_XOR: out->ALUOutput = in->A ^ in->B; break;
-        case OP_MUL: out->ALUOutput = in->A * in->B; break;
-        case OP_SLL: out->ALUOutput = in->A << in->B; break;
-        case OP_SRA: out->ALUOutput = (int32_t)in->A >> in->B; break;
-        case OP_SRL: out->ALUOutput = in->A >> in->B; break;
+        case OP_ADD: out->ALUOutput = a + b; break;
+        case OP_SUB: out->ALUOutput = a - b; break;
+        case OP_AND: out->ALUOutput = a & b; break;
+        case OP_OR:  out->ALUOutput = a | b; break;
+        case OP_XOR: out->ALUOutput = a ^ b; break;
+        case OP_MUL: out->ALUOutput = a * b; break;
+        case OP_SLL: out->ALUOutput = a << b; break;
+        case OP_SRA: out->ALUOutput = (int32_t)a >> b; break;
+        case OP_SRL: out->ALUOutput = a >> b; break;
         case OP_LW:
         case OP_SW:
-            out->ALUOutput = in->A + in->B;
+            out->ALUOutput = a + b;
             break;
         case OP_JAL:
             out->ALUOutput = in->PC + 1;
             break;
         default: out->ALUOutput = 0; break;
     }
+
+    /*
+     * 2. BRANCH RESOLUTION
+     * With a predictor, branches and jumps are resolved here.
+     */
+    if (core->predictor.kind != PREDICT_NONE && in->Op >= OP_BEQ && in->Op <= OP_JAL) {
+        uint32_t target = core->forwarding ? forward_operand(core, in->Rd_Index, in->Imm) & 0x3FF : in->Target;
+        resolve_branch(core, in, branch_condition(in->Op, a, b), target);
+    }
     out->valid = true;
+    core->busy_regs |= reg_bit(out->Rd_Index);
+    core->result_regs |= dest_bit(out->Op, out->Rd_Index);
+    if (out->Op == OP_LW) core->load_regs = dest_bit(OP_LW, out->Rd_Index);
 }
 
-void stage_decode(Core *core) {
+/*
+ * stage_decode
+ * Returns true if the instruction in IF/ID is held back by a data hazard,
+ * in which case Fetch must not overwrite it.
+ */
+bool stage_decode(Core *core) {
     IF_ID_Latch *in = &core->if_id;
     ID_EX_Latch *out = &core->id_ex;
-    if (core->stall) return;
+    if (core->stall) return false;
     if (core->halt_detected) {
         out->valid = false;
-        return;
+        return false;
     }
     if (in->Instruction == 0 && in->PC == 0) {
         out->valid = false;
-        return;
+        return false;
     }
-    uint32_t inst = in->Instruction;
-    Opcode op = GET_OPCODE(inst);
+    const DecodedInst *d = in->Instruction ? &core->decoded[in->PC] : &no_instruction;
+    Opcode op = d->op;
     if (op == OP_HALT) {
         core->halt_detected = true;
     }
-    uint32_t rs = GET_RS(inst);
-    uint32_t rt = GET_RT(inst);
-    uint32_t rd = GET_RD(inst);
-    uint32_t imm = GET_IMM(inst);
-    uint32_t imm_sext = sign_extend(imm);
-    bool hazard = false;
+    uint32_t rs = d->rs;
+    uint32_t rt = d->rt;
+    uint32_t rd = d->rd;
+    uint32_t imm_sext = d->imm;
 
     /*
      * 1. HAZARD DETECTION
-     * Check if any previous stage is writing to a register we need.
-     * If so, stall (insert bubble).
+     * Stall (insert bubble) if an instruction in EX/MEM or MEM/WB, or the
+     * one in WriteBack, writes a register we need. The destination of every
+     * instruction counts, stores and branches included. With forwarding,
+     * only operands that cannot be bypassed in time stall; with a predictor
+     * as well, branch operands are bypassed into Execute like the others.
      */
-    #define CHECK_HAZARD(reg_idx) \
-        if (reg_idx >= 2) { \
-            if (core->id_ex.valid && core->id_ex.Rd_Index == reg_idx) hazard = true; \
-            if (core->ex_mem.valid && core->ex_mem.Rd_Index == reg_idx) hazard = true; \
-            if (core->mem_wb.valid && core->mem_wb.Rd_Index == reg_idx) hazard = true; \
-            if (core->wb_hazard_rd == reg_idx) hazard = true; \
-        }
-    CHECK_HAZARD(rs);
-    if (op != OP_JAL) {
-        CHECK_HAZARD(rt);
-    }
-    if (op == OP_SW ||
-        op == OP_BEQ || op == OP_BNE ||
-        op == OP_BLT || op == OP_BGT ||
-        op == OP_BLE || op == OP_BGE) {
-        CHECK_HAZARD(rd);
+    bool predict = core->predictor.kind != PREDICT_NONE;
+    bool hazard;
+    if (core->forwarding && predict) {
+        hazard = (d->id_mask | d->ex_mask) & core->load_regs;
+    } else if (core->forwarding) {
+        hazard = (d->id_mask & core->result_regs) || (d->ex_mask & core->load_regs);
+    } else {
+        hazard = d->src_mask & core->busy_regs;
     }
+    if ((d->src_mask | d->id_mask) & core->pending_regs) hazard = true;
     if (hazard) {
         out->valid = false;
         core->stats.decode_stalls++;
-        return;
+        return true;
     }
 
     /*
      * 2. BRANCH RESOLUTION
      * Resolve branches in the Decode stage.
      * If taken, update PC and flush Fetch stage (handled in Fetch).
+     * With a predictor, Execute resolves them instead.
      */
     uint32_t val_rs = (rs == 1) ? imm_sext : core->regs[rs];
     uint32_t val_rt = (rt == 1) ? imm_sext : core->regs[rt];
-    bool branch_taken = false;
-    switch (op) {
-        case OP_BEQ: branch_taken = (val_rs == val_rt); break;
-        case OP_BNE: branch_taken = (val_rs != val_rt); break;
-        case OP_BLT: branch_taken = ((int32_t)val_rs < (int32_t)val_rt); break;
-        case OP_BGT: branch_taken = ((int32_t)val_rs > (int32_t)val_rt); break;
-        case OP_BLE: branch_taken = ((int32_t)val_rs <= (int32_t)val_rt); break;
-        case OP_BGE: branch_taken = ((int32_t)val_rs >= (int32_t)val_rt); break;
-        case OP_JAL: branch_taken = true; break;
-        default: break;
-    }
-    if (branch_taken) {
-        if (op == OP_JAL) {
-            out->Rd_Index = 15;
-        }
-        uint32_t target = (rd == 1) ? imm_sext : core->regs[rd];
+    uint32_t target = ((rd == 1) ? imm_sext : core->regs[rd]) & 0x3FF;
+    if (!predict && branch_condition(op, val_rs, val_rt)) {
         core->branch_pending = true;
-        core->branch_target = target & 0x3FF;
+        core->branch_target = target;
     }
     out->PC = in->PC;
     out->Op = op;
     out->Rd_Index = rd;
+    out->Rs_Index = rs;
+    out->Rt_Index = rt;
     out->A = val_rs;
     out->B = val_rt;
     out->Imm = imm_sext;
+    out->Target = target;
+    out->Predicted = in->Predicted;
     out->valid = true;
+    return false;
 }
 
-void stage_fetch(Core *core) {
+/*
+ * stage_fetch
+ * 'decode_stall' is the result of stage_decode in the same cycle.
+ */
+void stage_fetch(Core *core, bool decode_stall) {
     if (core->stall) return;
+    bool squash = core->squash_fetch;
+    core->squash_fetch = false;
     if (core->halt_detected ) {
         core->if_id.Instruction = 0;
         core->if_id.PC = 0;
         return;
     }
-    bool decode_stall = false;
 
     /*
      * 1. HAZARD CHECK (FETCH)
-     * Even though Decode handles hazards, Fetch needs to know if it should
-     * stop fetching new instructions to avoid overwriting the IF/ID latch
-     * if Decode is stalled.
+     * Fetch stops while Decode is stalled, to avoid overwriting the IF/ID
+     * latch.
      */
-    if (core->if_id.Instruction != 0) {
-        uint32_t inst = core->if_id.Instruction;
-        uint32_t rs = GET_RS(inst);
-        uint32_t rt = GET_RT(inst);
-        uint32_t rd = GET_RD(inst);
-        Opcode op = GET_OPCODE(inst);
-        #define CHECK_HAZARD_FETCH(reg_idx) \
-        if (reg_idx >= 2) { \
-            if (core->id_ex.valid && core->id_ex.Rd_Index == reg_idx) { \
-                if (core->id_ex.PC != core->if_id.PC) decode_stall = true; \
-            } \
-            if (core->ex_mem.valid && core->ex_mem.Rd_Index == reg_idx) decode_stall = true; \
-            if (core->mem_wb.valid && core->mem_wb.Rd_Index == reg_idx) decode_stall = true; \
-            if (core->wb_hazard_rd == reg_idx) decode_stall = true; \
-        }
-        CHECK_HAZARD_FETCH(rs);
-        if (op != OP_JAL) { CHECK_HAZARD_FETCH(rt); }
-        if (op == OP_SW ||
-        op == OP_BEQ || op == OP_BNE ||
-        op == OP_BLT || op == OP_BGT ||
-        op == OP_BLE || op == OP_BGE) {
-            CHECK_HAZARD_FETCH(rd);
-        }
-    }
     if (decode_stall) {
         return;
     }
 
     /*
-     * 2. INSTRUCTION FETCH
+     * 2. MISPREDICTION
+     * The instruction fetched on the wrong path in this cycle is discarded:
+     * IF/ID gets a bubble and the corrected PC is fetched next cycle.
+     */
+    if (squash) {
+        memset(&core->if_id, 0, sizeof(core->if_id));
+        core->stats.mispredict_stalls++;
+        return;
+    }
+
+    /*
+     * 3. INSTRUCTION FETCH
      * Fetch instruction from IMEM at current PC.
      * Handle branch targets if a branch was taken in Decode.
+     * A branch predicted taken redirects after its delay slot in the same way.
      */
     if (core->pc < 1024) {
-        core->if_id.Instruction = core->instruction_memory[core->pc];
-        core->if_id.PC = core->pc;
+        uint32_t pc = core->pc;
+        core->if_id.Instruction = core->instruction_memory[pc];
+        core->if_id.PC = pc;
         if (core->branch_pending) {
             core->pc = core->branch_target;
             core->branch_pending = false;
         } else {
             core->pc++;
         }
+        if (core->predictor.kind != PREDICT_NONE) {
+            Prediction p = predictor_predict(&core->predictor, pc);
+            core->if_id.Predicted = p;
+            if (p.taken) {
+                core->branch_pending = true;
+                core->branch_target = p.target;
+            }
+        }
     } else {
         core->if_id.Instruction = 0;
     }
 }
 
+/*
+ * complete_deferred_loads
+ * Writes back the loads completed by a fill of the non-blocking L1 and
+ * counts the outstanding misses.
+ */
+static void complete_deferred_loads(Core *core) {
+    Cache *cache = &core->l1_cache;
+    for (int i = 0; i < cache->num_fills; i++) {
+        core->regs[cache->fills[i].reg] = cache->fills[i].value;
+        core->pending_regs &= ~reg_bit(cache->fills[i].reg);
+    }
+    cache->num_fills = 0;
+
+    if (cache->outstanding > 0) {
+        core->stats.miss_cycles++;
+        core->stats.miss_occupancy += cache->outstanding;
+    }
+}
+
 void core_cycle(Core *core, Bus *bus) {
     if (core->halted) return;
     memcpy(core->trace_regs, core->regs, sizeof(core->regs));
     core->stats.cycles++;
     core->stall = false;
+    core->cache_port_busy = false;
+    if (core->l1_cache.num_mshrs > 0) complete_deferred_loads(core);
+    if (core->halt_pending && core->l1_cache.outstanding == 0 && core->sb.count == 0 && !core->l1_cache.restarted) {
+        core->halt_pending = false;
+        core->halted = true;
+        return;
+    }
     stage_wb(core);
     stage_mem(core, bus);
+    if (core->sb.count > 0 && !core->cache_port_busy) sb_drain(&core->sb, &core->l1_cache, bus);
     stage_ex(core);
-    stage_decode(core);
-    stage_fetch(core);
+    bool decode_stall = stage_decode(core);
+    stage_fetch(core, decode_stall);
     core->stats.instructions++;
     core->stats.instructions--;
     if (core->mem_wb.valid) core->stats.instructions++;
 }
+
+int core_next_event(const Core *core, int now, bool bus_locked) {
+    const Cache *cache = &core->l1_cache;
+    const EX_MEM_Latch *mem = &core->ex_mem;
+
+    // The cache keeps snooping (and flushing) after its core has halted.
+    if (cache->is_flushing) return now;
+    if (core->halted) return EVENT_NEVER;
+
+    // The store buffer drains in the background
+    if (core->sb.count > 0) return now;
+
+    /*
+     * 1. STEADY MEMORY STALL
+     * The pipeline is frozen behind a Load/Store in MEM, WB has drained, and
+     * the cache reports that retrying the access changes nothing. Every cycle
+     * until the fill arrives is then identical (only the counters move).
+     */
+    bool frozen = core->stall &&
+                  mem->valid &&
+                  !core->mem_wb.valid &&
+                  (mem->Op == OP_LW || mem->Op == OP_SW) &&
+                  cache_access_blocked(cache, mem->ALUOutput, mem->Op == OP_SW);
+    if (!frozen) return now;
+
+    /*
+     * 2. BUS REQUEST
+     * A core that still has to win arbitration is only passive while the
+     * memory is holding the bus.
+     */
+    bool needs_bus = cache->num_mshrs > 0 ? cache_wants_bus(cache) :
+                     cache->eviction_pending ||
+                     (cache->pending_addr != 0xFFFFFFFF && !cache->is_waiting_for_fill);
+    if (needs_bus && !bus_locked) return now;
+
+    return EVENT_NEVER;
+}
+
+void core_retire_writeback(Core *core) {
+    core->stall = false;
+    stage_wb(core);
+    core->mem_wb.valid = false;
+}
+
+void core_skip_cycles(Core *core, int n) {
+    memcpy(core->trace_regs, core->regs, sizeof(core->regs));
+    core->busy_regs = 0;
+    core->stats.cycles += n;
+    core->stats.mem_stalls += n;
+    if (core->l1_cache.outstanding > 0) {
+        core->stats.miss_cycles += n;
+        core->stats.miss_occupancy += n * core->l1_cache.outstanding;
+    }
+}
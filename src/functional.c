@@ -0,0 +1,367 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    functional.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * Timing-free execution of the ISA, used to fast-forward a run. Every core
+ * executes directly on its architectural state (registers, PC and delay
+ * slot) from the pre-decoded copy of its IMEM, without pipeline latches,
+ * hazards or bus cycles. Loads and stores still go through the L1 caches,
+ * and a miss applies the MESI effects of the bus transaction functionally,
+ * so the caches stay coherent and warm for the detailed model that takes
+ * over afterwards (the shared LLC included). Branches train the branch predictor for the same reason.
+ */
+
+#include <string.h>
+#include "functional.h"
+
+#define NO_REQUEST 0xFFFFFFFF
+
+static uint32_t *func_access(Core cores[], int num_cores, int id, MainMemory *mem, uint32_t addr, bool is_write);
+static void func_write(Core cores[], int num_cores, int id, MainMemory *mem, uint32_t addr, uint32_t value);
+
+void func_quiesce(Core cores[], int num_cores, MainMemory *mem, Bus *bus) {
+    for (int i = 0; i < num_cores; i++) {
+        Cache *cache = &cores[i].l1_cache;
+
+        /*
+         * 1. FLUSHES
+         * The block is still in the DSRAM (or the victim cache): write the
+         * remaining words and end the flush as the last word would (a
+         * Modified victim is dropped). A supply has not updated memory at
+         * all and its requester's fill is dropped below, so all of its words
+         * are written.
+         */
+        if (cache->is_flushing) {
+            const uint32_t *block = cache_flush_data(cache);
+            int first = cache->flush_offset < 0 || cache->flush_supply != SUPPLY_NONE ? 0 : cache->flush_offset;
+            for (int w = first; w < cache->geo.block_words; w++) {
+                int word = (cache->flush_start + w) & (cache->geo.block_words - 1);
+                if (cache->flush_addr + word < MAIN_MEMORY_SIZE) mem->data[cache->flush_addr + word] = block[word];
+            }
+            cache_flush_done(cache);
+        }
+
+        /*
+         * 2. MISSES
+         * A fill may already have overwritten part of its line, which is
+         * clean (a Modified victim is evicted before the miss), so it is
+         * simply dropped.
+         */
+        if (cache->is_waiting_for_fill) {
+            TSRAM_Entry *entry = &cache->tsram[cache_fill_line(cache, cache->pending_addr)];
+            if (!coherence_protocol(cache->protocol)->dirty[entry->state]) entry->state = MESI_INVALID;
+        }
+        cache->fill_line = -1;
+        cache->fill_words = 0;
+        cache->restarted = false;
+        cache->pending_addr = NO_REQUEST;
+        cache->is_waiting_for_fill = false;
+        cache->waiting_for_write = false;
+        cache->eviction_pending = false;
+        cache->update_pending = false;
+        cache->update_done = false;
+        cache->snoop_result_shared = false;
+        cache->sram_check_countdown = 0;
+    }
+
+    /*
+     * 3. MSHRS AND STORE BUFFERS
+     * The deferred loads and the buffered stores have left the pipeline, so
+     * they are completed here, oldest first, as functional accesses. A HALT
+     * waiting for them can then stop its core.
+     */
+    for (int i = 0; i < num_cores; i++) {
+        Core *core = &cores[i];
+        Cache *cache = &core->l1_cache;
+        for (int m = 0; m < cache->outstanding; m++) {
+            const MSHR *mshr = &cache->mshr[m];
+            for (int t = 0; t < mshr->num_targets; t++) {
+                const MSHRTarget *target = &mshr->target[t];
+                uint32_t addr = cache_block_base(cache, mshr->addr) | target->offset;
+                if (target->is_write) {
+                    func_write(cores, num_cores, i, mem, addr, target->data);
+                } else if (target->reg >= 2) {
+                    core->regs[target->reg] = *func_access(cores, num_cores, i, mem, addr, false);
+                }
+            }
+        }
+        cache->outstanding = 0;
+        cache->num_fills = 0;
+        core->pending_regs = 0;
+
+        // Buffered stores reach the L1 in order, after any miss of theirs was dropped above
+        StoreBuffer *sb = &core->sb;
+        for (; sb->count > 0; sb->count--) {
+            const StoreBufferEntry *e = &sb->entry[sb->head];
+            func_write(cores, num_cores, i, mem, e->addr, e->data);
+            sb->head = (sb->head + 1) % SB_MAX_ENTRIES;
+        }
+        sb->owns_miss = false;
+        if (core->halt_pending) {
+            core->halt_pending = false;
+            core->halted = true;
+        }
+    }
+
+    mem->processing_read = false;
+    mem->latency_timer = 0;
+    mem->word_offset = 0;
+    mem->num_requests = 0;
+    bus->busy = false;
+}
+
+/*
+ * collect_in_flight
+ * Lists the PCs of the instructions in the EX/MEM, ID/EX and IF/ID latches,
+ * oldest first.
+ */
+static int collect_in_flight(const Core *core, uint32_t pcs[3]) {
+    int n = 0;
+    uint32_t candidates[3] = {core->ex_mem.PC, core->id_ex.PC, core->if_id.PC};
+    bool valid[3] = {core->ex_mem.valid, core->id_ex.valid,
+                     !core->halt_detected && !(core->if_id.Instruction == 0 && core->if_id.PC == 0)};
+
+    // Oldest first; a stalled fetch leaves the decoded instruction in IF/ID too
+    for (int i = 0; i < 3; i++) {
+        if (!valid[i]) continue;
+        if (n > 0 && pcs[n - 1] == candidates[i]) continue;
+        pcs[n++] = candidates[i];
+    }
+    return n;
+}
+
+void func_enter(FuncCore *fc, Core *core) {
+    fc->instructions = 0;
+
+    /*
+     * The instruction in MEM/WB has performed its memory access (a store is
+     * visible to the other cores), so it is retired. The register file then
+     * holds the results of every instruction older than the ones left in the
+     * latches, which have no visible effects yet: execution restarts at the
+     * oldest of them. Instructions are fetched along the executed path, so
+     * the next one in the pipeline (or the fetch PC) is its successor, delay
+     * slot included.
+     */
+    if (core->mem_wb.valid) core_retire_writeback(core);
+    if (core->halted) return;
+
+    uint32_t pcs[3];
+    int n = collect_in_flight(core, pcs);
+    if (n == 0) {
+        fc->pc = core->pc;
+        fc->npc = core->branch_pending ? core->branch_target : core->pc + 1;
+    } else {
+        fc->pc = pcs[0];
+        fc->npc = n > 1 ? pcs[1] : core->pc;
+    }
+}
+
+void func_leave(const FuncCore *fc, Core *core) {
+    if (core->halted) return;
+
+    memset(&core->if_id, 0, sizeof(core->if_id));
+    memset(&core->id_ex, 0, sizeof(core->id_ex));
+    memset(&core->ex_mem, 0, sizeof(core->ex_mem));
+    memset(&core->mem_wb, 0, sizeof(core->mem_wb));
+    memcpy(core->trace_regs, core->regs, sizeof(core->regs));
+    core->stall = false;
+    core->halt_detected = false;
+    core->busy_regs = 0;
+
+    // Fetching 'pc' follows a pending branch to 'npc' if it is a delay slot
+    core->pc = fc->pc;
+    core->branch_pending = fc->npc != fc->pc + 1;
+    core->branch_target = fc->npc;
+}
+
+/*
+ * func_access
+ * Returns the L1 word of 'addr' for core 'id', first obtaining the line with
+ * the permission the access needs: a dirty victim (or an Owned copy being
+ * upgraded) is written back, the other caches snoop the BusRd/BusRdX (the
+ * owner supplies the block, and a flush updates memory), the LLC allocates
+ * the block, and the line is filled as after the real transaction. Under a
+ * write-update protocol, a store miss reads the block, and a store that
+ * needs a BusUpd returns NULL for func_write to broadcast it.
+ */
+static uint32_t *func_access(Core cores[], int num_cores, int id, MainMemory *mem, uint32_t addr, bool is_write) {
+    Cache *cache = &cores[id].l1_cache;
+    const CoherenceProtocol *protocol = coherence_protocol(cache->protocol);
+    bool exclusive = is_write && protocol->processor[MESI_INVALID][PR_WRITE].request == PR_BUS_READX;
+
+    /*
+     * 1. HIT
+     */
+    uint32_t *word = cache_functional_hit(cache, addr, is_write);
+    if (word) return word;
+    if (is_write && protocol->processor[cache_probe(cache, addr)][PR_WRITE].request == PR_BUS_UPDATE) return NULL;
+
+    /*
+     * 2. EVICTION
+     */
+    uint32_t victim;
+    uint32_t block[MAX_BLOCK_WORDS];
+    uint32_t base = cache_block_base(cache, addr);
+    if (cache_functional_evict(cache, addr, &victim, block)) {
+        memory_write_block(mem, victim, block);
+    } else if (is_write && cache_functional_write_back(cache, addr, block)) {
+        memory_write_block(mem, base, block);
+    }
+
+    /*
+     * 3. SNOOP AND FILL
+     */
+    bool any_copy = false;
+    bool supplied_any = false;
+    for (int i = 0; i < num_cores; i++) {
+        if (i == id) continue;
+        SnoopAction action;
+        if (!cache_functional_snoop(&cores[i].l1_cache, addr, exclusive, block, &action)) continue;
+        any_copy = true;
+        if (action != SNOOP_KEEP) {
+            if (action == SNOOP_FLUSH) memory_write_block(mem, base, block);
+            supplied_any = true;
+        }
+    }
+    if (!supplied_any) memory_read_block(mem, base, block);
+
+    /*
+     * 4. LAST-LEVEL CACHE
+     */
+    uint32_t replaced;
+    if (mem->llc.sets > 0 && !llc_lookup(&mem->llc, base, &replaced) &&
+        replaced != LLC_NO_VICTIM && mem->llc.inclusive) {
+        int writebacks = 0;
+        func_back_invalidate(cores, num_cores, mem, replaced, &writebacks);
+    }
+
+    MesiState state = exclusive ? MESI_MODIFIED : protocol->read_fill[any_copy];
+    word = cache_functional_fill(cache, addr, block, state);
+    return is_write && !exclusive ? cache_functional_hit(cache, addr, true) : word;
+}
+
+/*
+ * func_write
+ * Stores 'value' at 'addr' for core 'id' through func_access. A store that
+ * needs a BusUpd first writes the word into the other copies.
+ */
+static void func_write(Core cores[], int num_cores, int id, MainMemory *mem, uint32_t addr, uint32_t value) {
+    uint32_t *word = func_access(cores, num_cores, id, mem, addr, true);
+    if (!word) {
+        bool shared = false;
+        for (int i = 0; i < num_cores; i++) {
+            if (i != id && cache_functional_snoop_update(&cores[i].l1_cache, addr, value)) shared = true;
+        }
+        word = cache_functional_update(&cores[id].l1_cache, addr, shared);
+    }
+    *word = value;
+}
+
+int func_back_invalidate(Core cores[], int num_cores, MainMemory *mem, uint32_t addr, int *writebacks) {
+    int dropped = 0;
+    for (int i = 0; i < num_cores; i++) {
+        uint32_t block[MAX_BLOCK_WORDS];
+        MesiState state = cache_back_invalidate(&cores[i].l1_cache, addr, block);
+        if (state == MESI_INVALID) continue;
+        dropped++;
+        if (coherence_protocol(cores[i].l1_cache.protocol)->dirty[state]) {
+            memory_write_block(mem, addr, block);
+            (*writebacks)++;
+        }
+    }
+    return dropped;
+}
+
+long long func_run(FuncCore *fc, Core cores[], int num_cores, int id, MainMemory *mem, long long budget) {
+    Core *core = &cores[id];
+    uint32_t *regs = core->regs;
+    uint32_t pc = fc->pc;
+    uint32_t npc = fc->npc;
+    long long n = 0;
+
+    while (n < budget && !core->halted) {
+        // Past the end of IMEM the pipeline executes no-ops forever
+        if (pc >= IMEM_SIZE) {
+            n = budget;
+            break;
+        }
+
+        /*
+         * 1. OPERANDS
+         * R1 reads as the sign-extended immediate, as in Decode.
+         */
+        const DecodedInst *in = &core->decoded[pc];
+        uint32_t a = in->rs == 1 ? in->imm : regs[in->rs];
+        uint32_t b = in->rt == 1 ? in->imm : regs[in->rt];
+        uint32_t target = (in->rd == 1 ? in->imm : regs[in->rd]) & 0x3FF;
+        uint32_t next = npc + 1;
+        uint32_t result = 0;
+        int dest = in->rd;
+        bool taken = false;
+
+        /*
+         * 2. DISPATCH
+         */
+        switch (in->op) {
+            case OP_ADD: result = a + b; break;
+            case OP_SUB: result = a - b; break;
+            case OP_AND: result = a & b; break;
+            case OP_OR:  result = a | b; break;
+            case OP_XOR: result = a ^ b; break;
+            case OP_MUL: result = a * b; break;
+            case OP_SLL: result = a << b; break;
+            case OP_SRA: result = (int32_t)a >> b; break;
+            case OP_SRL: result = a >> b; break;
+            case OP_BEQ: taken = a == b; dest = 0; break;
+            case OP_BNE: taken = a != b; dest = 0; break;
+            case OP_BLT: taken = (int32_t)a < (int32_t)b; dest = 0; break;
+            case OP_BGT: taken = (int32_t)a > (int32_t)b; dest = 0; break;
+            case OP_BLE: taken = (int32_t)a <= (int32_t)b; dest = 0; break;
+            case OP_BGE: taken = (int32_t)a >= (int32_t)b; dest = 0; break;
+            case OP_JAL:
+                taken = true;
+                result = pc + 1;
+                dest = 15;
+                break;
+            case OP_LW:
+                result = *func_access(cores, num_cores, id, mem, a + b, false);
+                break;
+            case OP_SW:
+                func_write(cores, num_cores, id, mem, a + b, regs[in->rd]);
+                dest = 0;
+                break;
+            case OP_HALT:
+                core->halted = true;
+                dest = 0;
+                break;
+            case OP_FENCE: dest = 0; break; // Every access is already performed
+            default: break; // Unknown opcodes write 0, as the ALU does
+        }
+
+        /*
+         * 3. BRANCHES
+         * A taken branch redirects after the delay slot. The branch
+         * predictor learns from every branch and jump, so the detailed model
+         * takes over with warm tables.
+         */
+        if (taken) next = target;
+        if (core->predictor.kind != PREDICT_NONE && in->op >= OP_BEQ && in->op <= OP_JAL) {
+            predictor_train(&core->predictor, pc, in->op != OP_JAL, taken, target);
+        }
+
+        // Only R2-R15 are writable
+        if (dest >= 2) regs[dest] = result;
+        pc = npc;
+        npc = next;
+        n++;
+    }
+
+    fc->pc = pc;
+    fc->npc = npc;
+    fc->instructions += n;
+    return n;
+}
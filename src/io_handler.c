@@ -8,7 +8,7 @@
  * Description:
  * Handles all file I/O operations, including parsing command-line arguments,
  * loading input files (IMEM, MemIn), and writing output files (Trace, RegOut,
- * DSRAM, TSRAM, Stats, MemOut).
+ * DSRAM, TSRAM, Stats, MemOut, L2 Stats).
  */
 
 #include <stdio.h>
@@ -16,57 +16,162 @@
 #include <string.h>
 #include "io_handler.h"
 
-bool parse_arguments(int argc, char *argv[], SimFiles *files) {
+/*
+ * make_path
+ * Allocates "<dir>/<name>" (or just "<name>" when dir is NULL), where the
+ * name is built from 'fmt' and the core index.
+ */
+static char *make_path(const char *dir, const char *fmt, int index) {
+    char name[64];
+    snprintf(name, sizeof(name), fmt, index);
+    size_t len = (dir ? strlen(dir) + 1 : 0) + strlen(name) + 1;
+    char *path = malloc(len);
+    if (!path) return NULL;
+    if (dir) {
+        snprintf(path, len, "%s/%s", dir, name);
+    } else {
+        snprintf(path, len, "%s", name);
+    }
+    return path;
+}
+
+bool sim_files_alloc(SimFiles *files, int num_cores) {
+    memset(files, 0, sizeof(SimFiles));
+    files->num_cores = num_cores;
+    char ***lists[] = {&files->imem_paths, &files->regout_paths, &files->coretrace_paths,
+                       &files->dsram_paths, &files->tsram_paths, &files->stats_paths};
+    for (size_t l = 0; l < sizeof(lists) / sizeof(lists[0]); l++) {
+        *lists[l] = calloc(num_cores, sizeof(char *));
+        if (!*lists[l]) {
+            sim_files_free(files);
+            return false;
+        }
+    }
+    return true;
+}
+
+void sim_files_free(SimFiles *files) {
+    char **lists[] = {files->imem_paths, files->regout_paths, files->coretrace_paths,
+                      files->dsram_paths, files->tsram_paths, files->stats_paths};
+    for (size_t l = 0; l < sizeof(lists) / sizeof(lists[0]); l++) {
+        if (!lists[l]) continue;
+        for (int c = 0; c < files->num_cores; c++) free(lists[l][c]);
+        free(lists[l]);
+    }
+    free(files->memin_path);
+    free(files->memout_path);
+    free(files->bustrace_path);
+    free(files->l2stats_path);
+    free(files->busstats_path);
+    memset(files, 0, sizeof(SimFiles));
+}
+
+bool sim_files_default(SimFiles *files, const char *dir, int num_cores, bool with_outputs) {
+    if (!sim_files_alloc(files, num_cores)) return false;
+
+    for (int c = 0; c < num_cores; c++) files->imem_paths[c] = make_path(dir, "imem%d.txt", c);
+    files->memin_path = make_path(dir, "memin.txt", 0);
+    if (with_outputs) {
+        files->memout_path = make_path(dir, "memout.txt", 0);
+        files->bustrace_path = make_path(dir, "bustrace.txt", 0);
+        files->l2stats_path = make_path(dir, "l2stats.txt", 0);
+        files->busstats_path = make_path(dir, "busstats.txt", 0);
+        for (int c = 0; c < num_cores; c++) {
+            files->regout_paths[c] = make_path(dir, "regout%d.txt", c);
+            files->coretrace_paths[c] = make_path(dir, "core%dtrace.txt", c);
+            files->dsram_paths[c] = make_path(dir, "dsram%d.txt", c);
+            files->tsram_paths[c] = make_path(dir, "tsram%d.txt", c);
+            files->stats_paths[c] = make_path(dir, "stats%d.txt", c);
+        }
+    }
+    return true;
+}
+
+int discover_num_cores(const char *dir) {
+    int count = 0;
+    while (count < MAX_CORES) {
+        char *path = make_path(dir, "imem%d.txt", count);
+        FILE *fp = path ? fopen(path, "r") : NULL;
+        free(path);
+        if (!fp) break;
+        fclose(fp);
+        count++;
+    }
+    return count;
+}
+
+static char *copy_arg(const char *arg) {
+    char *copy = malloc(strlen(arg) + 1);
+    if (copy) strcpy(copy, arg);
+    return copy;
+}
+
+/*
+ * sibling_path
+ * Allocates the path of file 'name' in the directory of 'path'.
+ */
+static char *sibling_path(const char *path, const char *name) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) return make_path(NULL, name, 0);
+
+    size_t dir_len = (size_t)(slash - path);
+    char *dir = malloc(dir_len + 1);
+    if (!dir) return NULL;
+    memcpy(dir, path, dir_len);
+    dir[dir_len] = '\0';
+    char *sibling = make_path(dir_len ? dir : "", name, 0);
+    free(dir);
+    return sibling;
+}
+
+bool parse_arguments(int argc, char *argv[], SimFiles *files, int num_cores) {
     /*
      * 1. DEFAULT ARGUMENTS
      * If no arguments are provided, use the default filenames specified in the
-     * project requirements. This allows for easy local testing.
+     * project requirements. This allows for easy local testing. Without an
+     * explicit core count, there is one core per imemN.txt found (imem0.txt,
+     * imem1.txt, ... up to the first missing one).
      */
     if (argc < 2) {
-        files->imem_paths[0] = "imem0.txt"; files->imem_paths[1] = "imem1.txt";
-        files->imem_paths[2] = "imem2.txt"; files->imem_paths[3] = "imem3.txt";
-        files->memin_path = "memin.txt";
-        files->memout_path = "memout.txt";
-        files->regout_paths[0] = "regout0.txt"; files->regout_paths[1] = "regout1.txt";
-        files->regout_paths[2] = "regout2.txt"; files->regout_paths[3] = "regout3.txt";
-        files->coretrace_paths[0] = "core0trace.txt"; files->coretrace_paths[1] = "core1trace.txt";
-        files->coretrace_paths[2] = "core2trace.txt"; files->coretrace_paths[3] = "core3trace.txt";
-        files->bustrace_path = "bustrace.txt";
-        files->dsram_paths[0] = "dsram0.txt"; files->dsram_paths[1] = "dsram1.txt";
-        files->dsram_paths[2] = "dsram2.txt"; files->dsram_paths[3] = "dsram3.txt";
-        files->tsram_paths[0] = "tsram0.txt"; files->tsram_paths[1] = "tsram1.txt";
-        files->tsram_paths[2] = "tsram2.txt"; files->tsram_paths[3] = "tsram3.txt";
-        files->stats_paths[0] = "stats0.txt"; files->stats_paths[1] = "stats1.txt";
-        files->stats_paths[2] = "stats2.txt"; files->stats_paths[3] = "stats3.txt";
-        return true;
+        if (num_cores == 0) num_cores = discover_num_cores(NULL);
+        if (num_cores == 0) num_cores = DEFAULT_NUM_CORES;
+        return sim_files_default(files, NULL, num_cores, true);
     }
 
     /*
      * 2. COMMAND LINE PARSING
-     * If arguments are provided, we expect exactly 27 arguments (plus the executable name).
-     * We map them to the SimFiles struct in the specified order.
+     * If arguments are provided, we expect 6 per core plus 3 (27 for the
+     * default 4 cores) and map them to the SimFiles struct in this order:
+     * imem*, memin, memout, regout*, coretrace*, bustrace, dsram*, tsram*, stats*.
      */
-    if (argc != 28) {
-        printf("Error: Expected 27 arguments, got %d\n", argc - 1);
+    int args = argc - 1;
+    int derived = (args - 3) / 6;
+    if (args < 9 || (args - 3) % 6 != 0 || derived > MAX_CORES || (num_cores != 0 && derived != num_cores)) {
+        int cores = num_cores ? num_cores : DEFAULT_NUM_CORES;
+        printf("Error: Expected %d arguments, got %d\n", 6 * cores + 3, args);
         return false;
     }
+    num_cores = derived;
+    if (!sim_files_alloc(files, num_cores)) return false;
 
     int idx = 1;
-    for (int i = 0; i < 4; i++) files->imem_paths[i] = argv[idx++];
-    files->memin_path = argv[idx++];
-    files->memout_path = argv[idx++];
-    for (int i = 0; i < 4; i++) files->regout_paths[i] = argv[idx++];
-    for (int i = 0; i < 4; i++) files->coretrace_paths[i] = argv[idx++];
-    files->bustrace_path = argv[idx++];
-    for (int i = 0; i < 4; i++) files->dsram_paths[i] = argv[idx++];
-    for (int i = 0; i < 4; i++) files->tsram_paths[i] = argv[idx++];
-    for (int i = 0; i < 4; i++) files->stats_paths[i] = argv[idx++];
+    for (int i = 0; i < num_cores; i++) files->imem_paths[i] = copy_arg(argv[idx++]);
+    files->memin_path = copy_arg(argv[idx++]);
+    files->memout_path = copy_arg(argv[idx++]);
+    for (int i = 0; i < num_cores; i++) files->regout_paths[i] = copy_arg(argv[idx++]);
+    for (int i = 0; i < num_cores; i++) files->coretrace_paths[i] = copy_arg(argv[idx++]);
+    files->bustrace_path = copy_arg(argv[idx++]);
+    for (int i = 0; i < num_cores; i++) files->dsram_paths[i] = copy_arg(argv[idx++]);
+    for (int i = 0; i < num_cores; i++) files->tsram_paths[i] = copy_arg(argv[idx++]);
+    for (int i = 0; i < num_cores; i++) files->stats_paths[i] = copy_arg(argv[idx++]);
+    files->l2stats_path = files->memout_path ? sibling_path(files->memout_path, "l2stats.txt") : NULL;
+    files->busstats_path = files->memout_path ? sibling_path(files->memout_path, "busstats.txt") : NULL;
 
     return true;
 }
 
 void load_imem_files(Core cores[], SimFiles *files) {
-    for (int c = 0; c < NUM_CORES; c++) {
+    for (int c = 0; c < files->num_cores; c++) {
         FILE *fp = fopen(files->imem_paths[c], "r");
         if (!fp) {
             continue;
@@ -79,10 +184,12 @@ void load_imem_files(Core cores[], SimFiles *files) {
             addr++;
         }
         fclose(fp);
+        core_predecode(&cores[c]);
     }
 }
 
 void load_memin_file(MainMemory *mem, SimFiles *files) {
+    if (!files->memin_path) return;
     FILE *fp = fopen(files->memin_path, "r");
     if (!fp) return;
 
@@ -95,42 +202,64 @@ void load_memin_file(MainMemory *mem, SimFiles *files) {
     fclose(fp);
 }
 
-void write_core_trace(FILE *fp, Core *core, int cycle) {
-    fprintf(fp, "%d ", cycle);
-
-    if (core->halt_detected) {
-        fprintf(fp, "--- ");
-    }
-    else {
-        fprintf(fp, "%03X ", core->pc & 0xFFF);
+static char *put_hex(char *p, uint32_t value, int digits) {
+    static const char hex[] = "0123456789ABCDEF";
+    for (int i = digits - 1; i >= 0; i--) {
+        p[i] = hex[value & 0xF];
+        value >>= 4;
     }
+    return p + digits;
+}
 
-    if (core->if_id.Instruction == 0 && core->if_id.PC == 0) fprintf(fp, "--- ");
-    else fprintf(fp, "%03X ", core->if_id.PC & 0xFFF);
+static char *put_stage(char *p, bool valid, uint32_t pc) {
+    if (valid) {
+        p = put_hex(p, pc & 0xFFF, 3);
+    } else {
+        *p++ = '-'; *p++ = '-'; *p++ = '-';
+    }
+    *p++ = ' ';
+    return p;
+}
 
-    if (!core->id_ex.valid) fprintf(fp, "--- ");
-    else fprintf(fp, "%03X ", core->id_ex.PC & 0xFFF);
+int format_core_trace(char *buf, Core *core) {
+    char *p = buf;
 
-    if (!core->ex_mem.valid) fprintf(fp, "--- ");
-    else fprintf(fp, "%03X ", core->ex_mem.PC & 0xFFF);
+    p = put_stage(p, !core->halt_detected, core->pc);
+    p = put_stage(p, !(core->if_id.Instruction == 0 && core->if_id.PC == 0), core->if_id.PC);
+    p = put_stage(p, core->id_ex.valid, core->id_ex.PC);
+    p = put_stage(p, core->ex_mem.valid, core->ex_mem.PC);
+    p = put_stage(p, core->mem_wb.valid, core->mem_wb.PC);
 
-    if (!core->mem_wb.valid) {
-        fprintf(fp, "--- ");
-    } else {
-        fprintf(fp, "%03X ", core->mem_wb.PC & 0xFFF);
+    for (int i = 2; i < 16; i++) {
+        p = put_hex(p, core->regs[i], 8);
+        *p++ = (i < 15) ? ' ' : '\n';
     }
+    return (int)(p - buf);
+}
 
-    for (int i = 2; i < 16; i++) {
-        fprintf(fp, "%08X", core->regs[i]);
-        if (i < 15) fprintf(fp, " ");
+void write_trace_line(FILE *fp, int cycle, const char *state, int len) {
+    fprintf(fp, "%d ", cycle);
+    fwrite(state, 1, len, fp);
+}
+
+void write_core_trace(FILE *fp, Core *core, int cycle) {
+    char state[CORE_TRACE_MAX];
+    int len = format_core_trace(state, core);
+    write_trace_line(fp, cycle, state, len);
+}
+
+void write_core_trace_repeat(FILE *fp, Core *core, int first_cycle, int count) {
+    char state[CORE_TRACE_MAX];
+    int len = format_core_trace(state, core);
+    for (int i = 0; i < count; i++) {
+        write_trace_line(fp, first_cycle + i, state, len);
     }
-    fprintf(fp, "\n");
 }
 
 void write_bus_trace(FILE *fp, Bus *bus, int cycle) {
     if (bus->bus_cmd == 0) return;
 
-    fprintf(fp, "%d %X %X %06X %08X %X\n",
+    fprintf(fp, "%d %X %X %06X %08X %X",
             cycle,
             bus->bus_origid,
             bus->bus_cmd,
@@ -138,10 +267,16 @@ void write_bus_trace(FILE *fp, Bus *bus, int cycle) {
             bus->bus_data,
             bus->bus_shared
     );
+    // Separate address and data buses: the channel of the transaction
+    if (bus->channel == BUS_CHANNEL_ADDRESS) fprintf(fp, " A");
+    if (bus->channel == BUS_CHANNEL_DATA) fprintf(fp, " D");
+    fprintf(fp, "\n");
 }
 
 void write_regout_files(Core cores[], SimFiles *files) {
-    for (int c = 0; c < NUM_CORES; c++) {
+    if (!files->regout_paths) return;
+    for (int c = 0; c < files->num_cores; c++) {
+        if (!files->regout_paths[c]) continue;
         FILE *fp = fopen(files->regout_paths[c], "w");
         if (!fp) continue;
         for (int i = 2; i < 16; i++) {
@@ -152,53 +287,115 @@ void write_regout_files(Core cores[], SimFiles *files) {
 }
 
 void write_dsram_files(Core cores[], SimFiles *files) {
-    for (int c = 0; c < NUM_CORES; c++) {
+    if (!files->dsram_paths) return;
+    for (int c = 0; c < files->num_cores; c++) {
+        if (!files->dsram_paths[c]) continue;
         FILE *fp = fopen(files->dsram_paths[c], "w");
         if (!fp) continue;
 
-        for (int s = 0; s < NUM_CACHE_SETS; s++) {
-            for (int b = 0; b < BLOCK_SIZE; b++) {
-                fprintf(fp, "%08X\n", cores[c].l1_cache.dsram[s][b]);
-            }
+        // One block per line, lines ordered by set, then way
+        const Cache *cache = &cores[c].l1_cache;
+        int words = cache->geo.sets * cache->geo.ways * cache->geo.block_words;
+        for (int w = 0; w < words; w++) {
+            fprintf(fp, "%08X\n", cache->dsram[w]);
         }
         fclose(fp);
     }
 }
 
 void write_tsram_files(Core cores[], SimFiles *files) {
-    for (int c = 0; c < NUM_CORES; c++) {
+    if (!files->tsram_paths) return;
+    for (int c = 0; c < files->num_cores; c++) {
+        if (!files->tsram_paths[c]) continue;
         FILE *fp = fopen(files->tsram_paths[c], "w");
         if (!fp) continue;
 
-        for (int s = 0; s < NUM_CACHE_SETS; s++) {
+        /*
+         * The state sits right above the tag field, which is 12 bits wide
+         * unless a smaller geometry needs more tag bits.
+         */
+        const Cache *cache = &cores[c].l1_cache;
+        int tag_bits = ADDRESS_BITS - cache->geo.offset_bits - cache->geo.index_bits;
+        if (tag_bits < 12) tag_bits = 12;
+        for (int line = 0; line < cache->geo.sets * cache->geo.ways; line++) {
             uint32_t val = 0;
-            val |= (cores[c].l1_cache.tsram[s].state << 12);
-            val |= (cores[c].l1_cache.tsram[s].tag & 0xFFF);
+            val |= ((uint32_t)cache->tsram[line].state << tag_bits);
+            val |= (cache->tsram[line].tag & ((1u << tag_bits) - 1));
             fprintf(fp, "%08X\n", val);
         }
         fclose(fp);
     }
 }
 
+int collect_core_stats(Core *core, StatEntry out[]) {
+    int n = 0;
+    out[n++] = (StatEntry){"cycles", core->stats.cycles};
+    out[n++] = (StatEntry){"instructions", core->stats.instructions};
+    out[n++] = (StatEntry){"read_hit", core->l1_cache.read_hits};
+    out[n++] = (StatEntry){"write_hit", core->l1_cache.write_hits};
+    out[n++] = (StatEntry){"read_miss", core->l1_cache.read_miss};
+    out[n++] = (StatEntry){"write_miss", core->l1_cache.write_miss};
+    out[n++] = (StatEntry){"decode_stall", core->stats.decode_stalls};
+    out[n++] = (StatEntry){"mem_stall", core->stats.mem_stalls};
+    if (core->predictor.kind != PREDICT_NONE) {
+        out[n++] = (StatEntry){"branches", core->stats.branches};
+        out[n++] = (StatEntry){"mispredicts", core->stats.mispredicts};
+        out[n++] = (StatEntry){"mispredict_stall", core->stats.mispredict_stalls};
+    }
+    if (core->l1_cache.num_mshrs > 0) {
+        out[n++] = (StatEntry){"miss_cycles", core->stats.miss_cycles};
+        out[n++] = (StatEntry){"miss_occupancy", core->stats.miss_occupancy};
+    }
+    if (core->l1_cache.victim_entries > 0) {
+        out[n++] = (StatEntry){"victim_hit", core->l1_cache.victim_hits};
+    }
+    if (core->sb.depth > 0) {
+        out[n++] = (StatEntry){"sb_forward", core->stats.sb_forwards};
+        out[n++] = (StatEntry){"sb_full_stall", core->stats.sb_full_stalls};
+        out[n++] = (StatEntry){"fence_stall", core->stats.fence_stalls};
+    }
+    if (core->l1_cache.critical_word_first) {
+        out[n++] = (StatEntry){"restart_savings", core->l1_cache.restart_savings};
+    }
+    return n;
+}
+
 void write_stats_files(Core cores[], SimFiles *files) {
-    for (int c = 0; c < NUM_CORES; c++) {
+    if (!files->stats_paths) return;
+    for (int c = 0; c < files->num_cores; c++) {
+        if (!files->stats_paths[c]) continue;
         FILE *fp = fopen(files->stats_paths[c], "w");
         if (!fp) continue;
 
-        fprintf(fp, "cycles %d\n", cores[c].stats.cycles);
-        fprintf(fp, "instructions %d\n", cores[c].stats.instructions);
-        fprintf(fp, "read_hit %d\n", cores[c].l1_cache.read_hits);
-        fprintf(fp, "write_hit %d\n", cores[c].l1_cache.write_hits);
-        fprintf(fp, "read_miss %d\n", cores[c].l1_cache.read_miss);
-        fprintf(fp, "write_miss %d\n", cores[c].l1_cache.write_miss);
-        fprintf(fp, "decode_stall %d\n", cores[c].stats.decode_stalls);
-        fprintf(fp, "mem_stall %d\n", cores[c].stats.mem_stalls);
+        StatEntry stats[MAX_CORE_STATS];
+        int n = collect_core_stats(&cores[c], stats);
+        for (int i = 0; i < n; i++) {
+            fprintf(fp, "%s %d\n", stats[i].name, stats[i].value);
+        }
+        if (cores[c].predictor.kind != PREDICT_NONE) {
+            int branches = cores[c].stats.branches;
+            if (branches > 0) {
+                fprintf(fp, "branch_accuracy %.4f\n", 1.0 - (double)cores[c].stats.mispredicts / branches);
+            } else {
+                fprintf(fp, "branch_accuracy n/a\n");
+            }
+        }
+        // Memory-level parallelism: average outstanding misses while any is
+        if (cores[c].l1_cache.num_mshrs > 0) {
+            int miss_cycles = cores[c].stats.miss_cycles;
+            if (miss_cycles > 0) {
+                fprintf(fp, "mlp %.4f\n", (double)cores[c].stats.miss_occupancy / miss_cycles);
+            } else {
+                fprintf(fp, "mlp n/a\n");
+            }
+        }
 
         fclose(fp);
     }
 }
 
 void write_memout_file(MainMemory *mem, SimFiles *files) {
+    if (!files->memout_path) return;
     FILE *fp = fopen(files->memout_path, "w");
     if (!fp) return;
 
@@ -215,3 +412,102 @@ void write_memout_file(MainMemory *mem, SimFiles *files) {
 
     fclose(fp);
 }
+
+void write_l2stats_file(const Llc *llc, SimFiles *files) {
+    if (!files->l2stats_path) return;
+    FILE *fp = fopen(files->l2stats_path, "w");
+    if (!fp) return;
+
+    fprintf(fp, "hits %d\n", llc->hits);
+    fprintf(fp, "misses %d\n", llc->misses);
+    int accesses = llc->hits + llc->misses;
+    if (accesses > 0) {
+        fprintf(fp, "hit_rate %.4f\n", (double)llc->hits / accesses);
+    } else {
+        fprintf(fp, "hit_rate n/a\n");
+    }
+    fprintf(fp, "evictions %d\n", llc->evictions);
+    fprintf(fp, "back_invalidations %d\n", llc->back_invalidations);
+    fprintf(fp, "back_invalidation_writebacks %d\n", llc->back_invalidation_writebacks);
+
+    fclose(fp);
+}
+
+/*
+ * write_channel_stats
+ * Utilization of one bus over the run, prefixed with its channel name.
+ */
+static void write_channel_stats(FILE *fp, const char *name, const Bus *bus, int cycles) {
+    fprintf(fp, "%s_busy_cycles %d\n", name, bus->stats.busy_cycles);
+    fprintf(fp, "%s_utilization %.4f\n", name, cycles > 0 ? (double)bus->stats.busy_cycles / cycles : 0.0);
+}
+
+/*
+ * write_arbiter_stats
+ * Grant waits of every agent of an arbiter ("core0".., then "memory"),
+ * prefixed with 'prefix': the grants, the mean, 99th percentile and largest
+ * wait, and the histogram (see ARB_WAIT_BUCKETS).
+ */
+static void write_arbiter_stats(FILE *fp, const char *prefix, const Arbiter *arb) {
+    for (int a = 0; a < arb->agents; a++) {
+        const ArbiterAgentStats *stats = &arb->stats[a];
+        char name[32];
+        if (a < arb->agents - 1) snprintf(name, sizeof(name), "%score%d", prefix, a);
+        else snprintf(name, sizeof(name), "%smemory", prefix);
+
+        fprintf(fp, "%s_grants %d\n", name, stats->grants);
+        fprintf(fp, "%s_mean_wait %.4f\n", name, stats->grants > 0 ? (double)stats->wait_cycles / stats->grants : 0.0);
+        fprintf(fp, "%s_p99_wait %d\n", name, arbiter_wait_percentile(stats, 0.99));
+        fprintf(fp, "%s_max_wait %d\n", name, stats->max_wait);
+        fprintf(fp, "%s_wait_histogram", name);
+        for (int b = 0; b < ARB_WAIT_BUCKETS; b++) fprintf(fp, " %d", stats->histogram[b]);
+        fprintf(fp, "\n");
+    }
+}
+
+void write_busstats_file(const Bus *bus, const Bus *data, const Arbiter *arb, const Arbiter *data_arb,
+                         const char *protocol, int cycles, SimFiles *files) {
+    if (!files->busstats_path) return;
+    FILE *fp = fopen(files->busstats_path, "w");
+    if (!fp) return;
+
+    /*
+     * With a separate data bus, the commands are counted on the address
+     * channel and the data words on the data channel.
+     */
+    const BusStats *stats = &bus->stats;
+    const BusStats *words = data ? &data->stats : stats;
+    fprintf(fp, "protocol %s\n", protocol);
+    fprintf(fp, "busy_cycles %d\n", stats->busy_cycles);
+    fprintf(fp, "reads %d\n", stats->reads);
+    fprintf(fp, "read_exclusives %d\n", stats->read_exclusives);
+    fprintf(fp, "upgrades %d\n", stats->upgrades);
+    fprintf(fp, "updates %d\n", stats->updates);
+    fprintf(fp, "flush_words %d\n", words->flush_words);
+    fprintf(fp, "memory_read_words %d\n", words->memory_read_words);
+    fprintf(fp, "memory_write_words %d\n", words->memory_write_words);
+    fprintf(fp, "write_backs_avoided %d\n", words->write_backs_avoided);
+    fprintf(fp, "memory_reads_avoided %d\n", words->memory_reads_avoided);
+    fprintf(fp, "memory_cycles_avoided %d\n", words->memory_cycles_avoided);
+    fprintf(fp, "data_words %d\n", words->flush_words + words->memory_read_words + stats->updates);
+    if (stats->read_cycles > 0) {
+        fprintf(fp, "read_cycles %d\n", stats->read_cycles);
+        fprintf(fp, "read_occupancy %lld\n", stats->read_occupancy);
+        fprintf(fp, "reads_in_flight %.4f\n", (double)stats->read_occupancy / stats->read_cycles);
+    }
+    if (data) {
+        write_channel_stats(fp, "address", bus, cycles);
+        write_channel_stats(fp, "data", data, cycles);
+        fprintf(fp, "data_bus_width %d\n", data->width);
+    } else if (stats->read_cycles > 0) {
+        write_channel_stats(fp, "bus", bus, cycles);
+        fprintf(fp, "requests_behind_data %d\n", stats->requests_behind_data);
+    }
+
+    // Arbitration: the address channel's agents, then the data channel's
+    fprintf(fp, "arbitration %s\n", arbiter_policy_name(arb->policy));
+    write_arbiter_stats(fp, "", arb);
+    if (data_arb) write_arbiter_stats(fp, "data_", data_arb);
+
+    fclose(fp);
+}
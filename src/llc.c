@@ -0,0 +1,63 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    llc.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * Tag store of the shared last-level cache. The memory controller consults
+ * it for every bus read to pick the hit or the DRAM latency; write-backs go
+ * through to main memory, so the LLC never holds dirty data and the block
+ * contents are read from the memory image.
+ */
+
+#include <string.h>
+#include "llc.h"
+
+bool llc_configure(Llc *llc, int sets, int ways, int block_words, int hit_latency, bool inclusive) {
+    if (sets < 0 || (sets & (sets - 1)) != 0 || ways < 1 || ways > LLC_MAX_WAYS ||
+        (ways & (ways - 1)) != 0 || sets * ways > LLC_MAX_LINES) {
+        return false;
+    }
+    memset(llc, 0, sizeof(Llc));
+    llc->sets = sets;
+    llc->ways = ways;
+    llc->block_words = block_words;
+    llc->hit_latency = hit_latency;
+    llc->inclusive = inclusive;
+    return true;
+}
+
+bool llc_lookup(Llc *llc, uint32_t addr, uint32_t *victim) {
+    uint32_t block = addr / (uint32_t)llc->block_words;
+    LlcLine *set = &llc->line[(block & (uint32_t)(llc->sets - 1)) * llc->ways];
+
+    /*
+     * 1. HIT
+     */
+    for (int w = 0; w < llc->ways; w++) {
+        if (set[w].valid && set[w].block == block) {
+            set[w].stamp = llc->clock++;
+            return true;
+        }
+    }
+
+    /*
+     * 2. MISS
+     * An invalid way if there is one, otherwise the least recently used.
+     */
+    int way = 0;
+    for (int w = 0; w < llc->ways; w++) {
+        if (!set[w].valid) {
+            way = w;
+            break;
+        }
+        if ((int32_t)(set[w].stamp - set[way].stamp) < 0) way = w;
+    }
+    *victim = set[way].valid ? set[way].block * (uint32_t)llc->block_words : LLC_NO_VICTIM;
+    set[way].valid = true;
+    set[way].block = block;
+    set[way].stamp = llc->clock++;
+    return false;
+}
@@ -6,206 +6,302 @@
  * Date:    11/11/2024
  *
  * Description:
- * The main entry point of the simulation. Orchestrates the cycle-by-cycle
- * execution of Cores, Bus, and Memory. Manages the main simulation loop,
- * arbitration logic, and trace generation.
+ * The main entry point of the simulation. Parses the command line, runs one
+ * instance of the simulation library (sim.c) to completion and writes the
+ * final output files.
+ *
+ * Options of the form --key=value override simulator parameters (see
+ * sim_config_set) and may appear anywhere; the remaining arguments are the
+ * 6N + 3 file paths of N cores (or none, for the default file names).
+ *
+ * Checkpoints: --restore=FILE resumes a saved run, and --checkpoint=FILE
+ * saves the state at cycle --checkpoint_at=N and/or whenever the process
+ * receives SIGUSR1.
  */
 
+#include <signal.h>
 #include <stdio.h>
-#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
-#include "global.h"
-#include "core.h"
-#include "bus.h"
-#include "memory.h"
+#include "sim.h"
 #include "io_handler.h"
+#include "checkpoint.h"
 
-void gather_bus_requests(Core cores[], MainMemory *mem, bool requests[5]) {
-    for (int i = 0; i < 5; i++) requests[i] = false;
-
-    /*
-     * 1. MEMORY PRIORITY
-     * If Memory is currently processing a read (latency countdown active),
-     * it effectively holds a request to send data back when ready.
-     * (Though arbitration usually handles this via the 'busy' flag or specific grant).
-     */
-    if (mem->processing_read) {
-        requests[4] = true;
-        return; 
-    }
-
-    /*
-     * 2. CORE REQUESTS
-     * Check each core to see if it needs the bus.
-     * A core needs the bus if:
-     * - It is stalled at the Memory stage.
-     * - It has a valid instruction (Load/Store).
-     * - It has a pending address (miss detected).
-     * - It is NOT already waiting for a fill (request already sent).
-     */
-    for (int i = 0; i < NUM_CORES; i++) {
-        bool needs_bus = cores[i].stall &&
-                         cores[i].ex_mem.valid &&
-                         cores[i].l1_cache.pending_addr != 0xFFFFFFFF && 
-                         !cores[i].l1_cache.is_waiting_for_fill;
-
-        // <--- ADD THIS BLOCK --->
-        // Also request bus if we need to evict dirty data
-        if (cores[i].l1_cache.eviction_pending) {
-            needs_bus = true;
-        }
-        // <----------------------->
+// Cycles simulated between two checks for a checkpoint signal
+#define CHECKPOINT_POLL_CYCLES 10000
+
+/*
+ * RunOptions Structure
+ * Driver options that are not simulator parameters.
+ */
+typedef struct {
+    const char *checkpoint_path; // Where to save checkpoints (NULL = never)
+    int checkpoint_at;           // Cycle to checkpoint at (-1 = none)
+    const char *restore_path;    // Checkpoint to resume from (NULL = none)
+} RunOptions;
+
+static volatile sig_atomic_t checkpoint_requested = 0;
 
-        if (needs_bus) {
-            requests[i] = true;
+static void on_checkpoint_signal(int sig) {
+    (void)sig;
+    checkpoint_requested = 1;
+}
+
+/*
+ * extract_options
+ * Applies every --key=value argument to the configuration (or to the driver
+ * options) and compacts the others in place. Returns the new argc, or -1 on
+ * an invalid option.
+ */
+static int extract_options(int argc, char *argv[], SimConfig *config, RunOptions *run) {
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            argv[kept++] = argv[i];
+            continue;
+        }
+        if (strncmp(argv[i], "--checkpoint=", 13) == 0 && argv[i][13]) {
+            run->checkpoint_path = argv[i] + 13;
+            continue;
+        }
+        if (strncmp(argv[i], "--restore=", 10) == 0 && argv[i][10]) {
+            run->restore_path = argv[i] + 10;
+            continue;
+        }
+        if (strncmp(argv[i], "--checkpoint_at=", 16) == 0) {
+            char *end;
+            long at = strtol(argv[i] + 16, &end, 10);
+            if (end != argv[i] + 16 && *end == '\0' && at >= 0 && at <= 0x7FFFFFFE) {
+                run->checkpoint_at = (int)at;
+                continue;
+            }
+        }
+        if (!sim_config_apply(config, argv[i] + 2)) {
+            printf("Error: Invalid option %s\n", argv[i]);
+            return -1;
         }
     }
+    return kept;
 }
 
+static double percent_error(int approx, int exact) {
+    return exact ? 100.0 * (approx - exact) / exact : 0.0;
+}
 
-void drive_bus_from_core(Core *core, Bus *bus) {
-    if (bus->current_grant != core->id) return;
-
-    // 1. Handle Eviction Grant
-    if (core->l1_cache.eviction_pending) {
-        // Transition from "Pending" to "Active Flushing"
-        core->l1_cache.is_flushing = true;
-        core->l1_cache.eviction_pending = false;
-        core->l1_cache.flush_offset = 0;
-
-        // We don't drive the bus data here directly.
-        // Setting 'is_flushing' will cause cache_snoop (in the next phase)
-        // to drive the bus with BUS_CMD_FLUSH.
+/*
+ * report_timing_error
+ * Re-runs the same inputs on the exact lockstep engine (no traces, no output
+ * files) and prints how far the bound-weave cycle counts are from it.
+ */
+static void report_timing_error(Sim *approx, SimFiles *files) {
+    SimConfig config = approx->config;
+    config.quantum = 0;
+
+    SimFiles inputs;
+    Sim *exact = sim_create(&config);
+    if (!exact || !sim_files_alloc(&inputs, files->num_cores)) {
+        printf("Error: Could not allocate the reference simulator\n");
+        sim_destroy(exact);
         return;
     }
-
-    EX_MEM_Latch *latch = &core->ex_mem;
-    if (!latch->valid) return;
-
-    bus->bus_origid = core->id;
-    bus->bus_addr = latch->ALUOutput; 
-
-    if (latch->Op == OP_LW) {
-        bus->bus_cmd = BUS_CMD_READ;
-    } else if (latch->Op == OP_SW) {
-        bus->bus_cmd = BUS_CMD_READX;
+    for (int i = 0; i < files->num_cores; i++) inputs.imem_paths[i] = strdup(files->imem_paths[i]);
+    inputs.memin_path = strdup(files->memin_path);
+    sim_load(exact, &inputs);
+    sim_files_free(&inputs);
+    sim_run(exact);
+
+    printf("Bound-weave timing error (quantum %d) against the lockstep engine:\n", approx->config.quantum);
+    printf("%-6s %12s %12s %9s\n", "core", "exact", "approx", "error");
+    for (int i = 0; i < exact->num_cores; i++) {
+        int e = exact->cores[i].stats.cycles;
+        int a = approx->cores[i].stats.cycles;
+        printf("%-6d %12d %12d %+8.2f%%\n", i, e, a, percent_error(a, e));
     }
-
-    /*
-     * MARK AS WAITING
-     * Once the request is on the bus, the core enters "Waiting for Fill" state.
-     * It will stop requesting the bus and start listening for data.
-     */
-    core->l1_cache.is_waiting_for_fill = true;
+    printf("%-6s %12d %12d %+8.2f%%\n", "total", exact->cycle, approx->cycle,
+           percent_error(approx->cycle, exact->cycle));
+    sim_destroy(exact);
 }
 
-int main(int argc, char *argv[]) {
-    
-    // 1. SETUP
-    SimFiles files;
-    if (!parse_arguments(argc, argv, &files)) return 1;
-
-    Bus bus;
-    bus_init(&bus);
-
-    static MainMemory main_memory;
-    memory_init(&main_memory);
-    load_memin_file(&main_memory, &files);
-
-    Core cores[NUM_CORES];
-    for (int i = 0; i < NUM_CORES; i++) {
-        core_init(&cores[i], i, files.imem_paths[i]);
+/*
+ * report_sampling
+ * Prints the extrapolated length of a sampled run: the estimate of the core
+ * that finishes last, with its 95% confidence interval.
+ */
+static void report_sampling(Sim *sim) {
+    long long cycles = -1;
+    long long half_width = -1;
+    for (int i = 0; i < sim->num_cores; i++) {
+        long long hw;
+        long long c = sample_estimate_cycles(&sim->sampling, &sim->cores[i], &hw);
+        if (c > cycles) {
+            cycles = c;
+            half_width = hw;
+        }
     }
 
-    FILE *trace_files[NUM_CORES];
-    FILE *bus_trace_file = fopen(files.bustrace_path, "w");
-    for (int i = 0; i < NUM_CORES; i++) {
-        trace_files[i] = fopen(files.coretrace_paths[i], "w");
+    printf("Sampled %d windows of %d cycles every %d instructions per core.\n", sim->sampling.windows,
+           sim->config.sample_window, sim->config.sample_interval);
+    if (cycles < 0) {
+        printf("Estimated run length: n/a (no window measured a running core)\n");
+    } else if (half_width < 0) {
+        printf("Estimated run length: %lld cycles\n", cycles);
+    } else {
+        printf("Estimated run length: %lld cycles (95%% CI +/- %lld)\n", cycles, half_width);
     }
+}
 
-    int cycle = 0;
-    bool active = true;
+/*
+ * save_checkpoint
+ * Writes a checkpoint of the current cycle and reports it.
+ */
+static bool save_checkpoint(Sim *sim, const char *path) {
+    if (!sim_checkpoint_save(sim, path)) {
+        printf("Error: Could not write checkpoint %s\n", path);
+        return false;
+    }
+    printf("Checkpoint of cycle %d written to %s\n", sim->cycle, path);
+    return true;
+}
 
-    // 2. MAIN LOOP
-    while (active) {
-        
-        // A. Reset Bus Signals (Start of Cycle)
-        bus_reset_signals(&bus);
-
-        // B. Arbitration Phase
-        bool requests[5];
-        gather_bus_requests(cores, &main_memory, requests);
-        bus_arbitrate(&bus, requests);
-
-        // C. Bus Driving Phase
-        // Check if any core is "hijacking" the bus for a Flush (highest priority)
-        bool any_hijack = false;
-        for (int i=0; i<NUM_CORES; i++) {
-             if (cores[i].l1_cache.is_flushing) any_hijack = true;
+/*
+ * run_with_checkpoints
+ * Runs to completion, stopping at the requested cycle and, while a signal
+ * handler is installed, every CHECKPOINT_POLL_CYCLES cycles to serve
+ * SIGUSR1. Stepping does not change the simulated behavior.
+ */
+static bool run_with_checkpoints(Sim *sim, const RunOptions *run) {
+    if (run->checkpoint_at >= 0 && sim->cycle <= run->checkpoint_at) {
+        sim_run_until(sim, run->checkpoint_at);
+        if (sim->cycle < run->checkpoint_at) {
+            printf("The run ended in cycle %d, before the checkpoint cycle %d\n", sim->cycle, run->checkpoint_at);
+        } else if (!save_checkpoint(sim, run->checkpoint_path)) {
+            return false;
         }
-
-        // If no flush is happening, let the granted core drive the bus
-        if (!any_hijack && bus.current_grant < 4 && bus.current_grant >= 0) {
-            drive_bus_from_core(&cores[bus.current_grant], &bus);
-            bus.busy = false; 
+    }
+    while (!sim->done) {
+        sim_step(sim, CHECKPOINT_POLL_CYCLES);
+        if (checkpoint_requested) {
+            checkpoint_requested = 0;
+            if (!save_checkpoint(sim, run->checkpoint_path)) return false;
         }
+    }
+    return true;
+}
 
-        // D. Snooping / Memory Response Phase
-        // Order matters: If Memory is driving, Cores snoop. If Core is driving, Memory listens.
-        if (bus.current_grant == 4) {
-            memory_listen(&main_memory, &bus);
-            for (int i = 0; i < NUM_CORES; i++) cache_snoop(&cores[i].l1_cache, &bus);
-        } else {
-            for (int i = 0; i < NUM_CORES; i++) cache_snoop(&cores[i].l1_cache, &bus);
-            memory_listen(&main_memory, &bus);
-        }
+int main(int argc, char *argv[]) {
 
-        // E. Shared Signal Propagation
-        if (bus.bus_shared) {
-            if (bus.bus_origid < 4) {
-                cores[bus.bus_origid].l1_cache.snoop_result_shared = true;
-            }
-            // Special case: If data is being flushed, the waiting core also needs to know it's shared
-            if (bus.bus_cmd == BUS_CMD_FLUSH) {
-                for (int i = 0; i < NUM_CORES; i++) {
-                    if (cores[i].l1_cache.is_waiting_for_fill &&
-                       (cores[i].l1_cache.pending_addr & ~0x7) == (bus.bus_addr & ~0x7)) {
-                        cores[i].l1_cache.snoop_result_shared = true;
-                       }
-                }
-            }
-        }
+    // 1. SETUP
+    SimConfig config;
+    sim_config_default(&config);
+    RunOptions run = {NULL, -1, NULL};
+    argc = extract_options(argc, argv, &config, &run);
+    if (argc < 0) return 1;
+    if ((run.checkpoint_path || run.restore_path) && config.quantum > 0) {
+        printf("Error: Checkpoints require the lockstep engine (quantum=0)\n");
+        return 1;
+    }
+    if ((config.mshrs > 0 || config.store_buffer > 0 || config.victim_entries > 0) && config.quantum > 0) {
+        printf("Error: MSHRs, store buffers and victim caches require the lockstep engine (quantum=0)\n");
+        return 1;
+    }
+    if (config.mshrs > 0 && config.store_buffer > 0) {
+        printf("Error: The store buffer requires the blocking L1 (mshrs=0)\n");
+        return 1;
+    }
+    if (config.mshrs > 0 && config.victim_entries > 0) {
+        printf("Error: The victim cache requires the blocking L1 (mshrs=0)\n");
+        return 1;
+    }
+    if (config.l1_sets * config.l1_ways > L1_MAX_LINES ||
+        config.l1_sets * config.l1_ways * config.l1_block > L1_MAX_WORDS) {
+        printf("Error: The L1 holds at most %d lines and %d words\n", L1_MAX_LINES, L1_MAX_WORDS);
+        return 1;
+    }
+    if (config.l2_sets > 0 && config.quantum > 0) {
+        printf("Error: The shared LLC requires the lockstep engine (quantum=0)\n");
+        return 1;
+    }
+    if (config.l2_sets * config.l2_ways > LLC_MAX_LINES) {
+        printf("Error: The LLC holds at most %d lines\n", LLC_MAX_LINES);
+        return 1;
+    }
+    if (config.coherence != COHERENCE_MESI && config.quantum > 0) {
+        printf("Error: Coherence protocols other than MESI require the lockstep engine (quantum=0)\n");
+        return 1;
+    }
+    if (config.bus_upgrade && config.quantum > 0) {
+        printf("Error: BusUpgr transactions require the lockstep engine (quantum=0)\n");
+        return 1;
+    }
+    if (config.critical_word_first && config.quantum > 0) {
+        printf("Error: Critical-word-first fills require the lockstep engine (quantum=0)\n");
+        return 1;
+    }
+    if (config.split_bus && config.quantum > 0) {
+        printf("Error: The split-transaction bus requires the lockstep engine (quantum=0)\n");
+        return 1;
+    }
+    if (config.arbitration != ARBITRATE_ROUND_ROBIN && config.quantum > 0) {
+        printf("Error: Arbitration policies other than rr require the lockstep engine (quantum=0)\n");
+        return 1;
+    }
+    if (config.data_bus && !config.split_bus) {
+        printf("Error: A separate data bus requires the split-transaction bus (split_bus)\n");
+        return 1;
+    }
+    if (config.coherence == COHERENCE_DRAGON && config.mshrs > 0) {
+        printf("Error: The write-update protocol requires the blocking L1 (mshrs=0)\n");
+        return 1;
+    }
+    if ((run.checkpoint_path || run.restore_path) && config.sample_interval > 0) {
+        printf("Error: Checkpoints are not supported in sampled runs (sample_interval)\n");
+        return 1;
+    }
+    if (run.checkpoint_at >= 0 && !run.checkpoint_path) {
+        printf("Error: --checkpoint_at requires --checkpoint=FILE\n");
+        return 1;
+    }
 
-        // F. Trace Generation
-        if (bus_trace_file) {
-            write_bus_trace(bus_trace_file, &bus, cycle);
-        }
+    SimFiles files;
+    if (!parse_arguments(argc, argv, &files, config.cores)) return 1;
+    config.cores = files.num_cores;
+
+    Sim *sim = sim_create(&config);
+    if (!sim) {
+        printf("Error: Could not allocate the simulator\n");
+        sim_files_free(&files);
+        return 1;
+    }
+    sim_load(sim, &files);
+    if (run.restore_path && !sim_checkpoint_restore(sim, run.restore_path)) {
+        printf("Error: Could not restore checkpoint %s\n", run.restore_path);
+        sim_destroy(sim);
+        sim_files_free(&files);
+        return 1;
+    }
 
-        // G. Core Execution Phase
-        bool all_halted = true;
-        for (int i = 0; i < NUM_CORES; i++) {
-            if (cores[i].halted) continue;
-            write_core_trace(trace_files[i], &cores[i], cycle);
-            core_cycle(&cores[i], &bus); 
-            if (!cores[i].halted) all_halted = false;
+    // 2. MAIN LOOP
+    if (run.checkpoint_path) {
+        signal(SIGUSR1, on_checkpoint_signal);
+        if (!run_with_checkpoints(sim, &run)) {
+            sim_destroy(sim);
+            sim_files_free(&files);
+            return 1;
         }
-
-        // H. End of Cycle Checks
-        if (all_halted) active = false;
-        cycle++;
-        if (cycle > 500000) break;
+    } else {
+        sim_run(sim);
     }
 
     // 3. FINAL OUTPUT
-    write_regout_files(cores, &files);
-    write_dsram_files(cores, &files);
-    write_tsram_files(cores, &files);
-    write_stats_files(cores, &files);
-    write_memout_file(&main_memory, &files);
+    sim_write_outputs(sim, &files);
 
-    for (int i = 0; i < NUM_CORES; i++) if (trace_files[i]) fclose(trace_files[i]);
-    if (bus_trace_file) fclose(bus_trace_file);
-
-    printf("Simulation completed successfully in %d cycles.\n", cycle);
+    if (config.fast_forward > 0) {
+        printf("Fast-forwarded %lld instructions in functional mode.\n", sim->fast_forwarded);
+    }
+    printf("Simulation completed successfully in %d cycles.\n", sim->cycle);
+    if (config.sample_interval > 0) report_sampling(sim);
+    if (config.quantum > 0 && config.quantum_check) report_timing_error(sim, &files);
+    sim_destroy(sim);
+    sim_files_free(&files);
     return 0;
 }
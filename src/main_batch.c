@@ -0,0 +1,471 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    main_batch.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * Entry point of sim-batch, the design-space sweep runner. It reads a
+ * manifest of runs, executes them concurrently on a pool of worker threads
+ * (one simulator instance per run, traces disabled) and collects the
+ * statistics of every run into a single CSV or JSON table.
+ *
+ * Usage: sim-batch [--jobs=N] [--format=csv|json] [--out=FILE] manifest
+ *
+ * Manifest format, one run per line ('#' starts a comment):
+ *     <name> <workload_dir> [key=value ...]
+ * The workload directory holds imem0..3.txt and memin.txt. A value may be a
+ * comma-separated list, in which case the line expands to the cartesian
+ * product of all its lists, e.g.
+ *     counter  counter/  mem_latency=8,16,32
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim.h"
+#include "io_handler.h"
+
+#define MAX_LINE 1024
+#define MAX_PARAMS 16
+
+/*
+ * BatchRun Structure
+ * One expanded point of the manifest and, once executed, its results.
+ */
+typedef struct {
+    char name[128];
+    char workload[256];
+    char params[MAX_LINE]; // Space-separated key=value overrides (fits any manifest line)
+    SimConfig config;      // config.cores is always resolved
+
+    // --- Results (config.cores entries) ---
+    bool ok;
+    int sim_cycles;
+    int *num_stats;
+    StatEntry (*stats)[MAX_CORE_STATS];
+} BatchRun;
+
+/*
+ * Batch Structure
+ * The list of runs and the shared work index of the worker pool.
+ */
+typedef struct {
+    BatchRun *runs;
+    int num_runs;
+    int capacity;
+
+    pthread_mutex_t lock;
+    int next_run; // Index of the next run to hand out
+    int finished;
+} Batch;
+
+static bool add_run(Batch *batch, const BatchRun *run) {
+    if (batch->num_runs == batch->capacity) {
+        int capacity = batch->capacity ? batch->capacity * 2 : 16;
+        BatchRun *runs = realloc(batch->runs, sizeof(BatchRun) * capacity);
+        if (!runs) return false;
+        batch->runs = runs;
+        batch->capacity = capacity;
+    }
+    batch->runs[batch->num_runs++] = *run;
+    return true;
+}
+
+static bool file_readable(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return false;
+    fclose(fp);
+    return true;
+}
+
+/*
+ * workload_present
+ * Checks the input files of a workload directory and returns its core count
+ * (one per consecutive imemN.txt), or 0 if it is incomplete.
+ */
+static int workload_present(const char *dir, int line_no) {
+    char path[512];
+    int num_cores = discover_num_cores(dir);
+    if (num_cores == 0) {
+        fprintf(stderr, "Error: line %d: missing %s/imem0.txt\n", line_no, dir);
+        return 0;
+    }
+    snprintf(path, sizeof(path), "%s/memin.txt", dir);
+    if (!file_readable(path)) {
+        fprintf(stderr, "Error: line %d: missing %s\n", line_no, path);
+        return 0;
+    }
+    return num_cores;
+}
+
+/*
+ * expand_line
+ * Adds one run per point of the cartesian product of the value lists of a
+ * manifest line. 'keys[i]' has 'counts[i]' candidate values in 'values[i]'.
+ * Runs without a 'cores' value use every core the workload provides.
+ */
+static bool expand_line(Batch *batch, const char *name, const char *workload, int workload_cores,
+                        char *keys[], char *values[][MAX_PARAMS], int counts[], int num_keys,
+                        int line_no) {
+    int choice[MAX_PARAMS] = {0};
+
+    while (true) {
+        /*
+         * 1. BUILD THE POINT
+         * Apply the currently selected value of every key.
+         */
+        BatchRun run;
+        memset(&run, 0, sizeof(run));
+        snprintf(run.name, sizeof(run.name), "%s", name);
+        snprintf(run.workload, sizeof(run.workload), "%s", workload);
+        sim_config_default(&run.config);
+
+        size_t len = 0;
+        for (int k = 0; k < num_keys; k++) {
+            const char *value = values[k][choice[k]];
+            if (!sim_config_set(&run.config, keys[k], value)) {
+                fprintf(stderr, "Error: line %d: invalid parameter %s=%s\n", line_no, keys[k], value);
+                return false;
+            }
+            len += snprintf(run.params + len, sizeof(run.params) - len, "%s%s=%s", k ? " " : "", keys[k], value);
+        }
+        if (run.config.cores == 0) run.config.cores = workload_cores;
+        if (run.config.cores > workload_cores) {
+            fprintf(stderr, "Error: line %d: %s provides only %d cores\n", line_no, workload, workload_cores);
+            return false;
+        }
+        if (!add_run(batch, &run)) return false;
+
+        /*
+         * 2. NEXT POINT
+         * Advance the choices like an odometer, last key fastest.
+         */
+        int k = num_keys - 1;
+        while (k >= 0 && ++choice[k] == counts[k]) {
+            choice[k] = 0;
+            k--;
+        }
+        if (k < 0) return true;
+    }
+}
+
+static bool load_manifest(Batch *batch, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open manifest %s\n", path);
+        return false;
+    }
+
+    char line[MAX_LINE];
+    int line_no = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), fp)) {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char *save;
+        char *name = strtok_r(line, " \t\r\n", &save);
+        if (!name) continue;
+        char *workload = strtok_r(NULL, " \t\r\n", &save);
+        if (!workload) {
+            fprintf(stderr, "Error: line %d: missing workload directory\n", line_no);
+            ok = false;
+            break;
+        }
+        int workload_cores = workload_present(workload, line_no);
+        if (workload_cores == 0) {
+            ok = false;
+            break;
+        }
+
+        char *keys[MAX_PARAMS];
+        char *values[MAX_PARAMS][MAX_PARAMS];
+        int counts[MAX_PARAMS];
+        int num_keys = 0;
+        char *token;
+        while (ok && (token = strtok_r(NULL, " \t\r\n", &save))) {
+            char *eq = strchr(token, '=');
+            if (!eq || eq == token || num_keys == MAX_PARAMS) {
+                fprintf(stderr, "Error: line %d: bad parameter '%s'\n", line_no, token);
+                ok = false;
+                break;
+            }
+            *eq = '\0';
+            keys[num_keys] = token;
+            counts[num_keys] = 0;
+
+            char *vsave;
+            for (char *v = strtok_r(eq + 1, ",", &vsave); v; v = strtok_r(NULL, ",", &vsave)) {
+                if (counts[num_keys] == MAX_PARAMS) break;
+                values[num_keys][counts[num_keys]++] = v;
+            }
+            if (counts[num_keys] == 0) {
+                fprintf(stderr, "Error: line %d: no value for '%s'\n", line_no, token);
+                ok = false;
+                break;
+            }
+            num_keys++;
+        }
+        if (ok) ok = expand_line(batch, name, workload, workload_cores, keys, values, counts, num_keys, line_no);
+    }
+    fclose(fp);
+    return ok;
+}
+
+/*
+ * execute_run
+ * Simulates one run to completion without any trace output and keeps its
+ * statistics.
+ */
+static void execute_run(BatchRun *run) {
+    int num_cores = run->config.cores;
+    SimFiles files;
+    if (!sim_files_default(&files, run->workload, num_cores, false)) return;
+
+    Sim *sim = sim_create(&run->config);
+    run->num_stats = calloc(num_cores, sizeof(int));
+    run->stats = calloc(num_cores, sizeof(*run->stats));
+    if (!sim || !run->num_stats || !run->stats) {
+        sim_destroy(sim);
+        sim_files_free(&files);
+        return;
+    }
+    sim_load(sim, &files);
+    sim_files_free(&files);
+    sim_run(sim);
+
+    run->sim_cycles = sim->cycle;
+    for (int i = 0; i < num_cores; i++) {
+        run->num_stats[i] = collect_core_stats(&sim->cores[i], run->stats[i]);
+    }
+    run->ok = true;
+    sim_destroy(sim);
+}
+
+static void *worker_main(void *arg) {
+    Batch *batch = arg;
+    while (true) {
+        pthread_mutex_lock(&batch->lock);
+        int index = batch->next_run++;
+        pthread_mutex_unlock(&batch->lock);
+        if (index >= batch->num_runs) break;
+
+        BatchRun *run = &batch->runs[index];
+        execute_run(run);
+
+        pthread_mutex_lock(&batch->lock);
+        batch->finished++;
+        fprintf(stderr, "[%d/%d] %s %s%s\n", batch->finished, batch->num_runs,
+                run->name, run->params, run->ok ? "" : " FAILED");
+        pthread_mutex_unlock(&batch->lock);
+    }
+    return NULL;
+}
+
+/*
+ * put_csv_field / put_json_string
+ * Emit a text value with the quoting each format requires.
+ */
+static void put_csv_field(FILE *fp, const char *text) {
+    if (!strpbrk(text, ",\"\n ")) {
+        fputs(text, fp);
+        return;
+    }
+    fputc('"', fp);
+    for (const char *p = text; *p; p++) {
+        if (*p == '"') fputc('"', fp);
+        fputc(*p, fp);
+    }
+    fputc('"', fp);
+}
+
+static void put_json_string(FILE *fp, const char *text) {
+    fputc('"', fp);
+    for (const char *p = text; *p; p++) {
+        if (*p == '"' || *p == '\\') fputc('\\', fp);
+        fputc(*p, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * stat_column
+ * Column of the stats name 'name' in 'columns', appending it if it is new.
+ */
+static int stat_column(const char *columns[], int *num_columns, const char *name) {
+    for (int i = 0; i < *num_columns; i++) {
+        if (strcmp(columns[i], name) == 0) return i;
+    }
+    columns[*num_columns] = name;
+    return (*num_columns)++;
+}
+
+static void write_csv(FILE *fp, const Batch *batch) {
+    /*
+     * 1. HEADER
+     * Fixed columns, then the stats names as in the stats files. Optional
+     * counters (e.g. of a branch predictor) only exist in some runs: every
+     * name seen gets a column, in order of first appearance.
+     */
+    const char *columns[MAX_CORE_STATS * 4];
+    int num_columns = 0;
+    for (int r = 0; r < batch->num_runs; r++) {
+        const BatchRun *run = &batch->runs[r];
+        if (!run->ok) continue;
+        for (int s = 0; s < run->num_stats[0] && num_columns < MAX_CORE_STATS * 4; s++) {
+            stat_column(columns, &num_columns, run->stats[0][s].name);
+        }
+    }
+    fprintf(fp, "run,workload,params,sim_cycles,core");
+    for (int i = 0; i < num_columns; i++) fprintf(fp, ",%s", columns[i]);
+    fputc('\n', fp);
+
+    /*
+     * 2. ROWS
+     * A counter the run does not have leaves its field empty.
+     */
+
+    for (int r = 0; r < batch->num_runs; r++) {
+        const BatchRun *run = &batch->runs[r];
+        if (!run->ok) continue;
+        for (int c = 0; c < run->config.cores; c++) {
+            put_csv_field(fp, run->name);
+            fputc(',', fp);
+            put_csv_field(fp, run->workload);
+            fputc(',', fp);
+            put_csv_field(fp, run->params);
+            fprintf(fp, ",%d,%d", run->sim_cycles, c);
+            for (int i = 0; i < num_columns; i++) {
+                fputc(',', fp);
+                for (int s = 0; s < run->num_stats[c]; s++) {
+                    if (strcmp(run->stats[c][s].name, columns[i]) != 0) continue;
+                    fprintf(fp, "%d", run->stats[c][s].value);
+                    break;
+                }
+            }
+            fputc('\n', fp);
+        }
+    }
+}
+
+static void write_json(FILE *fp, const Batch *batch) {
+    fprintf(fp, "[\n");
+    bool first_run = true;
+    for (int r = 0; r < batch->num_runs; r++) {
+        const BatchRun *run = &batch->runs[r];
+        if (!run->ok) continue;
+
+        fprintf(fp, "%s  {\"run\": ", first_run ? "" : ",\n");
+        put_json_string(fp, run->name);
+        fprintf(fp, ", \"workload\": ");
+        put_json_string(fp, run->workload);
+        fprintf(fp, ", \"params\": ");
+        put_json_string(fp, run->params);
+        fprintf(fp, ", \"sim_cycles\": %d,\n   \"cores\": [", run->sim_cycles);
+        for (int c = 0; c < run->config.cores; c++) {
+            fprintf(fp, "%s\n    {\"core\": %d", c ? "," : "", c);
+            for (int s = 0; s < run->num_stats[c]; s++) {
+                fprintf(fp, ", \"%s\": %d", run->stats[c][s].name, run->stats[c][s].value);
+            }
+            fputc('}', fp);
+        }
+        fprintf(fp, "]}");
+        first_run = false;
+    }
+    fprintf(fp, "\n]\n");
+}
+
+static void free_runs(Batch *batch) {
+    for (int r = 0; r < batch->num_runs; r++) {
+        free(batch->runs[r].num_stats);
+        free(batch->runs[r].stats);
+    }
+    free(batch->runs);
+}
+
+static void print_usage(void) {
+    fprintf(stderr, "Usage: sim-batch [--jobs=N] [--format=csv|json] [--out=FILE] manifest\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    // 1. COMMAND LINE
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int jobs = cpus > 0 ? (int)cpus : 1;
+    bool json = false;
+    const char *out_path = NULL;
+    const char *manifest = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            jobs = atoi(argv[i] + 7);
+            if (jobs < 1) {
+                print_usage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--format=csv") == 0) {
+            json = false;
+        } else if (strcmp(argv[i], "--format=json") == 0) {
+            json = true;
+        } else if (strncmp(argv[i], "--out=", 6) == 0) {
+            out_path = argv[i] + 6;
+        } else if (argv[i][0] != '-' && !manifest) {
+            manifest = argv[i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (!manifest) {
+        print_usage();
+        return 1;
+    }
+
+    // 2. MANIFEST
+    Batch batch;
+    memset(&batch, 0, sizeof(batch));
+    if (!load_manifest(&batch, manifest)) {
+        free(batch.runs);
+        return 1;
+    }
+
+    // 3. WORKER POOL
+    pthread_mutex_init(&batch.lock, NULL);
+    if (jobs > batch.num_runs) jobs = batch.num_runs > 0 ? batch.num_runs : 1;
+    pthread_t *workers = malloc(sizeof(pthread_t) * jobs);
+    int started = 0;
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&workers[i], NULL, worker_main, &batch) != 0) break;
+        started++;
+    }
+    if (started == 0) worker_main(&batch);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    pthread_mutex_destroy(&batch.lock);
+
+    // 4. RESULTS TABLE (manifest order, independent of completion order)
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Error: Could not open %s\n", out_path);
+        free_runs(&batch);
+        return 1;
+    }
+    if (json) {
+        write_json(out, &batch);
+    } else {
+        write_csv(out, &batch);
+    }
+    if (out != stdout) fclose(out);
+
+    int failed = 0;
+    for (int r = 0; r < batch.num_runs; r++) {
+        if (!batch.runs[r].ok) failed++;
+    }
+    free_runs(&batch);
+    return failed ? 1 : 0;
+}
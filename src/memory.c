@@ -12,70 +12,220 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "memory.h"
 
 #define MEM_MASK (MAIN_MEMORY_SIZE - 1)
 
 void memory_init(MainMemory *mem) {
     memset(mem->data, 0, sizeof(uint32_t) * MAIN_MEMORY_SIZE);
+    mem->processing_read = false;
+    mem->serving_shared_request = false;
+    mem->read_latency = MEM_READ_LATENCY;
+    mem->block_words = DEFAULT_BLOCK_WORDS;
+    mem->critical_word_first = false;
+    mem->latency_timer = 0;
+    mem->target_addr = 0;
+    mem->word_offset = 0;
+    mem->max_requests = 0;
+    mem->num_requests = 0;
+    mem->requester = -1;
+    llc_configure(&mem->llc, 0, 1, DEFAULT_BLOCK_WORDS, 0, false);
+    mem->back_invalidate_addr = LLC_NO_VICTIM;
+}
+
+MainMemory *memory_create(void) {
+    MainMemory *mem = calloc(1, sizeof(MainMemory));
+    if (mem) {
+        mem->read_latency = MEM_READ_LATENCY;
+        mem->block_words = DEFAULT_BLOCK_WORDS;
+        mem->back_invalidate_addr = LLC_NO_VICTIM;
+    }
+    return mem;
+}
+
+void memory_destroy(MainMemory *mem) {
+    free(mem);
 }
 
 bool memory_is_active(MainMemory *mem) {
-    return mem->processing_read;
+    return mem->processing_read || mem->num_requests > 0;
 }
 
-void memory_listen(MainMemory *mem, Bus *bus) {
-    static int latency_timer = 0;
-    static uint32_t target_addr = 0;
-    static int word_offset = 0;
+/*
+ * find_request
+ * Index of the queued read of the block holding 'addr', or -1.
+ */
+static int find_request(const MainMemory *mem, uint32_t addr) {
+    uint32_t block_mask = ~(uint32_t)(mem->block_words - 1);
+    for (int r = 0; r < mem->num_requests; r++) {
+        if ((mem->request[r].addr & block_mask) == (addr & block_mask)) return r;
+    }
+    return -1;
+}
+
+/*
+ * remove_request
+ * Drops queued read 'r', keeping the others in order.
+ */
+static void remove_request(MainMemory *mem, int r) {
+    mem->num_requests--;
+    memmove(&mem->request[r], &mem->request[r + 1], (size_t)(mem->num_requests - r) * sizeof(MemRequest));
+}
+
+/*
+ * ready_request
+ * Index of the oldest queued read whose latency has elapsed, or -1.
+ */
+static int ready_request(const MainMemory *mem) {
+    for (int r = 0; r < mem->num_requests; r++) {
+        if (mem->request[r].latency_timer < 0) return r;
+    }
+    return -1;
+}
+
+bool memory_wants_bus(const MainMemory *mem) {
+    return mem->processing_read || ready_request(mem) >= 0;
+}
+
+bool memory_accepts_request(const MainMemory *mem, uint32_t addr) {
+    if (mem->max_requests == 0) return true;
+    uint32_t block_mask = ~(uint32_t)(mem->block_words - 1);
+    if (mem->processing_read && (mem->target_addr & block_mask) == (addr & block_mask)) return false;
+    return mem->num_requests < mem->max_requests && find_request(mem, addr) < 0;
+}
+
+/*
+ * request_latency
+ * Latency of a bus read of 'addr'. With a shared last-level cache, a hit is
+ * served after the LLC hit latency, and a miss pays the LLC lookup and then
+ * the DRAM latency and allocates the block. Flushes write through to DRAM,
+ * so the LLC never holds dirty data.
+ */
+static int request_latency(MainMemory *mem, uint32_t addr) {
+    Llc *llc = &mem->llc;
+    if (llc->sets == 0) return mem->read_latency;
+
+    uint32_t victim;
+    if (llc_lookup(llc, addr, &victim)) {
+        llc->hits++;
+        return llc->hit_latency;
+    }
+    llc->misses++;
+    if (victim != LLC_NO_VICTIM) {
+        llc->evictions++;
+        if (llc->inclusive) mem->back_invalidate_addr = victim;
+    }
+    return llc->hit_latency + mem->read_latency;
+}
 
+void memory_listen(MainMemory *mem, Bus *bus) {
     /*
      * 1. WRITE HANDLING (FLUSH)
      * If a core is flushing data (Modified -> Memory), we write it immediately.
      * "Main memory updates in parallel" [cite: 59].
+     * A cache-to-cache supply is left to the requester.
      */
-    if (bus->bus_cmd == BUS_CMD_FLUSH && bus->bus_origid < 4) {
-        if (bus->bus_addr < MAIN_MEMORY_SIZE) {
+    if (bus->bus_cmd == BUS_CMD_FLUSH && bus->bus_origid < bus->num_cores) {
+        if (bus->bus_addr < MAIN_MEMORY_SIZE && bus->bus_supply == SUPPLY_NONE) {
             mem->data[bus->bus_addr] = bus->bus_data;
         }
 
         // If we were preparing to read this same address, abort the read.
         // The core's flush satisfies the system's need for this data (or overrides it).
-        if (mem->processing_read && (bus->bus_addr & ~0x7) == (target_addr & ~0x7)) {
+        uint32_t block_mask = ~(uint32_t)(mem->block_words - 1);
+        if (mem->processing_read && (bus->bus_addr & block_mask) == (mem->target_addr & block_mask)) {
+            if (bus->bus_supply == SUPPLY_SAVES_READ) bus->stats.memory_cycles_avoided += mem->latency_timer + 1;
             mem->processing_read = false;
-            latency_timer = 0;
+            mem->latency_timer = 0;
+        }
+
+        // On a split-transaction bus, the read is still in the queue: a supply
+        // replaces it, a write-back only makes the block shared (its data
+        // phase then sends the written-back block)
+        int queued = find_request(mem, bus->bus_addr);
+        if (queued >= 0 && bus->bus_supply != SUPPLY_NONE) {
+            if (bus->bus_supply == SUPPLY_SAVES_READ) {
+                bus->stats.memory_cycles_avoided += mem->request[queued].latency_timer + 1;
+            }
+            remove_request(mem, queued);
+        } else if (queued >= 0 && bus->bus_shared) {
+            mem->request[queued].shared = true;
         }
     }
 
     /*
      * 2. READ REQUEST HANDLING
      * If we see a Read/ReadX and we aren't busy, start the latency timer.
+     * A BusUpgr (or a BusUpd) needs no data from memory and is ignored.
+     * On a split-transaction bus the request only takes its own bus cycle
+     * and the read is queued instead (the arbiter only grants a request the
+     * queue accepts).
      */
     if (bus->bus_cmd == BUS_CMD_READ || bus->bus_cmd == BUS_CMD_READX) {
-        if (!mem->processing_read) {
+        if (mem->max_requests > 0) {
+            MemRequest *req = &mem->request[mem->num_requests++];
+            req->addr = bus->bus_addr;
+            req->requester = bus->bus_origid;
+            req->shared = bus->bus_shared;
+            req->latency_timer = request_latency(mem, bus->bus_addr) - 1;
+            // A data phase in progress on a separate data bus keeps its block
+            if (!mem->processing_read) mem->target_addr = bus->bus_addr;
+        } else if (!mem->processing_read) {
             mem->processing_read = true;
-            target_addr = bus->bus_addr;
-            latency_timer = 15; // 16 cycles total (1 request + 15 wait)
-            word_offset = 0;
+            mem->target_addr = bus->bus_addr;
+            mem->latency_timer = request_latency(mem, bus->bus_addr) - 1; // Latency cycles total (1 request + the wait)
+            mem->word_offset = 0;
             mem->serving_shared_request = bus->bus_shared;
         }
     }
 
     /*
-     * 3. LATENCY & DATA SENDING
+     * 3. SPLIT TRANSACTIONS
+     * The queued reads count their latency down together while the bus
+     * carries other transactions (once per cycle: with a separate data bus,
+     * on the address channel). The memory then asks for the bus, and once it
+     * holds it (the data channel) the oldest ready read starts its data
+     * phase, tagged with the requester and sent below from this cycle.
+     */
+    if (mem->max_requests > 0 && bus->channel != BUS_CHANNEL_DATA) {
+        for (int r = 0; r < mem->num_requests; r++) {
+            if (mem->request[r].latency_timer >= 0) mem->request[r].latency_timer--;
+        }
+    }
+    if (mem->max_requests > 0 && bus->channel != BUS_CHANNEL_ADDRESS) {
+        int r = ready_request(mem);
+        if (!mem->processing_read && bus->current_grant == BUS_MEMORY_ID(bus) && r >= 0) {
+            mem->processing_read = true;
+            mem->target_addr = mem->request[r].addr;
+            mem->requester = mem->request[r].requester;
+            mem->serving_shared_request = mem->request[r].shared;
+            mem->latency_timer = -1;
+            mem->word_offset = 0;
+            remove_request(mem, r);
+        }
+    }
+
+    /*
+     * 4. LATENCY & DATA SENDING
      * After the timer expires, we need the bus to send data back.
-     * We send 8 words (one cache block) over 8 cycles.
+     * We send one cache block, a word per cycle: from its first word, or
+     * with critical-word-first from the requested one, wrapping around the
+     * block, so the word the core waits for comes first. A wider data bus
+     * calls this once per word of the cycle.
      */
-    if (mem->processing_read) {
-        if (latency_timer >= 0) {
-            latency_timer--;
+    if (mem->processing_read && bus->channel != BUS_CHANNEL_ADDRESS) {
+        if (mem->latency_timer >= 0) {
+            mem->latency_timer--;
         } else {
-            // We only send if we have been granted the bus (ID 4)
-            if (bus->current_grant == 4) {
-                uint32_t block_start = target_addr & ~0x7;
-                uint32_t current_addr = block_start + word_offset;
+            // We only send if we have been granted the bus (memory slot)
+            if (bus->current_grant == BUS_MEMORY_ID(bus)) {
+                uint32_t block_mask = (uint32_t)(mem->block_words - 1);
+                uint32_t block_start = mem->target_addr & ~block_mask;
+                uint32_t first = mem->critical_word_first ? mem->target_addr & block_mask : 0;
+                uint32_t current_addr = block_start + ((first + (uint32_t)mem->word_offset) & block_mask);
 
-                bus->bus_origid = 4;
+                bus->bus_origid = BUS_MEMORY_ID(bus);
                 bus->bus_cmd = BUS_CMD_FLUSH;
                 bus->bus_addr = current_addr;
                 bus->bus_data = mem->data[current_addr];
@@ -84,10 +234,11 @@ void memory_listen(MainMemory *mem, Bus *bus) {
                 if (mem->serving_shared_request) {
                     bus->bus_shared = true;
                 }
+                if (mem->max_requests > 0) bus->bus_requester = mem->requester;
 
-                word_offset++;
+                mem->word_offset++;
 
-                if (word_offset >= 8) {
+                if (mem->word_offset >= mem->block_words) {
                     mem->processing_read = false;
                     bus->busy = false; // Release bus
                 }
@@ -95,3 +246,46 @@ void memory_listen(MainMemory *mem, Bus *bus) {
         }
     }
 }
+
+int memory_next_event(const MainMemory *mem, const Bus *bus, int now) {
+    /*
+     * While the memory holds the bus and the latency timer is running, each
+     * cycle only decrements the timer. The first interesting cycle is the one
+     * that sees the timer at -1 and drives the first data word.
+     */
+    if (mem->processing_read) {
+        if (bus->busy && bus->current_grant == BUS_MEMORY_ID(bus) && mem->latency_timer >= 0) {
+            return now + mem->latency_timer + 1;
+        }
+        return now;
+    }
+
+    // A queued read asks for the bus once its timer is at -1
+    int next = EVENT_NEVER;
+    for (int r = 0; r < mem->num_requests; r++) {
+        int ready = now + mem->request[r].latency_timer + 1;
+        if (ready < next) next = ready;
+    }
+    return next;
+}
+
+void memory_skip_cycles(MainMemory *mem, int n) {
+    if (mem->processing_read) {
+        mem->latency_timer -= n;
+    }
+    for (int r = 0; r < mem->num_requests; r++) {
+        if (mem->request[r].latency_timer >= 0) mem->request[r].latency_timer -= n;
+    }
+}
+
+void memory_read_block(const MainMemory *mem, uint32_t base, uint32_t block[MAX_BLOCK_WORDS]) {
+    for (int w = 0; w < mem->block_words; w++) {
+        block[w] = base + w < MAIN_MEMORY_SIZE ? mem->data[base + w] : 0;
+    }
+}
+
+void memory_write_block(MainMemory *mem, uint32_t base, const uint32_t block[MAX_BLOCK_WORDS]) {
+    for (int w = 0; w < mem->block_words; w++) {
+        if (base + w < MAIN_MEMORY_SIZE) mem->data[base + w] = block[w];
+    }
+}
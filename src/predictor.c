@@ -0,0 +1,105 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    predictor.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * Branch prediction for the fetch stage. The BTB, indexed by the low bits
+ * of the PC and tagged with the full PC, remembers the target of every
+ * branch or jump that has been taken; Fetch only redirects on a BTB hit. The
+ * direction of a conditional branch comes from the selected predictor: the
+ * static backward-taken/forward-not-taken rule on the BTB target, a table of
+ * 2-bit saturating counters indexed by the PC (bimodal), or the same table
+ * indexed by the PC xor the global branch history (gshare).
+ */
+
+#include <string.h>
+#include "predictor.h"
+
+bool predictor_parse_kind(const char *name, int *kind) {
+    static const char *names[] = {"none", "btfn", "bimodal", "gshare"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *kind = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void predictor_init(Predictor *bp, PredictorKind kind, int btb_entries, int pht_entries) {
+    memset(bp, 0, sizeof(Predictor));
+    bp->kind = kind;
+    bp->btb_entries = btb_entries;
+    bp->pht_entries = pht_entries;
+    memset(bp->pht, 1, sizeof(bp->pht));
+}
+
+/*
+ * pht_index
+ * Counter used for the branch at 'pc' with the current history.
+ */
+static uint16_t pht_index(const Predictor *bp, uint32_t pc) {
+    uint32_t mask = (uint32_t)bp->pht_entries - 1;
+    if (bp->kind == PREDICT_GSHARE) return (uint16_t)((pc ^ bp->history) & mask);
+    return (uint16_t)(pc & mask);
+}
+
+Prediction predictor_predict(const Predictor *bp, uint32_t pc) {
+    Prediction p = {false, 0, pht_index(bp, pc)};
+    const BTBEntry *e = &bp->btb[pc & (bp->btb_entries - 1)];
+    if (!e->valid || e->pc != pc) return p;
+
+    p.target = e->target;
+    if (!e->conditional) {
+        p.taken = true;
+    } else if (bp->kind == PREDICT_BTFN) {
+        p.taken = e->target <= pc;
+    } else {
+        p.taken = bp->pht[p.index] >= 2;
+    }
+    return p;
+}
+
+void predictor_update(Predictor *bp, uint32_t pc, uint16_t index, bool conditional, bool taken, uint32_t target) {
+    /*
+     * 1. DIRECTION
+     * Only conditional branches train the counters and the history.
+     */
+    if (conditional && bp->kind != PREDICT_BTFN) {
+        uint8_t *counter = &bp->pht[index];
+        if (taken && *counter < 3) {
+            (*counter)++;
+            bp->changes++;
+        } else if (!taken && *counter > 0) {
+            (*counter)--;
+            bp->changes++;
+        }
+        if (bp->kind == PREDICT_GSHARE) {
+            uint32_t history = ((bp->history << 1) | taken) & ((uint32_t)bp->pht_entries - 1);
+            if (history != bp->history) bp->changes++;
+            bp->history = history;
+        }
+    }
+
+    /*
+     * 2. TARGET
+     * A taken branch claims its BTB slot with the target it went to.
+     */
+    if (taken) {
+        BTBEntry *e = &bp->btb[pc & (bp->btb_entries - 1)];
+        if (!e->valid || e->pc != pc || e->target != target || e->conditional != conditional) {
+            e->valid = true;
+            e->conditional = conditional;
+            e->pc = (uint16_t)pc;
+            e->target = (uint16_t)target;
+            bp->changes++;
+        }
+    }
+}
+
+void predictor_train(Predictor *bp, uint32_t pc, bool conditional, bool taken, uint32_t target) {
+    predictor_update(bp, pc, pht_index(bp, pc), conditional, taken, target);
+}
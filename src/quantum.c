@@ -0,0 +1,263 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    quantum.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * Approximate bound-weave engine. Cores run ahead independently for a
+ * quantum of cycles (bound), each against its private L1, and stop as soon
+ * as they need the bus. The logged bus transactions are then replayed in
+ * time order on a single shared bus (weave), which applies the MESI effects
+ * functionally and decides when every waiting core resumes.
+ *
+ * Within a quantum, a core can only hit on lines it holds with the right
+ * permission, so the run stays coherent. What is approximated is the
+ * interleaving: a core may keep reading a line during the quantum after
+ * another core's (earlier) store to it has been woven in.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "quantum.h"
+#include "io_handler.h"
+
+#define NO_REQUEST 0xFFFFFFFF
+
+bool quantum_init(QuantumState *q, int quantum, int start, int num_cores) {
+    memset(q, 0, sizeof(QuantumState));
+    q->quantum = quantum;
+    q->num_cores = num_cores;
+    q->bus_free = start;
+    q->core_time = calloc(num_cores, sizeof(int));
+    q->resume_at = calloc(num_cores, sizeof(int));
+    q->request = calloc(num_cores, sizeof(BusRequest));
+    q->fill_pending = calloc(num_cores, sizeof(bool));
+    q->fill_block = calloc(num_cores, sizeof(uint32_t));
+    if (!q->core_time || !q->resume_at || !q->request || !q->fill_pending || !q->fill_block) {
+        quantum_free(q);
+        return false;
+    }
+    for (int i = 0; i < num_cores; i++) {
+        q->core_time[i] = start;
+        q->resume_at[i] = start;
+    }
+    return true;
+}
+
+void quantum_free(QuantumState *q) {
+    free(q->core_time);
+    free(q->resume_at);
+    free(q->request);
+    free(q->fill_pending);
+    free(q->fill_block);
+    q->core_time = q->resume_at = NULL;
+    q->request = NULL;
+    q->fill_pending = NULL;
+    q->fill_block = NULL;
+}
+
+void quantum_bound(QuantumState *q, Core *core, FILE *trace, int end) {
+    int id = core->id;
+    int t = q->core_time[id];
+    Cache *cache = &core->l1_cache;
+
+    // Still waiting for a held-back request
+    if (q->request[id].valid) return;
+
+    /*
+     * 1. WAIT FOR THE BUS
+     * A core whose transaction was woven in stays frozen (stalled in MEM)
+     * until the data arrives.
+     */
+    if (!core->halted && q->resume_at[id] > t) {
+        int n = (q->resume_at[id] < end ? q->resume_at[id] : end) - t;
+        if (trace) write_core_trace_repeat(trace, core, t, n);
+        core_skip_cycles(core, n);
+        t += n;
+    }
+
+    /*
+     * 2. RUN AHEAD
+     * Execute cycles until the end of the quantum, a HALT, or a cycle that
+     * leaves the cache needing the bus. The cache accesses of a core never
+     * drive the bus, so no bus is passed to core_cycle.
+     */
+    while (t < end && !core->halted) {
+        if (trace) write_core_trace(trace, core, t);
+        core_cycle(core, NULL);
+        t++;
+        q->fill_pending[id] = false; // The first cycle retries the filled access
+
+        bool evict = cache->eviction_pending;
+        bool miss = cache->pending_addr != NO_REQUEST && !cache->is_waiting_for_fill;
+        if (evict || miss) {
+            BusRequest *r = &q->request[id];
+            r->valid = true;
+            r->time = t - 1;
+            r->evict = evict;
+            r->exclusive = cache->waiting_for_write;
+            r->addr = evict ? core->ex_mem.ALUOutput : cache->pending_addr;
+            if (miss) cache->is_waiting_for_fill = true; // The request is out
+            break;
+        }
+    }
+    q->core_time[id] = t;
+}
+
+static void trace_bus(FILE *fp, int cycle, int origid, BusCmd cmd, uint32_t addr, uint32_t data, bool shared) {
+    if (!fp) return;
+    Bus bus;
+    memset(&bus, 0, sizeof(bus));
+    bus.bus_origid = origid;
+    bus.bus_cmd = cmd;
+    bus.bus_addr = addr;
+    bus.bus_data = data;
+    bus.bus_shared = shared;
+    write_bus_trace(fp, &bus, cycle);
+}
+
+/*
+ * weave_eviction
+ * Write-back of a Modified victim: a flush word per cycle from the grant.
+ * Returns the cycle at which the core resumes.
+ */
+static int weave_eviction(QuantumState *q, Core *core, BusRequest *r, MainMemory *mem, FILE *bus_trace, int start) {
+    Cache *cache = &core->l1_cache;
+    int words = cache->geo.block_words;
+    uint32_t victim;
+    uint32_t block[MAX_BLOCK_WORDS];
+
+    if (cache_functional_evict(cache, r->addr, &victim, block)) {
+        memory_write_block(mem, victim, block);
+        for (int w = 0; w < words; w++) {
+            trace_bus(bus_trace, start + w, core->id, BUS_CMD_FLUSH, victim + w, block[w], true);
+        }
+    }
+    cache->eviction_pending = false;
+    q->bus_free = start + words;
+    return start + words - 1;
+}
+
+/*
+ * weave_miss
+ * BusRd/BusRdX: the other caches snoop the request, and the block comes from
+ * a Modified owner (flushed right after the request) or from main memory
+ * (after the read latency). Returns the cycle at which the core resumes.
+ */
+static int weave_miss(QuantumState *q, Core cores[], int id, BusRequest *r, MainMemory *mem, FILE *bus_trace,
+                      int start) {
+    Cache *cache = &cores[id].l1_cache;
+    int words = cache->geo.block_words;
+    uint32_t base = cache_block_base(cache, r->addr);
+    uint32_t block[MAX_BLOCK_WORDS];
+    int owner = -1;
+    bool shared_signal = false; // Asserted by clean sharers of a BusRd
+    bool any_copy = false;
+
+    /*
+     * 1. SNOOP
+     */
+    for (int i = 0; i < q->num_cores; i++) {
+        if (i == id) continue;
+        MesiState before = cache_probe(&cores[i].l1_cache, r->addr);
+        SnoopAction action;
+        if (!cache_functional_snoop(&cores[i].l1_cache, r->addr, r->exclusive, block, &action)) continue;
+        any_copy = true;
+        if (action != SNOOP_KEEP) owner = i;
+        if (!r->exclusive && before != MESI_MODIFIED) shared_signal = true;
+    }
+    trace_bus(bus_trace, start, id, r->exclusive ? BUS_CMD_READX : BUS_CMD_READ, r->addr, 0, shared_signal);
+
+    /*
+     * 2. DATA
+     */
+    int resume;
+    if (owner >= 0) {
+        memory_write_block(mem, base, block);
+        for (int w = 0; w < words; w++) {
+            trace_bus(bus_trace, start + 1 + w, owner, BUS_CMD_FLUSH, base + w, block[w], true);
+        }
+        q->bus_free = start + words + 1;
+        resume = start + words;
+    } else {
+        int first = start + mem->read_latency;
+        memory_read_block(mem, base, block);
+        for (int w = 0; w < words; w++) {
+            trace_bus(bus_trace, first + w, q->num_cores, BUS_CMD_FLUSH, base + w, block[w], shared_signal);
+        }
+        q->bus_free = first + words;
+        resume = first + words - 1;
+    }
+
+    /*
+     * 3. FILL
+     * The access is still registered (pending_addr), so the retry completes
+     * without counting a second hit, as after a real fill.
+     */
+    MesiState state = r->exclusive ? MESI_MODIFIED : (any_copy ? MESI_SHARED : MESI_EXCLUSIVE);
+    cache_functional_fill(cache, r->addr, block, state);
+    cache->is_waiting_for_fill = false;
+    cache->waiting_for_write = false;
+    q->fill_pending[id] = true;
+    q->fill_block[id] = base;
+    return resume;
+}
+
+/*
+ * held_back
+ * True if the request targets a block filled for another core that has not
+ * retried its access yet.
+ */
+static bool held_back(const QuantumState *q, const Core cores[], int id) {
+    const BusRequest *r = &q->request[id];
+    if (r->evict) return false;
+    uint32_t base = cache_block_base(&cores[id].l1_cache, r->addr);
+    for (int i = 0; i < q->num_cores; i++) {
+        if (i != id && q->fill_pending[i] && q->fill_block[i] == base) return true;
+    }
+    return false;
+}
+
+void quantum_weave(QuantumState *q, Core cores[], MainMemory *mem, FILE *bus_trace) {
+    while (true) {
+        // Oldest request first (ties: lowest core)
+        int id = -1;
+        for (int i = 0; i < q->num_cores; i++) {
+            if (!q->request[i].valid || held_back(q, cores, i)) continue;
+            if (id < 0 || q->request[i].time < q->request[id].time) id = i;
+        }
+        if (id < 0) return;
+
+        BusRequest *r = &q->request[id];
+        int start = r->time + 1;
+        if (start < q->bus_free) {
+            q->bus_wait_cycles += q->bus_free - start;
+            start = q->bus_free;
+        }
+
+        if (r->evict) {
+            q->resume_at[id] = weave_eviction(q, &cores[id], r, mem, bus_trace, start);
+        } else {
+            q->resume_at[id] = weave_miss(q, cores, id, r, mem, bus_trace, start);
+        }
+        r->valid = false;
+        q->transactions++;
+    }
+}
+
+bool quantum_reached(const QuantumState *q, const Core cores[], int end) {
+    for (int i = 0; i < q->num_cores; i++) {
+        if (!cores[i].halted && q->core_time[i] < end && !q->request[i].valid) return false;
+    }
+    return true;
+}
+
+int quantum_last_cycle(const QuantumState *q) {
+    int last = 0;
+    for (int i = 0; i < q->num_cores; i++) {
+        if (q->core_time[i] > last) last = q->core_time[i];
+    }
+    return last;
+}
@@ -0,0 +1,159 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    sampling.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * Statistics of sampled simulation. A sampled run executes most instructions
+ * in functional mode (which keeps the L1 caches warm) and simulates short
+ * windows in detail at a fixed instruction interval. Every measured window
+ * gives one observation of each core's IPC and L1 miss rates; their mean
+ * estimates the metric over the whole run and their spread gives a
+ * confidence interval. The cycle count of a core is extrapolated from the
+ * instructions it executed functionally and its estimated IPC.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sampling.h"
+
+bool sample_init(SampleState *s, int num_cores) {
+    memset(s, 0, sizeof(SampleState));
+    s->num_cores = num_cores;
+    s->phase = SAMPLE_FUNCTIONAL;
+    s->core = calloc(num_cores, sizeof(SampleCore));
+    s->fc = calloc(num_cores, sizeof(FuncCore));
+    if (!s->core || !s->fc) {
+        sample_free(s);
+        return false;
+    }
+    return true;
+}
+
+void sample_free(SampleState *s) {
+    free(s->core);
+    free(s->fc);
+    s->core = NULL;
+    s->fc = NULL;
+}
+
+static void stat_add(SampleStat *stat, double value) {
+    stat->n++;
+    stat->sum += value;
+    stat->sum_sq += value * value;
+}
+
+double sample_mean(const SampleStat *stat) {
+    return stat->n > 0 ? stat->sum / stat->n : -1;
+}
+
+double sample_half_width(const SampleStat *stat) {
+    if (stat->n < 2) return -1;
+    double mean = stat->sum / stat->n;
+    double variance = (stat->sum_sq - stat->n * mean * mean) / (stat->n - 1);
+    if (variance < 0) variance = 0; // Rounding of nearly constant samples
+    return SAMPLE_Z * sqrt(variance / stat->n);
+}
+
+void sample_begin(SampleState *s, const Core cores[]) {
+    for (int i = 0; i < s->num_cores; i++) {
+        const Core *core = &cores[i];
+        SampleCore *c = &s->core[i];
+        c->measuring = !core->halted;
+        c->cycles = core->stats.cycles;
+        c->instructions = core->stats.instructions;
+        c->read_hits = core->l1_cache.read_hits;
+        c->write_hits = core->l1_cache.write_hits;
+        c->read_miss = core->l1_cache.read_miss;
+        c->write_miss = core->l1_cache.write_miss;
+    }
+}
+
+void sample_end(SampleState *s, const Core cores[]) {
+    for (int i = 0; i < s->num_cores; i++) {
+        const Core *core = &cores[i];
+        SampleCore *c = &s->core[i];
+        if (!c->measuring) continue;
+        c->measuring = false;
+
+        /*
+         * 1. IPC
+         * Over the core's own cycles: a core that halts inside the window
+         * stops counting cycles there.
+         */
+        int cycles = core->stats.cycles - c->cycles;
+        if (cycles <= 0) continue;
+        stat_add(&c->ipc, (double)(core->stats.instructions - c->instructions) / cycles);
+
+        /*
+         * 2. MISS RATES
+         * Only windows with accesses of the kind observe a rate.
+         */
+        int read_miss = core->l1_cache.read_miss - c->read_miss;
+        int reads = core->l1_cache.read_hits - c->read_hits + read_miss;
+        if (reads > 0) stat_add(&c->read_miss_rate, (double)read_miss / reads);
+
+        int write_miss = core->l1_cache.write_miss - c->write_miss;
+        int writes = core->l1_cache.write_hits - c->write_hits + write_miss;
+        if (writes > 0) stat_add(&c->write_miss_rate, (double)write_miss / writes);
+    }
+    s->windows++;
+}
+
+long long sample_estimate_cycles(const SampleState *s, const Core *core, long long *half_width) {
+    const SampleCore *c = &s->core[core->id];
+    double ipc = sample_mean(&c->ipc);
+    *half_width = -1;
+    if (ipc <= 0) return c->functional > 0 ? -1 : core->stats.cycles;
+
+    // Cycles = F / IPC; the interval follows from the one of the IPC (delta method)
+    double ipc_half = sample_half_width(&c->ipc);
+    if (ipc_half >= 0) *half_width = llround(c->functional * ipc_half / (ipc * ipc));
+    return core->stats.cycles + llround(c->functional / ipc);
+}
+
+static void write_estimate(FILE *fp, const char *name, double value, double half_width) {
+    if (value < 0) {
+        fprintf(fp, "%s n/a\n%s_ci n/a\n", name, name);
+        return;
+    }
+    fprintf(fp, "%s %.4f\n", name, value);
+    if (half_width < 0) {
+        fprintf(fp, "%s_ci n/a\n", name);
+    } else {
+        fprintf(fp, "%s_ci %.4f\n", name, half_width);
+    }
+}
+
+void sample_write_report(const SampleState *s, const Core cores[], SimFiles *files) {
+    if (!files->stats_paths) return;
+    for (int i = 0; i < files->num_cores && i < s->num_cores; i++) {
+        if (!files->stats_paths[i]) continue;
+        FILE *fp = fopen(files->stats_paths[i], "a");
+        if (!fp) continue;
+
+        const SampleCore *c = &s->core[i];
+        fprintf(fp, "sample_windows %d\n", c->ipc.n);
+        fprintf(fp, "functional_instructions %lld\n", c->functional);
+
+        long long half_width;
+        long long cycles = sample_estimate_cycles(s, &cores[i], &half_width);
+        if (cycles < 0) {
+            fprintf(fp, "est_cycles n/a\nest_cycles_ci n/a\n");
+        } else if (half_width < 0) {
+            fprintf(fp, "est_cycles %lld\nest_cycles_ci n/a\n", cycles);
+        } else {
+            fprintf(fp, "est_cycles %lld\nest_cycles_ci %lld\n", cycles, half_width);
+        }
+        write_estimate(fp, "est_ipc", sample_mean(&c->ipc), sample_half_width(&c->ipc));
+        write_estimate(fp, "est_read_miss_rate", sample_mean(&c->read_miss_rate),
+                       sample_half_width(&c->read_miss_rate));
+        write_estimate(fp, "est_write_miss_rate", sample_mean(&c->write_miss_rate),
+                       sample_half_width(&c->write_miss_rate));
+        fclose(fp);
+    }
+}
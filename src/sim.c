@@ -0,0 +1,1106 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    sim.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * The simulation library. A Sim handle owns the Bus, the Main Memory and the
+ * Cores, and this file orchestrates their cycle-by-cycle execution
+ * (arbitration, bus driving, snooping, core execution and tracing).
+ *
+ * The kernel is event driven: before each cycle a linear scan of the agents
+ * (next_event_time) finds the earliest cycle at which one can change state,
+ * and runs of quiet cycles (e.g. all cores waiting on the memory latency)
+ * are skipped in a single step. Cores
+ * spinning in a steady loop that hits in L1 are fast-forwarded by the spin
+ * detector and count as passive agents.
+ *
+ * With config.threads > 1, the per-core parts of a cycle (snooping and core
+ * execution) run on a worker pool. Every phase boundary is a barrier and the
+ * only shared state, the Bus, is merged in a fixed order, so the results are
+ * identical to the serial run.
+ *
+ * With config.quantum > 0, the approximate bound-weave engine (quantum.c)
+ * replaces the cycle loop. With config.fast_forward > 0, the run starts with
+ * timing-free functional execution (functional.c). With
+ * config.sample_interval > 0, functional stretches alternate with detailed
+ * windows whose statistics are extrapolated (sampling.c).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+
+// Jobs run by the worker pool
+#define PHASE_SNOOP 0
+#define PHASE_CORES 1
+#define PHASE_BOUND 2
+
+// Instructions a core executes in functional mode before the next core's turn
+#define FUNC_SLICE 100
+
+/*
+ * request_addr
+ * Address of the request a core drives when it is granted the bus, or
+ * 0xFFFFFFFF for the write-back of an eviction.
+ */
+static uint32_t request_addr(const Core *core) {
+    const Cache *cache = &core->l1_cache;
+    if (cache->eviction_pending) return 0xFFFFFFFF;
+    return cache->num_mshrs > 0 ? cache->mshr[0].addr : cache->pending_addr;
+}
+
+/*
+ * core_wants_bus
+ * True if a core has a request for the bus: a miss, an upgrade or an update
+ * to send, or a dirty victim to write back.
+ */
+static bool core_wants_bus(const Core *core, const MainMemory *mem) {
+    const Cache *cache = &core->l1_cache;
+    bool needs_bus;
+    if (cache->num_mshrs > 0) {
+        needs_bus = cache_wants_bus(cache);
+    } else if (core->sb.depth > 0) {
+        // With a store buffer, the miss may belong to a store that has left the pipeline
+        needs_bus = cache->eviction_pending ||
+                    (cache->pending_addr != 0xFFFFFFFF && !cache->is_waiting_for_fill);
+    } else {
+        /*
+         * A blocking L1 needs the bus if its core:
+         * - Is stalled at the Memory stage.
+         * - Has a valid instruction (Load/Store).
+         * - Has a pending address (miss detected).
+         * - Is NOT already waiting for a fill (request already sent).
+         */
+        needs_bus = core->stall &&
+                    core->ex_mem.valid &&
+                    cache->pending_addr != 0xFFFFFFFF &&
+                    !cache->is_waiting_for_fill;
+
+        // Also request bus if we need to evict dirty data
+        if (cache->eviction_pending) {
+            needs_bus = true;
+        }
+    }
+
+    /*
+     * SPLIT TRANSACTIONS
+     * A request the memory cannot queue yet waits for a data phase to free
+     * an entry or, if its block is in the queue, to deliver that block.
+     * Write-backs always go.
+     */
+    uint32_t addr = request_addr(core);
+    return needs_bus && (addr == 0xFFFFFFFF || memory_accepts_request(mem, addr));
+}
+
+static void gather_bus_requests(Core cores[], int num_cores, MainMemory *mem, bool requests[]) {
+    for (int i = 0; i <= num_cores; i++) requests[i] = false;
+
+    /*
+     * 1. MEMORY REQUEST
+     * If Memory is currently processing a read (latency countdown active),
+     * it effectively holds a request to send data back when ready, which the
+     * arbiter grants ahead of any policy. On a split-transaction bus, it only asks for
+     * the data phase of a queued read whose latency has elapsed, and the
+     * arbitration policy orders it with the cores.
+     */
+    requests[num_cores] = memory_wants_bus(mem);
+
+    /*
+     * 2. CORE REQUESTS
+     * Check each core to see if it needs the bus.
+     */
+    for (int i = 0; i < num_cores; i++) {
+        requests[i] = core_wants_bus(&cores[i], mem);
+    }
+}
+
+/*
+ * block_in_flight
+ * True while a request for 'addr' on the address channel must be retried:
+ * a cache is flushing its block, or owns it but is still busy with another
+ * flush and could not answer.
+ */
+static bool block_in_flight(const Core cores[], int num_cores, uint32_t addr) {
+    for (int i = 0; i < num_cores; i++) {
+        const Cache *cache = &cores[i].l1_cache;
+        if (!cache->is_flushing) continue;
+        if (cache->flush_addr == cache_block_base(cache, addr) || cache_would_flush(cache, addr)) return true;
+    }
+    return false;
+}
+
+/*
+ * gather_channel_requests
+ * Request vectors of a separate address and data bus. The address channel
+ * carries the cores' misses, upgrades and updates (memory never uses it).
+ * A core holds its request back while its own L1 is writing a block back,
+ * since the fill may reuse the victim's line. The data channel carries the
+ * write-backs, the snooped flushes and the memory data phases. A snooped
+ * flush goes first: the owner's copy must leave before memory answers the
+ * same block or the line is reused.
+ */
+static void gather_channel_requests(Sim *sim, bool address[], bool data[]) {
+    Core *cores = sim->cores;
+    int num_cores = sim->num_cores;
+    for (int i = 0; i <= num_cores; i++) {
+        address[i] = false;
+        data[i] = false;
+    }
+
+    bool snoop_flush = false;
+    for (int i = 0; i < num_cores; i++) {
+        if (cores[i].l1_cache.is_flushing) snoop_flush = true;
+    }
+
+    for (int i = 0; i < num_cores; i++) {
+        const Cache *cache = &cores[i].l1_cache;
+        data[i] = cache->is_flushing || (!snoop_flush && cache->eviction_pending);
+        if (cache->is_flushing || cache->eviction_pending || !core_wants_bus(&cores[i], sim->memory)) continue;
+        address[i] = !block_in_flight(cores, num_cores, request_addr(&cores[i]));
+    }
+    data[num_cores] = !snoop_flush && memory_wants_bus(sim->memory);
+}
+
+/*
+ * start_eviction
+ * The write-back of a dirty victim has won the bus (the data channel).
+ */
+static void start_eviction(Cache *cache) {
+    // Transition from "Pending" to "Active Flushing"
+    cache->is_flushing = true;
+    cache->eviction_pending = false;
+    cache->flush_offset = 0;
+    cache->flush_start = 0;
+    cache->flush_supply = SUPPLY_NONE;
+}
+
+static void drive_bus_from_core(Core *core, Bus *bus) {
+    if (bus->current_grant != core->id) return;
+
+    // 1. Handle Eviction Grant
+    if (core->l1_cache.eviction_pending) {
+        start_eviction(&core->l1_cache);
+
+        // We don't drive the bus data here directly.
+        // Setting 'is_flushing' will cause cache_snoop (in the next phase)
+        // to drive the bus with BUS_CMD_FLUSH.
+        return;
+    }
+
+    // 2. Write update: the word goes to the other copies in this single bus cycle
+    if (core->l1_cache.update_pending) {
+        cache_issue_update(&core->l1_cache, bus);
+        return;
+    }
+
+    // 3. Non-blocking L1: the oldest MSHR goes out
+    if (core->l1_cache.num_mshrs > 0) {
+        cache_issue_miss(&core->l1_cache, bus);
+        return;
+    }
+
+    // 4. Store buffer: the registered miss may be a buffered store's, not MEM's
+    if (core->sb.depth > 0) {
+        bus->bus_origid = core->id;
+        bus->bus_addr = core->l1_cache.pending_addr;
+        bus->bus_cmd = cache_request_cmd(&core->l1_cache, bus->bus_addr, core->l1_cache.waiting_for_write);
+        core->l1_cache.is_waiting_for_fill = true;
+        return;
+    }
+
+    EX_MEM_Latch *latch = &core->ex_mem;
+    if (!latch->valid) return;
+
+    bus->bus_origid = core->id;
+    bus->bus_addr = latch->ALUOutput; 
+
+    if (latch->Op == OP_LW) {
+        bus->bus_cmd = BUS_CMD_READ;
+    } else if (latch->Op == OP_SW) {
+        // A write-update store miss reads the block first, an upgrade keeps its copy
+        bus->bus_cmd = cache_request_cmd(&core->l1_cache, bus->bus_addr, core->l1_cache.waiting_for_write);
+    }
+
+    /*
+     * MARK AS WAITING
+     * Once the request is on the bus, the core enters "Waiting for Fill" state.
+     * It will stop requesting the bus and start listening for data.
+     */
+    core->l1_cache.is_waiting_for_fill = true;
+}
+
+/*
+ * next_event_time
+ * Asks every agent for the next cycle at which it can change state and
+ * returns the earliest one. The answers change after every simulated cycle,
+ * so they are not kept; the scan stops at the first agent due now.
+ */
+static int next_event_time(const Sim *sim) {
+    int now = sim->cycle;
+    int earliest = EVENT_NEVER;
+    for (int i = 0; i < sim->num_cores && earliest > now; i++) {
+        int next;
+        if (spin_is_active(&sim->spin[i])) {
+            next = spin_next_event(&sim->spin[i], &sim->cores[i], now);
+        } else {
+            // A data phase only holds the bus when it carries the requests too
+            next = core_next_event(&sim->cores[i], now, sim->memory->processing_read && sim->config.data_bus == 0);
+        }
+        if (next < earliest) earliest = next;
+    }
+    if (earliest <= now) return earliest;
+    const Bus *data = sim->config.data_bus > 0 ? &sim->data_bus : &sim->bus;
+    int next = memory_next_event(sim->memory, data, now);
+    return next < earliest ? next : earliest;
+}
+
+/*
+ * execute_core
+ * Runs one cycle of a core (phase G). A core in a detected steady loop is
+ * replayed instead of simulated for as long as the lines it polls are
+ * untouched; otherwise its trace line is written and core_cycle runs.
+ */
+static void execute_core(Core *core, SpinDetector *spin, Bus *bus, FILE *trace_file, int cycle) {
+    if (spin_is_active(spin)) {
+        if (spin_still_valid(spin, core)) {
+            spin_replay(spin, core, trace_file, cycle, 1);
+            return;
+        }
+        spin_exit(spin, core);
+    }
+
+    char state[CORE_TRACE_MAX];
+    int len = format_core_trace(state, core);
+    if (spin_observe(spin, core, state, len)) {
+        spin_replay(spin, core, trace_file, cycle, 1);
+        return;
+    }
+
+    if (trace_file) write_trace_line(trace_file, cycle, state, len);
+    core_cycle(core, bus);
+}
+
+/*
+ * skip_quiet_cycles
+ * Fast-forwards 'n' cycles in which no agent changes state. Only the latency
+ * timer, the per-core counters and the core traces advance; the bus carries
+ * no command, so nothing is written to the bus trace.
+ */
+static void skip_quiet_cycles(Sim *sim, int n) {
+    for (int i = 0; i < sim->num_cores; i++) {
+        Core *core = &sim->cores[i];
+        if (core->halted) continue;
+        if (spin_is_active(&sim->spin[i])) {
+            spin_replay(&sim->spin[i], core, sim->core_trace[i], sim->cycle, n);
+            continue;
+        }
+        if (sim->core_trace[i]) write_core_trace_repeat(sim->core_trace[i], core, sim->cycle, n);
+        core_skip_cycles(core, n);
+    }
+    int reads = sim->memory->num_requests + (sim->memory->processing_read ? 1 : 0);
+    if (sim->memory->max_requests > 0 && reads > 0) {
+        sim->bus.stats.read_cycles += n;
+        sim->bus.stats.read_occupancy += (long long)reads * n;
+    }
+    memory_skip_cycles(sim->memory, n);
+    if (sim->bus.busy) sim->bus.stats.busy_cycles += n;
+    sim->cycle += n;
+}
+
+/*
+ * run_phase
+ * Worker-pool callback: runs the slice of a per-core phase that belongs to
+ * 'worker' (cores worker, worker + num_workers, ...).
+ *
+ * Snooping: a cache that is not flushing only reads the bus wires and can
+ * only raise 'bus_shared' and 'busy', so each cache snoops a private copy of
+ * the bus and the raised signals are OR-ed back afterwards.
+ * Core execution: a core only touches its own pipeline, L1, spin detector
+ * and trace file (cache_read/cache_write do not drive the bus).
+ */
+static void run_phase(void *ctx, int job, int worker, int num_workers) {
+    Sim *sim = ctx;
+    for (int i = worker; i < sim->num_cores; i += num_workers) {
+        Core *core = &sim->cores[i];
+        if (job == PHASE_SNOOP) {
+            Bus view = sim->bus;
+            cache_snoop(&core->l1_cache, &view);
+            sim->snoop_shared[i] = view.bus_shared;
+            sim->snoop_busy[i] = view.busy;
+        } else if (job == PHASE_CORES) {
+            if (core->halted) continue;
+            execute_core(core, &sim->spin[i], &sim->bus, sim->core_trace[i], sim->cycle);
+        } else if (job == PHASE_BOUND) {
+            quantum_bound(&sim->quantum, core, sim->core_trace[i], sim->bound_end);
+        }
+    }
+}
+
+/*
+ * snoop_caches
+ * Lets every cache snoop the bus (phase D). A flushing cache drives the bus
+ * wires that the caches after it observe, so that case stays serial. A
+ * cache-to-cache supply is the requester's only source of the block (memory
+ * abandons its read and is not updated), so the supplier drives the bus
+ * before any other cache snoops. On a separate data bus only the cache
+ * granted the data channel drives it, and the worker pool is only used for
+ * the address channel.
+ */
+static void snoop_caches(Sim *sim, Bus *bus) {
+    Core *cores = sim->cores;
+    bool any_flushing = false;
+    int supplier = -1;
+    for (int i = 0; i < sim->num_cores; i++) {
+        const Cache *cache = &cores[i].l1_cache;
+        bool drives = bus->channel == BUS_CHANNEL_SHARED ||
+                      (bus->channel == BUS_CHANNEL_DATA && bus->current_grant == i);
+        if (cache->is_flushing) any_flushing = true;
+        if (cache->is_flushing && drives && cache->flush_supply != SUPPLY_NONE) supplier = i;
+    }
+
+    if (!sim->pool || any_flushing || bus->channel == BUS_CHANNEL_DATA) {
+        if (supplier >= 0) cache_snoop(&cores[supplier].l1_cache, bus);
+        for (int i = 0; i < sim->num_cores; i++) {
+            if (i != supplier) cache_snoop(&cores[i].l1_cache, bus);
+        }
+        return;
+    }
+
+    pool_run(sim->pool, PHASE_SNOOP);
+    for (int i = 0; i < sim->num_cores; i++) {
+        if (sim->snoop_shared[i]) sim->bus.bus_shared = true;
+        if (sim->snoop_busy[i]) sim->bus.busy = true;
+    }
+}
+
+/*
+ * count_bus_traffic
+ * Adds the bus activity of the cycle (after phase D) to the bus statistics.
+ * A cache-to-cache supply is counted at its first word: the requested one
+ * (the memory read's target) with critical-word-first. A wider data channel
+ * counts each beat's word, but the cycle and the reads in flight once.
+ */
+static void count_bus_traffic(Bus *bus, const MainMemory *mem, int beat) {
+    BusStats *stats = &bus->stats;
+    uint32_t first = mem->critical_word_first ? mem->target_addr : 0;
+    if (beat == 0 && (bus->busy || bus->bus_cmd != BUS_CMD_NO_CMD)) stats->busy_cycles++;
+    int reads = mem->num_requests + (mem->processing_read ? 1 : 0);
+    if (mem->max_requests > 0 && reads > 0 && bus->channel != BUS_CHANNEL_DATA) {
+        stats->read_cycles++;
+        stats->read_occupancy += reads;
+    }
+
+    if (bus->bus_cmd == BUS_CMD_READ) {
+        stats->reads++;
+    } else if (bus->bus_cmd == BUS_CMD_READX) {
+        stats->read_exclusives++;
+    } else if (bus->bus_cmd == BUS_CMD_UPGRADE) {
+        stats->upgrades++;
+    } else if (bus->bus_cmd == BUS_CMD_UPDATE) {
+        stats->updates++;
+    } else if (bus->bus_cmd == BUS_CMD_FLUSH) {
+        if (bus->bus_origid == BUS_MEMORY_ID(bus)) {
+            stats->memory_read_words++;
+            return;
+        }
+        stats->flush_words++;
+        if (bus->bus_supply == SUPPLY_NONE) {
+            stats->memory_write_words++;
+        } else if (((bus->bus_addr ^ first) & (uint32_t)(mem->block_words - 1)) == 0) {
+            if (bus->bus_supply == SUPPLY_SAVES_WRITE_BACK) stats->write_backs_avoided++;
+            else stats->memory_reads_avoided++;
+        }
+    }
+}
+
+/*
+ * bus_phases
+ * Phases D to F for one bus: the snoops and the memory, the traffic
+ * counters, the Shared line and the trace. A separate data bus runs them
+ * once per data channel beat and then once for the address channel.
+ */
+static void bus_phases(Sim *sim, Bus *bus, int beat) {
+    Core *cores = sim->cores;
+
+    // D. Snooping / Memory Response Phase
+    // Order matters: If Memory is driving, Cores snoop. If Core is driving, Memory listens.
+    if (bus->current_grant == BUS_MEMORY_ID(bus)) {
+        memory_listen(sim->memory, bus);
+        snoop_caches(sim, bus);
+    } else {
+        snoop_caches(sim, bus);
+        memory_listen(sim->memory, bus);
+    }
+    count_bus_traffic(bus, sim->memory, beat);
+
+    // An inclusive LLC has replaced a block on this read: the L1s drop it
+    MainMemory *mem = sim->memory;
+    if (mem->back_invalidate_addr != LLC_NO_VICTIM) {
+        mem->llc.back_invalidations += func_back_invalidate(cores, sim->num_cores, mem, mem->back_invalidate_addr,
+                                                            &mem->llc.back_invalidation_writebacks);
+        mem->back_invalidate_addr = LLC_NO_VICTIM;
+    }
+
+    // E. Shared Signal Propagation
+    if (bus->bus_shared) {
+        // On a split bus, a core's own write-back may come between its read and the data
+        if (bus->bus_origid < sim->num_cores && (bus->bus_cmd != BUS_CMD_FLUSH || sim->config.split_bus == 0)) {
+            cores[bus->bus_origid].l1_cache.snoop_result_shared = true;
+        }
+        // Special case: If data is being flushed, the waiting core also needs to know it's shared
+        if (bus->bus_cmd == BUS_CMD_FLUSH) {
+            for (int i = 0; i < sim->num_cores; i++) {
+                const Cache *cache = &cores[i].l1_cache;
+                if (cache->is_waiting_for_fill &&
+                    cache_block_base(cache, cache->pending_addr) == cache_block_base(cache, bus->bus_addr)) {
+                    cores[i].l1_cache.snoop_result_shared = true;
+                }
+            }
+        }
+    }
+
+    // F. Trace Generation
+    if (sim->bus_trace) {
+        write_bus_trace(sim->bus_trace, bus, sim->cycle);
+    }
+}
+
+/*
+ * block_in_transfer
+ * True if the memory holds a read of the block at 'base' (queued, waiting
+ * for its latency or sending) or a cache is flushing it.
+ */
+static bool block_in_transfer(const Sim *sim, uint32_t base) {
+    const MainMemory *mem = sim->memory;
+    uint32_t block_mask = ~(uint32_t)(mem->block_words - 1);
+    if (mem->processing_read && (mem->target_addr & block_mask) == base) return true;
+    for (int r = 0; r < mem->num_requests; r++) {
+        if ((mem->request[r].addr & block_mask) == base) return true;
+    }
+    for (int i = 0; i < sim->num_cores; i++) {
+        const Cache *cache = &sim->cores[i].l1_cache;
+        if (cache->is_flushing && cache->flush_addr == base) return true;
+    }
+    return false;
+}
+
+/*
+ * retry_orphaned_fills
+ * A fill completes only with every word of its block. A requester that
+ * snoops before the owner misses the owner's flush, and memory abandons its
+ * read, so its fill is normally completed by the next read of the block.
+ * Once no agent has an event left, nothing will send it: such a fill is
+ * dropped and its request goes out again. Returns true if any was.
+ */
+static bool retry_orphaned_fills(Sim *sim) {
+    bool retried = false;
+    for (int i = 0; i < sim->num_cores; i++) {
+        Cache *cache = &sim->cores[i].l1_cache;
+        if (!cache->is_waiting_for_fill) continue;
+        if (block_in_transfer(sim, cache_block_base(cache, cache->pending_addr))) continue;
+        cache->is_waiting_for_fill = false;
+        cache->fill_words = 0;
+        cache->snoop_result_shared = false;
+        if (cache->num_mshrs > 0) cache->mshr[0].issued = false;
+        retried = true;
+    }
+    return retried;
+}
+
+/*
+ * count_requests_behind_data
+ * Shared split-transaction bus: counts the cores whose request waits while
+ * a data transfer holds the bus (after phase C), the serialization a
+ * separate data bus removes.
+ */
+static void count_requests_behind_data(Sim *sim) {
+    Bus *bus = &sim->bus;
+    bool transfer = bus->current_grant == BUS_MEMORY_ID(bus);
+    for (int i = 0; i < sim->num_cores; i++) {
+        if (sim->cores[i].l1_cache.is_flushing) transfer = true;
+    }
+    if (!transfer) return;
+    for (int i = 0; i < sim->num_cores; i++) {
+        const Core *core = &sim->cores[i];
+        if (!core->l1_cache.is_flushing && !core->l1_cache.eviction_pending && core_wants_bus(core, sim->memory)) {
+            bus->stats.requests_behind_data++;
+        }
+    }
+}
+
+/*
+ * drive_channels
+ * Phases A to C on a separate address and data bus. Each channel runs its
+ * own arbitration. The address grant drives its command at once; a data
+ * grant starts a write-back, or lets a pending snooped flush stream.
+ */
+static void drive_channels(Sim *sim) {
+    Bus *address = &sim->bus;
+    Bus *data = &sim->data_bus;
+    Core *cores = sim->cores;
+
+    // A. Reset Bus Signals (Start of Cycle)
+    bus_reset_signals(address);
+    bus_reset_signals(data);
+
+    // B. Arbitration Phase
+    gather_channel_requests(sim, sim->requests, sim->data_requests);
+    bus_arbitrate(address, &sim->arbiter, sim->requests, sim->cycle);
+    bus_arbitrate(data, &sim->data_arbiter, sim->data_requests, sim->cycle);
+
+    // C. Bus Driving Phase
+    if (address->current_grant >= 0 && address->current_grant < sim->num_cores) {
+        drive_bus_from_core(&cores[address->current_grant], address);
+        address->busy = false;
+    }
+    if (data->current_grant >= 0 && data->current_grant < sim->num_cores) {
+        Cache *cache = &cores[data->current_grant].l1_cache;
+        if (cache->eviction_pending && !cache->is_flushing) start_eviction(cache);
+    }
+}
+
+/*
+ * simulate_cycle
+ * Executes one full clock cycle of the system (phases A-H).
+ */
+static void simulate_cycle(Sim *sim) {
+    Bus *bus = &sim->bus;
+    Core *cores = sim->cores;
+
+    if (sim->config.data_bus > 0) {
+        // A-C. Separate address and data channels
+        drive_channels(sim);
+
+        // D-F. The data channel moves up to 'width' words, then the address channel runs
+        for (int beat = 0; beat < sim->data_bus.width; beat++) {
+            if (beat > 0) {
+                if (!sim->data_bus.busy) break;
+                bus_reset_signals(&sim->data_bus);
+            }
+            bus_phases(sim, &sim->data_bus, beat);
+        }
+        bus_phases(sim, bus, 0);
+    } else {
+        // A. Reset Bus Signals (Start of Cycle)
+        bus_reset_signals(bus);
+
+        // B. Arbitration Phase
+        gather_bus_requests(cores, sim->num_cores, sim->memory, sim->requests);
+        bus_arbitrate(bus, &sim->arbiter, sim->requests, sim->cycle);
+
+        // C. Bus Driving Phase
+        // Check if any core is "hijacking" the bus for a Flush (highest priority)
+        bool any_hijack = false;
+        for (int i = 0; i < sim->num_cores; i++) {
+            if (cores[i].l1_cache.is_flushing) any_hijack = true;
+        }
+
+        // If no flush is happening, let the granted core drive the bus
+        if (!any_hijack && bus->current_grant < sim->num_cores && bus->current_grant >= 0) {
+            drive_bus_from_core(&cores[bus->current_grant], bus);
+            bus->busy = false;
+        }
+        if (sim->config.split_bus > 0) count_requests_behind_data(sim);
+
+        // D-F. Snoops, memory, statistics and trace
+        bus_phases(sim, bus, 0);
+    }
+
+    // G. Core Execution Phase
+    if (sim->pool) {
+        pool_run(sim->pool, PHASE_CORES);
+    } else {
+        for (int i = 0; i < sim->num_cores; i++) {
+            if (cores[i].halted) continue;
+            execute_core(&cores[i], &sim->spin[i], bus, sim->core_trace[i], sim->cycle);
+        }
+    }
+    bool all_halted = true;
+    for (int i = 0; i < sim->num_cores; i++) {
+        if (!cores[i].halted) all_halted = false;
+    }
+
+    // H. End of Cycle Checks
+    if (all_halted) sim->done = true;
+    sim->cycle++;
+    if (sim->cycle > sim->config.max_cycles) sim->done = true;
+}
+
+/*
+ * run_quanta
+ * Bound-weave main loop: all cores run ahead towards the end of the quantum
+ * (in parallel when a worker pool exists), then their bus requests are woven
+ * in.
+ */
+static void run_quanta(Sim *sim, int target) {
+    while (!sim->done && sim->cycle < target) {
+        int end = sim->cycle + sim->config.quantum;
+        if (end > target) end = target;
+        if (end > sim->config.max_cycles + 1) end = sim->config.max_cycles + 1;
+        sim->bound_end = end;
+
+        // A core stops at its first bus request, so bound and weave alternate
+        // until every core has reached the end of the quantum (or halted).
+        while (!quantum_reached(&sim->quantum, sim->cores, end)) {
+            if (sim->pool) {
+                pool_run(sim->pool, PHASE_BOUND);
+            } else {
+                for (int i = 0; i < sim->num_cores; i++) {
+                    quantum_bound(&sim->quantum, &sim->cores[i], sim->core_trace[i], end);
+                }
+            }
+            quantum_weave(&sim->quantum, sim->cores, sim->memory, sim->bus_trace);
+        }
+        sim->cycle = end;
+
+        bool all_halted = true;
+        for (int i = 0; i < sim->num_cores; i++) {
+            if (!sim->cores[i].halted) all_halted = false;
+        }
+        if (all_halted) {
+            sim->cycle = quantum_last_cycle(&sim->quantum);
+            sim->done = true;
+        }
+        if (sim->cycle > sim->config.max_cycles) sim->done = true;
+    }
+}
+
+void sim_config_default(SimConfig *config) {
+    config->cores = 0;
+    config->max_cycles = 500000;
+    config->mem_latency = MEM_READ_LATENCY;
+    config->threads = 1;
+    config->quantum = 0;
+    config->quantum_check = 0;
+    config->fast_forward = 0;
+    config->forwarding = 0;
+    config->branch_predictor = PREDICT_NONE;
+    config->btb_entries = 16;
+    config->predictor_entries = 256;
+    config->mshrs = 0;
+    config->store_buffer = 0;
+    config->l1_sets = L1_DEFAULT_SETS;
+    config->l1_ways = L1_DEFAULT_WAYS;
+    config->l1_block = DEFAULT_BLOCK_WORDS;
+    config->l1_replacement = REPLACE_LRU;
+    config->victim_entries = 0;
+    config->l2_sets = 0;
+    config->l2_ways = 8;
+    config->l2_latency = 4;
+    config->l2_inclusive = 1;
+    config->coherence = COHERENCE_MESI;
+    config->bus_upgrade = 0;
+    config->critical_word_first = 0;
+    config->split_bus = 0;
+    config->data_bus = 0;
+    config->arbitration = ARBITRATE_ROUND_ROBIN;
+    config->tdma_slot = 1;
+    memset(config->arbitration_weights, 0, sizeof(config->arbitration_weights));
+    config->bus_stats = 0;
+    config->sample_interval = 0;
+    config->sample_warmup = 200;
+    config->sample_window = 1000;
+}
+
+/*
+ * parse_int
+ * Strict decimal conversion: the whole string must be a number in [min, max].
+ */
+static bool parse_int(const char *text, int min, int max, int *out) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0') return false;
+    if (value < min || value > max) return false;
+    *out = (int)value;
+    return true;
+}
+
+/*
+ * parse_pow2
+ * parse_int restricted to powers of two.
+ */
+static bool parse_pow2(const char *text, int min, int max, int *out) {
+    int value;
+    if (!parse_int(text, min, max, &value) || (value & (value - 1)) != 0) return false;
+    *out = value;
+    return true;
+}
+
+bool sim_config_set(SimConfig *config, const char *key, const char *value) {
+    if (strcmp(key, "cores") == 0) return parse_int(value, 1, MAX_CORES, &config->cores);
+    if (strcmp(key, "max_cycles") == 0) return parse_int(value, 1, 0x7FFFFFFE, &config->max_cycles);
+    if (strcmp(key, "mem_latency") == 0) return parse_int(value, 1, 100000, &config->mem_latency);
+    if (strcmp(key, "threads") == 0) return parse_int(value, 1, 1024, &config->threads);
+    if (strcmp(key, "quantum") == 0) return parse_int(value, 0, 1000000, &config->quantum);
+    if (strcmp(key, "quantum_check") == 0) return parse_int(value, 0, 1, &config->quantum_check);
+    if (strcmp(key, "fast_forward") == 0) return parse_int(value, 0, 0x7FFFFFFF, &config->fast_forward);
+    if (strcmp(key, "forwarding") == 0) return parse_int(value, 0, 1, &config->forwarding);
+    if (strcmp(key, "branch_predictor") == 0) return predictor_parse_kind(value, &config->branch_predictor);
+    if (strcmp(key, "btb_entries") == 0) return parse_pow2(value, 1, BTB_MAX_ENTRIES, &config->btb_entries);
+    if (strcmp(key, "predictor_entries") == 0) return parse_pow2(value, 1, PHT_MAX_ENTRIES, &config->predictor_entries);
+    if (strcmp(key, "mshrs") == 0) return parse_int(value, 0, MAX_MSHRS, &config->mshrs);
+    if (strcmp(key, "store_buffer") == 0) return parse_int(value, 0, SB_MAX_ENTRIES, &config->store_buffer);
+    if (strcmp(key, "l1_sets") == 0) return parse_pow2(value, 1, L1_MAX_LINES, &config->l1_sets);
+    if (strcmp(key, "l1_ways") == 0) return parse_pow2(value, 1, L1_MAX_WAYS, &config->l1_ways);
+    if (strcmp(key, "l1_block") == 0) return parse_pow2(value, 1, MAX_BLOCK_WORDS, &config->l1_block);
+    if (strcmp(key, "l1_replacement") == 0) return cache_parse_replacement(value, &config->l1_replacement);
+    if (strcmp(key, "victim_entries") == 0) return parse_int(value, 0, VICTIM_MAX_ENTRIES, &config->victim_entries);
+    if (strcmp(key, "l2_sets") == 0) return parse_pow2(value, 0, LLC_MAX_LINES, &config->l2_sets);
+    if (strcmp(key, "l2_ways") == 0) return parse_pow2(value, 1, LLC_MAX_WAYS, &config->l2_ways);
+    if (strcmp(key, "l2_latency") == 0) return parse_int(value, 1, 100000, &config->l2_latency);
+    if (strcmp(key, "l2_inclusive") == 0) return parse_int(value, 0, 1, &config->l2_inclusive);
+    if (strcmp(key, "coherence") == 0) return coherence_parse(value, &config->coherence);
+    if (strcmp(key, "bus_upgrade") == 0) return parse_int(value, 0, 1, &config->bus_upgrade);
+    if (strcmp(key, "critical_word_first") == 0) return parse_int(value, 0, 1, &config->critical_word_first);
+    if (strcmp(key, "split_bus") == 0) return parse_int(value, 0, MEM_MAX_REQUESTS, &config->split_bus);
+    if (strcmp(key, "data_bus") == 0) return parse_int(value, 0, MAX_BLOCK_WORDS, &config->data_bus);
+    if (strcmp(key, "arbitration") == 0) return arbiter_parse_policy(value, &config->arbitration);
+    if (strcmp(key, "tdma_slot") == 0) return parse_int(value, 1, 100000, &config->tdma_slot);
+    if (strcmp(key, "arbitration_weights") == 0) {
+        return arbiter_parse_weights(value, config->arbitration_weights, MAX_CORES + 1);
+    }
+    if (strcmp(key, "bus_stats") == 0) return parse_int(value, 0, 1, &config->bus_stats);
+    if (strcmp(key, "sample_interval") == 0) return parse_int(value, 0, 0x7FFFFFFF, &config->sample_interval);
+    if (strcmp(key, "sample_warmup") == 0) return parse_int(value, 0, 1000000, &config->sample_warmup);
+    if (strcmp(key, "sample_window") == 0) return parse_int(value, 1, 1000000, &config->sample_window);
+    return false;
+}
+
+bool sim_config_apply(SimConfig *config, const char *assignment) {
+    char key[64];
+    const char *eq = strchr(assignment, '=');
+    if (!eq) return false;
+
+    size_t key_len = (size_t)(eq - assignment);
+    if (key_len == 0 || key_len >= sizeof(key)) return false;
+    memcpy(key, assignment, key_len);
+    key[key_len] = '\0';
+    return sim_config_set(config, key, eq + 1);
+}
+
+Sim *sim_create(const SimConfig *config) {
+    int num_cores = config->cores ? config->cores : DEFAULT_NUM_CORES;
+    if (num_cores < 1 || num_cores > MAX_CORES) return NULL;
+    if ((config->mshrs > 0 || config->store_buffer > 0 || config->victim_entries > 0) && config->quantum > 0) return NULL;
+    if (config->mshrs > 0 && (config->store_buffer > 0 || config->victim_entries > 0)) return NULL;
+    if (config->l2_sets > 0 && (config->quantum > 0 || config->l2_sets * config->l2_ways > LLC_MAX_LINES)) return NULL;
+    if ((config->coherence != COHERENCE_MESI || config->bus_upgrade || config->critical_word_first ||
+         config->split_bus) && config->quantum > 0) {
+        return NULL;
+    }
+    if (config->coherence == COHERENCE_DRAGON && config->mshrs > 0) return NULL;
+    if (config->data_bus > 0 && config->split_bus == 0) return NULL;
+    if (config->arbitration != ARBITRATE_ROUND_ROBIN && config->quantum > 0) return NULL;
+    if (config->l1_sets * config->l1_ways > L1_MAX_LINES ||
+        config->l1_sets * config->l1_ways * config->l1_block > L1_MAX_WORDS) {
+        return NULL;
+    }
+
+    Sim *sim = calloc(1, sizeof(Sim));
+    if (!sim) return NULL;
+    sim->config = *config;
+    sim->config.cores = num_cores;
+    sim->num_cores = num_cores;
+
+    /*
+     * The memory image is calloc'ed rather than cleared: untouched pages are
+     * provided zeroed by the OS, so creating an instance does not pay for
+     * the full 8 MB. The per-core storage is sized by the core count.
+     */
+    sim->memory = memory_create();
+    sim->cores = calloc(num_cores, sizeof(Core));
+    sim->spin = calloc(num_cores, sizeof(SpinDetector));
+    sim->requests = calloc(num_cores + 1, sizeof(bool));
+    sim->data_requests = calloc(num_cores + 1, sizeof(bool));
+    sim->snoop_shared = calloc(num_cores, sizeof(bool));
+    sim->snoop_busy = calloc(num_cores, sizeof(bool));
+    sim->core_trace = calloc(num_cores, sizeof(FILE *));
+    if (!sim->memory || !sim->cores || !sim->spin || !sim->requests || !sim->data_requests ||
+        !sim->snoop_shared || !sim->snoop_busy || !sim->core_trace ||
+        !quantum_init(&sim->quantum, config->quantum, 0, num_cores) ||
+        (config->sample_interval > 0 && !sample_init(&sim->sampling, num_cores))) {
+        sim_destroy(sim);
+        return NULL;
+    }
+
+    sim->memory->read_latency = config->mem_latency;
+    sim->memory->block_words = config->l1_block;
+    sim->memory->critical_word_first = config->critical_word_first;
+    sim->memory->max_requests = config->split_bus;
+    llc_configure(&sim->memory->llc, config->l2_sets, config->l2_ways, config->l1_block,
+                  config->l2_latency, config->l2_inclusive);
+    bus_init(&sim->bus, num_cores);
+    bus_init(&sim->data_bus, num_cores);
+    arbiter_init(&sim->arbiter, num_cores, config->arbitration, config->tdma_slot, config->arbitration_weights,
+                 config->split_bus == 0);
+    arbiter_init(&sim->data_arbiter, num_cores, config->arbitration, config->tdma_slot, config->arbitration_weights,
+                 false);
+    if (config->data_bus > 0) {
+        sim->bus.channel = BUS_CHANNEL_ADDRESS;
+        sim->data_bus.channel = BUS_CHANNEL_DATA;
+        sim->data_bus.width = config->data_bus;
+    }
+    for (int i = 0; i < num_cores; i++) {
+        core_init(&sim->cores[i], i, NULL);
+        cache_set_geometry(&sim->cores[i].l1_cache, config->l1_sets, config->l1_ways,
+                           config->l1_block, config->l1_replacement);
+        sim->cores[i].forwarding = config->forwarding;
+        predictor_init(&sim->cores[i].predictor, config->branch_predictor,
+                       config->btb_entries, config->predictor_entries);
+        sim->cores[i].l1_cache.num_mshrs = config->mshrs;
+        sim->cores[i].l1_cache.victim_entries = config->victim_entries;
+        sim->cores[i].l1_cache.protocol = config->coherence;
+        sim->cores[i].l1_cache.upgrades = config->bus_upgrade;
+        sim->cores[i].l1_cache.critical_word_first = config->critical_word_first;
+        sim->cores[i].l1_cache.split_bus = config->split_bus > 0;
+        sb_init(&sim->cores[i].sb, config->store_buffer);
+        spin_init(&sim->spin[i]);
+    }
+
+    // More workers than cores would have nothing to do
+    int workers = config->threads < num_cores ? config->threads : num_cores;
+    if (workers > 1) sim->pool = pool_create(workers, run_phase, sim);
+    return sim;
+}
+
+bool sim_load(Sim *sim, SimFiles *files) {
+    if (files->num_cores != sim->num_cores) return false;
+
+    load_memin_file(sim->memory, files);
+    for (int i = 0; i < sim->num_cores; i++) {
+        core_load_imem(&sim->cores[i], files->imem_paths[i]);
+    }
+
+    if (files->bustrace_path) sim->bus_trace = fopen(files->bustrace_path, "w");
+    for (int i = 0; i < sim->num_cores && files->coretrace_paths; i++) {
+        if (files->coretrace_paths[i]) sim->core_trace[i] = fopen(files->coretrace_paths[i], "w");
+    }
+    return true;
+}
+
+/*
+ * run_lockstep
+ * Exact main loop: next-event scan, quiet-cycle skipping and full cycles.
+ */
+static void run_lockstep(Sim *sim, int target) {
+    while (!sim->done && sim->cycle < target) {
+
+        // Next Event: jump straight to the next cycle where something happens
+        int next = next_event_time(sim);
+        if (next == EVENT_NEVER && retry_orphaned_fills(sim)) next = sim->cycle;
+        if (next > sim->config.max_cycles + 1) next = sim->config.max_cycles + 1;
+        if (next > target) next = target;
+        if (next > sim->cycle) {
+            skip_quiet_cycles(sim, next - sim->cycle);
+            if (sim->cycle > sim->config.max_cycles) sim->done = true;
+            continue;
+        }
+
+        simulate_cycle(sim);
+    }
+
+    // Expose a consistent pipeline state for cores inside a fast-forwarded loop
+    for (int i = 0; i < sim->num_cores; i++) {
+        if (spin_is_active(&sim->spin[i])) spin_sync(&sim->spin[i], &sim->cores[i]);
+    }
+}
+
+/*
+ * run_detailed
+ * Runs the timing model selected by the configuration.
+ */
+static void run_detailed(Sim *sim, int target) {
+    if (sim->config.quantum > 0) {
+        run_quanta(sim, target);
+    } else {
+        run_lockstep(sim, target);
+    }
+}
+
+/*
+ * fast_forward_cores
+ * Functional execution of up to 'instructions' instructions per core, using
+ * the caller's FuncCore array. Returns the number executed by all cores, or
+ * -1 if the bound-weave state cannot be re-created.
+ */
+static long long fast_forward_cores(Sim *sim, FuncCore fc[], long long instructions) {
+    /*
+     * 1. ENTER
+     * Settle the bus, then take over the architectural state of every core
+     * (a core inside a replayed loop is first given its real pipeline state).
+     */
+    for (int i = 0; i < sim->num_cores; i++) {
+        if (spin_is_active(&sim->spin[i])) spin_sync(&sim->spin[i], &sim->cores[i]);
+        spin_init(&sim->spin[i]);
+    }
+    func_quiesce(sim->cores, sim->num_cores, sim->memory, &sim->bus);
+    sim->data_bus.busy = false;
+    arbiter_quiesce(&sim->arbiter);
+    arbiter_quiesce(&sim->data_arbiter);
+    for (int i = 0; i < sim->num_cores; i++) func_enter(&fc[i], &sim->cores[i]);
+
+    /*
+     * 2. EXECUTE
+     * The cores take turns in slices of FUNC_SLICE instructions, so that a
+     * core waiting on another one (e.g. for a token) sees it progress.
+     */
+    long long total = 0;
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (int i = 0; i < sim->num_cores; i++) {
+            long long left = instructions - fc[i].instructions;
+            if (left <= 0 || sim->cores[i].halted) continue;
+            long long done = func_run(&fc[i], sim->cores, sim->num_cores, i, sim->memory,
+                                      left < FUNC_SLICE ? left : FUNC_SLICE);
+            if (done > 0) progress = true;
+            total += done;
+        }
+    }
+
+    /*
+     * 3. LEAVE
+     * Restart the pipelines (and the bound-weave state) at the reached point.
+     */
+    bool all_halted = true;
+    for (int i = 0; i < sim->num_cores; i++) {
+        func_leave(&fc[i], &sim->cores[i]);
+        if (!sim->cores[i].halted) all_halted = false;
+    }
+    if (sim->config.quantum > 0) {
+        quantum_free(&sim->quantum);
+        if (!quantum_init(&sim->quantum, sim->config.quantum, sim->cycle, sim->num_cores)) return -1;
+    }
+    if (all_halted) sim->done = true;
+    return total;
+}
+
+/*
+ * run_sampled
+ * Sampling driver: a functional stretch of config.sample_interval
+ * instructions per core, then config.sample_warmup detailed cycles to refill
+ * the pipelines and the bus, then a measured window of config.sample_window
+ * detailed cycles, repeated until the run finishes. The phase survives
+ * between calls, so stepping does not change the schedule. A window cut
+ * short by the end of the run is still measured.
+ */
+static void run_sampled(Sim *sim, int target) {
+    SampleState *s = &sim->sampling;
+    while (!sim->done && sim->cycle < target) {
+        if (s->phase == SAMPLE_FUNCTIONAL) {
+            if (fast_forward_cores(sim, s->fc, sim->config.sample_interval) < 0) {
+                sim->done = true;
+                return;
+            }
+            for (int i = 0; i < sim->num_cores; i++) s->core[i].functional += s->fc[i].instructions;
+            s->phase = SAMPLE_WARMUP;
+            s->phase_end = sim->cycle + sim->config.sample_warmup;
+            continue;
+        }
+
+        run_detailed(sim, s->phase_end < target ? s->phase_end : target);
+        if (sim->cycle < s->phase_end) continue;
+
+        if (s->phase == SAMPLE_WARMUP) {
+            sample_begin(s, sim->cores);
+            s->phase = SAMPLE_MEASURE;
+            s->phase_end = sim->cycle + sim->config.sample_window;
+        } else {
+            sample_end(s, sim->cores);
+            s->phase = SAMPLE_FUNCTIONAL;
+        }
+    }
+    if (sim->done && s->phase == SAMPLE_MEASURE) {
+        sample_end(s, sim->cores);
+        s->phase = SAMPLE_FUNCTIONAL;
+    }
+}
+
+void sim_run_until(Sim *sim, int target) {
+    if (sim->config.fast_forward > 0 && !sim->fast_forward_done) {
+        sim->fast_forward_done = true;
+        sim->fast_forwarded = sim_fast_forward(sim, sim->config.fast_forward);
+    }
+
+    if (sim->config.sample_interval > 0) {
+        run_sampled(sim, target);
+    } else {
+        run_detailed(sim, target);
+    }
+}
+
+int sim_step(Sim *sim, int n) {
+    int start = sim->cycle;
+    sim_run_until(sim, start + n);
+    return sim->cycle - start;
+}
+
+void sim_run(Sim *sim) {
+    sim_run_until(sim, sim->config.max_cycles + 1);
+}
+
+long long sim_fast_forward(Sim *sim, long long instructions) {
+    FuncCore *fc = calloc(sim->num_cores, sizeof(FuncCore));
+    if (!fc) return -1;
+    long long total = fast_forward_cores(sim, fc, instructions);
+    free(fc);
+    return total;
+}
+
+/*
+ * write_back_victims
+ * The DSRAM/TSRAM dumps only hold the L1 arrays, so the dirty blocks left
+ * in the victim caches go to memory before memout.txt is written.
+ */
+static void write_back_victims(Sim *sim) {
+    const CoherenceProtocol *protocol = coherence_protocol(sim->config.coherence);
+    for (int i = 0; i < sim->num_cores; i++) {
+        const Cache *cache = &sim->cores[i].l1_cache;
+        for (int v = 0; v < cache->victim_entries; v++) {
+            const VictimEntry *entry = &cache->victim[v];
+            if (protocol->dirty[entry->state]) memory_write_block(sim->memory, entry->addr, entry->data);
+        }
+    }
+}
+
+void sim_write_outputs(Sim *sim, SimFiles *files) {
+    write_back_victims(sim);
+    write_regout_files(sim->cores, files);
+    write_dsram_files(sim->cores, files);
+    write_tsram_files(sim->cores, files);
+    write_stats_files(sim->cores, files);
+    if (sim->config.sample_interval > 0) sample_write_report(&sim->sampling, sim->cores, files);
+    write_memout_file(sim->memory, files);
+    if (sim->memory->llc.sets > 0) write_l2stats_file(&sim->memory->llc, files);
+    if (sim->config.coherence != COHERENCE_MESI || sim->config.bus_upgrade || sim->config.split_bus ||
+        sim->config.arbitration != ARBITRATE_ROUND_ROBIN || sim->config.bus_stats) {
+        const Bus *data = sim->config.data_bus > 0 ? &sim->data_bus : NULL;
+        const Arbiter *data_arbiter = data ? &sim->data_arbiter : NULL;
+        write_busstats_file(&sim->bus, data, &sim->arbiter, data_arbiter,
+                            coherence_protocol(sim->config.coherence)->name, sim->cycle, files);
+    }
+}
+
+void sim_destroy(Sim *sim) {
+    if (!sim) return;
+    pool_destroy(sim->pool);
+    for (int i = 0; i < sim->num_cores && sim->core_trace; i++) {
+        if (sim->core_trace[i]) fclose(sim->core_trace[i]);
+    }
+    if (sim->bus_trace) fclose(sim->bus_trace);
+    quantum_free(&sim->quantum);
+    sample_free(&sim->sampling);
+    memory_destroy(sim->memory);
+    free(sim->cores);
+    free(sim->spin);
+    free(sim->requests);
+    free(sim->data_requests);
+    free(sim->snoop_shared);
+    free(sim->snoop_busy);
+    free(sim->core_trace);
+    free(sim);
+}
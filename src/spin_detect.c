@@ -0,0 +1,249 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    spin_detect.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * Detects cores that are spinning in a steady-state loop (e.g. polling a
+ * shared flag that hits in L1) and fast-forwards them analytically. A loop is
+ * recognized when the complete pipeline state at the start of a cycle equals
+ * the state some cycles earlier, with no stores, no misses and no bus traffic
+ * in between. Until a snoop touches one of the lines the loop reads, the core
+ * provably repeats the same cycles, so they are replayed from a recording.
+ */
+
+#include <string.h>
+#include "spin_detect.h"
+
+#define HISTORY_SIZE (SPIN_MAX_PERIOD + 1)
+
+static void take_snapshot(SpinSnapshot *snap, const Core *core) {
+    memset(snap, 0, sizeof(SpinSnapshot));
+    memcpy(snap->regs, core->regs, sizeof(core->regs));
+    snap->pc = core->pc;
+    snap->if_id = core->if_id;
+    snap->id_ex = core->id_ex;
+    snap->ex_mem = core->ex_mem;
+    snap->mem_wb = core->mem_wb;
+    snap->stall = core->stall;
+    snap->halt_detected = core->halt_detected;
+    snap->branch_pending = core->branch_pending;
+    snap->branch_target = core->branch_target;
+    snap->busy_regs = core->busy_regs;
+    snap->predictor_changes = core->predictor.changes;
+}
+
+static void restore_snapshot(Core *core, const SpinSnapshot *snap) {
+    memcpy(core->regs, snap->regs, sizeof(core->regs));
+    memcpy(core->trace_regs, snap->regs, sizeof(core->regs));
+    core->pc = snap->pc;
+    core->if_id = snap->if_id;
+    core->id_ex = snap->id_ex;
+    core->ex_mem = snap->ex_mem;
+    core->mem_wb = snap->mem_wb;
+    core->stall = snap->stall;
+    core->halt_detected = snap->halt_detected;
+    core->branch_pending = snap->branch_pending;
+    core->branch_target = snap->branch_target;
+    core->busy_regs = snap->busy_regs;
+}
+
+static uint32_t snapshot_hash(const SpinSnapshot *snap) {
+    // FNV-1a over the raw snapshot, a word at a time (the snapshot is 4-byte aligned)
+    const uint32_t *p = (const uint32_t *)snap;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(SpinSnapshot) / sizeof(uint32_t); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool memory_is_idle(const Core *core) {
+    const Cache *cache = &core->l1_cache;
+    return core->sb.count == 0 &&
+           cache->pending_addr == 0xFFFFFFFF &&
+           cache->sram_check_countdown == 0 &&
+           !cache->eviction_pending &&
+           !cache->is_flushing &&
+           !cache->is_waiting_for_fill &&
+           cache->outstanding == 0;
+}
+
+static SpinEntry *history_at(SpinDetector *spin, int back) {
+    // back = 0 is the most recent observation
+    int idx = (spin->head - 1 - back + 2 * HISTORY_SIZE) % HISTORY_SIZE;
+    return &spin->history[idx];
+}
+
+void spin_init(SpinDetector *spin) {
+    spin->head = 0;
+    spin->count = 0;
+    spin->active = false;
+    spin->period = 0;
+    spin->phase = 0;
+    spin->num_watch = 0;
+}
+
+/*
+ * window_is_steady
+ * Checks the cycles between the current observation and the one 'period'
+ * cycles back: nothing may have missed, stalled on memory or stored.
+ */
+static bool window_is_steady(SpinDetector *spin, int period) {
+    SpinEntry *now = history_at(spin, 0);
+    SpinEntry *then = history_at(spin, period);
+
+    if (now->mem_stalls != then->mem_stalls ||
+        now->read_miss != then->read_miss ||
+        now->write_miss != then->write_miss ||
+        now->write_hits != then->write_hits) {
+        return false;
+    }
+
+    for (int back = 0; back <= period; back++) {
+        SpinEntry *e = history_at(spin, back);
+        if (!e->cache_idle || e->snap.stall) return false;
+        if (back > 0 && e->snap.ex_mem.valid && e->snap.ex_mem.Op == OP_SW) return false;
+    }
+    return true;
+}
+
+static void enter_loop(SpinDetector *spin, const Core *core, int period) {
+    SpinEntry *now = history_at(spin, 0);
+
+    spin->period = period;
+    spin->phase = 0;
+    spin->num_watch = 0;
+
+    for (int j = 0; j < period; j++) {
+        SpinEntry *step = history_at(spin, period - j);
+        SpinEntry *next = (j + 1 < period) ? history_at(spin, period - j - 1) : now;
+
+        spin->loop[j] = *step;
+        spin->d_instructions[j] = next->instructions - step->instructions;
+        spin->d_decode_stalls[j] = next->decode_stalls - step->decode_stalls;
+        spin->d_read_hits[j] = next->read_hits - step->read_hits;
+        spin->d_branches[j] = next->branches - step->branches;
+        spin->d_mispredicts[j] = next->mispredicts - step->mispredicts;
+        spin->d_mispredict_stalls[j] = next->mispredict_stalls - step->mispredict_stalls;
+
+        // Every load of the loop reads a line that must stay put, and the
+        // word it returned (the next step's MEM/WB) must still be there
+        const EX_MEM_Latch *mem = &step->snap.ex_mem;
+        if (mem->valid && mem->Op == OP_LW) {
+            bool known = false;
+            for (int w = 0; w < spin->num_watch; w++) {
+                if (spin->watch_addr[w] == mem->ALUOutput) known = true;
+            }
+            if (!known) {
+                spin->watch_addr[spin->num_watch] = mem->ALUOutput;
+                spin->watch_state[spin->num_watch] = cache_probe(&core->l1_cache, mem->ALUOutput);
+                spin->watch_data[spin->num_watch] = next->snap.mem_wb.MemData;
+                spin->num_watch++;
+            }
+        }
+    }
+    spin->active = true;
+}
+
+bool spin_observe(SpinDetector *spin, Core *core, const char *trace, int trace_len) {
+    /*
+     * 1. RECORD
+     * Store the state at the start of this cycle in the history ring.
+     */
+    SpinEntry *e = &spin->history[spin->head];
+    take_snapshot(&e->snap, core);
+    e->hash = snapshot_hash(&e->snap);
+    e->cache_idle = memory_is_idle(core);
+    e->instructions = core->stats.instructions;
+    e->decode_stalls = core->stats.decode_stalls;
+    e->mem_stalls = core->stats.mem_stalls;
+    e->read_hits = core->l1_cache.read_hits;
+    e->write_hits = core->l1_cache.write_hits;
+    e->read_miss = core->l1_cache.read_miss;
+    e->write_miss = core->l1_cache.write_miss;
+    e->branches = core->stats.branches;
+    e->mispredicts = core->stats.mispredicts;
+    e->mispredict_stalls = core->stats.mispredict_stalls;
+    memcpy(e->trace, trace, trace_len);
+    e->trace_len = trace_len;
+
+    int previous = spin->count;
+    spin->head = (spin->head + 1) % HISTORY_SIZE;
+    if (spin->count < HISTORY_SIZE) spin->count++;
+
+    /*
+     * 2. DETECT
+     * Look for the shortest period whose starting state equals the current
+     * one and whose cycles were all steady.
+     */
+    for (int period = 1; period <= SPIN_MAX_PERIOD && period <= previous; period++) {
+        SpinEntry *then = history_at(spin, period);
+        if (then->hash != e->hash) continue;
+        if (memcmp(&then->snap, &e->snap, sizeof(SpinSnapshot)) != 0) continue;
+        if (!window_is_steady(spin, period)) continue;
+
+        enter_loop(spin, core, period);
+
+        // A loop is only safe if every line it reads is actually resident
+        for (int w = 0; w < spin->num_watch; w++) {
+            if (spin->watch_state[w] == MESI_INVALID) {
+                spin->active = false;
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+bool spin_is_active(const SpinDetector *spin) {
+    return spin->active;
+}
+
+bool spin_still_valid(const SpinDetector *spin, const Core *core) {
+    if (!memory_is_idle(core)) return false;
+    for (int w = 0; w < spin->num_watch; w++) {
+        if (cache_probe(&core->l1_cache, spin->watch_addr[w]) != spin->watch_state[w]) return false;
+        if (cache_peek(&core->l1_cache, spin->watch_addr[w]) != spin->watch_data[w]) return false;
+    }
+    return true;
+}
+
+int spin_next_event(const SpinDetector *spin, const Core *core, int now) {
+    if (!spin_still_valid(spin, core)) return now;
+    return EVENT_NEVER;
+}
+
+void spin_replay(SpinDetector *spin, Core *core, FILE *fp, int cycle, int n) {
+    for (int i = 0; i < n; i++) {
+        int j = spin->phase;
+        SpinEntry *step = &spin->loop[j];
+
+        if (fp) write_trace_line(fp, cycle + i, step->trace, step->trace_len);
+
+        core->stats.cycles++;
+        core->stats.instructions += spin->d_instructions[j];
+        core->stats.decode_stalls += spin->d_decode_stalls[j];
+        core->l1_cache.read_hits += spin->d_read_hits[j];
+        core->stats.branches += spin->d_branches[j];
+        core->stats.mispredicts += spin->d_mispredicts[j];
+        core->stats.mispredict_stalls += spin->d_mispredict_stalls[j];
+
+        spin->phase = (j + 1 == spin->period) ? 0 : j + 1;
+    }
+}
+
+void spin_sync(const SpinDetector *spin, Core *core) {
+    restore_snapshot(core, &spin->loop[spin->phase].snap);
+}
+
+void spin_exit(SpinDetector *spin, Core *core) {
+    restore_snapshot(core, &spin->loop[spin->phase].snap);
+    spin->active = false;
+    spin->head = 0;
+    spin->count = 0;
+}
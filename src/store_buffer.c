@@ -0,0 +1,65 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    store_buffer.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * Store buffer between the MEM stage and the L1. A store retires into the
+ * buffer instead of waiting for its write-allocate miss, and the buffer
+ * writes it to the L1 in the background. Younger loads of a buffered
+ * address take the data from the buffer. Stores leave strictly in order and
+ * only after the previous one has been performed with the line Modified, so
+ * the other cores observe them in program order while this core's loads may
+ * pass them: Total Store Order.
+ */
+
+#include <string.h>
+#include "store_buffer.h"
+
+void sb_init(StoreBuffer *sb, int depth) {
+    memset(sb, 0, sizeof(StoreBuffer));
+    sb->depth = depth;
+}
+
+bool sb_push(StoreBuffer *sb, uint32_t addr, uint32_t data) {
+    if (sb->count == sb->depth) return false;
+    StoreBufferEntry *e = &sb->entry[(sb->head + sb->count) % SB_MAX_ENTRIES];
+    e->addr = addr;
+    e->data = data;
+    sb->count++;
+    return true;
+}
+
+bool sb_forward(const StoreBuffer *sb, uint32_t addr, uint32_t *data) {
+    for (int i = sb->count - 1; i >= 0; i--) {
+        const StoreBufferEntry *e = &sb->entry[(sb->head + i) % SB_MAX_ENTRIES];
+        if (e->addr == addr) {
+            *data = e->data;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool sb_blocks_load(const StoreBuffer *sb, const Cache *cache, uint32_t addr) {
+    if (!sb->owns_miss) return false;
+    // The store must retry its miss before the next arbitration, or the L1 would request it again
+    if (cache->pending_addr != 0xFFFFFFFF && !cache->is_waiting_for_fill) return true;
+    uint32_t store_addr = sb->entry[sb->head].addr;
+    if (cache_set_index(cache, store_addr) == cache_set_index(cache, addr)) return true;
+    return cache_probe(cache, addr) == MESI_INVALID;
+}
+
+void sb_drain(StoreBuffer *sb, Cache *cache, Bus *bus) {
+    if (sb->count == 0) return;
+    const StoreBufferEntry *e = &sb->entry[sb->head];
+    if (!cache_write(cache, e->addr, e->data, bus)) {
+        sb->owns_miss = true;
+        return;
+    }
+    sb->owns_miss = false;
+    sb->head = (sb->head + 1) % SB_MAX_ENTRIES;
+    sb->count--;
+}
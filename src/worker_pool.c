@@ -0,0 +1,128 @@
+/*
+ * Project: Multi-Core Cache Simulator (MIPS-like)
+ * File:    worker_pool.c
+ * Author:
+ * ID:
+ * Date:    11/11/2024
+ *
+ * Description:
+ * A small pool of persistent worker threads synchronized by a spin barrier.
+ * The simulation kernel uses it to run the per-core parts of a cycle (cache
+ * snooping, core execution) concurrently while keeping every phase boundary
+ * a hard synchronization point.
+ */
+
+#include <sched.h>
+#include <stdlib.h>
+#include "worker_pool.h"
+
+// Spins before a waiting thread starts yielding its CPU
+#define BARRIER_SPIN_LIMIT 2000
+
+static void barrier_init(SpinBarrier *b, int parties) {
+    b->parties = parties;
+    b->remaining = parties;
+    b->sense = 0;
+}
+
+static void barrier_wait(SpinBarrier *b, int *local_sense) {
+    int sense = !*local_sense;
+    *local_sense = sense;
+
+    /*
+     * 1. LAST ARRIVAL
+     * Re-arm the barrier, then release everybody by flipping the sense.
+     */
+    if (__atomic_sub_fetch(&b->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+        __atomic_store_n(&b->remaining, b->parties, __ATOMIC_RELAXED);
+        __atomic_store_n(&b->sense, sense, __ATOMIC_RELEASE);
+        return;
+    }
+
+    /*
+     * 2. WAIT
+     * Spin on the shared sense; yield once the wait gets long so that an
+     * oversubscribed host still makes progress.
+     */
+    int spins = 0;
+    while (__atomic_load_n(&b->sense, __ATOMIC_ACQUIRE) != sense) {
+        if (++spins >= BARRIER_SPIN_LIMIT) {
+            sched_yield();
+            spins = 0;
+        }
+    }
+}
+
+typedef struct {
+    WorkerPool *pool;
+    int index;
+} WorkerArg;
+
+static void *worker_main(void *arg) {
+    WorkerPool *pool = ((WorkerArg *)arg)->pool;
+    int index = ((WorkerArg *)arg)->index;
+    free(arg);
+
+    // Wait until the pool knows how many workers actually started
+    while (!__atomic_load_n(&pool->ready, __ATOMIC_ACQUIRE)) sched_yield();
+
+    while (true) {
+        barrier_wait(&pool->barrier, &pool->local_sense[index]);
+        int job = pool->job;
+        if (job == POOL_EXIT) break;
+        pool->fn(pool->ctx, job, index, pool->num_workers);
+        barrier_wait(&pool->barrier, &pool->local_sense[index]);
+    }
+    return NULL;
+}
+
+WorkerPool *pool_create(int num_workers, WorkerFn fn, void *ctx) {
+    WorkerPool *pool = calloc(1, sizeof(WorkerPool));
+    if (!pool) return NULL;
+
+    pool->num_workers = num_workers;
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->threads = calloc(num_workers, sizeof(pthread_t));
+    pool->local_sense = calloc(num_workers, sizeof(int));
+    if (!pool->threads || !pool->local_sense) {
+        free(pool->threads);
+        free(pool->local_sense);
+        free(pool);
+        return NULL;
+    }
+
+    for (int i = 1; i < num_workers; i++) {
+        WorkerArg *arg = malloc(sizeof(WorkerArg));
+        if (arg) {
+            arg->pool = pool;
+            arg->index = i;
+        }
+        if (!arg || pthread_create(&pool->threads[i], NULL, worker_main, arg) != 0) {
+            // Shrink the pool to the threads that did start
+            free(arg);
+            pool->num_workers = i;
+            break;
+        }
+    }
+    barrier_init(&pool->barrier, pool->num_workers);
+    __atomic_store_n(&pool->ready, 1, __ATOMIC_RELEASE);
+    return pool;
+}
+
+void pool_run(WorkerPool *pool, int job) {
+    pool->job = job;
+    barrier_wait(&pool->barrier, &pool->local_sense[0]);
+    pool->fn(pool->ctx, job, 0, pool->num_workers);
+    barrier_wait(&pool->barrier, &pool->local_sense[0]);
+}
+
+void pool_destroy(WorkerPool *pool) {
+    if (!pool) return;
+    pool->job = POOL_EXIT;
+    barrier_wait(&pool->barrier, &pool->local_sense[0]);
+    for (int i = 1; i < pool->num_workers; i++) pthread_join(pool->threads[i], NULL);
+    free(pool->threads);
+    free(pool->local_sense);
+    free(pool);
+}